@@ -49,6 +49,7 @@ namespace ruru
         eOutRange,
         eIsNull,
         eIsNotNull,
+        eIn,
 
         eUnknown = 0
     };
@@ -59,15 +60,22 @@ namespace ruru
     static const char* db_extension = ".ru";
     static const char* _basic_factory = "_basic_factory";
     static const char* _basic_cached_factory = "_basic_cached_factory";
+    inline constexpr const char* _columnar_factory = "_columnar_factory";
     
 
     //forward class
     class Record;
+    class RecordView;
     class Filter;
     class Table;
     class RecordTable;
     class ResultSet;
     class IDatabase;
+    class Transaction;
+    namespace internal
+    {
+        class BufferPool;
+    }
 
     using TablePtr = std::shared_ptr<Table>;
     using RecordTablePtr = std::shared_ptr<RecordTable>;
@@ -76,9 +84,40 @@ namespace ruru
     using DatabasePtr =  std::shared_ptr<IDatabase>;
     using Value_t = std::variant<int64_t, double, std::string>;
     using Filters_t = std::vector<std::shared_ptr<Filter>>;
+    using TransactionPtr = std::shared_ptr<Transaction>;
+    // records saved together, with true for a new record
+    using RecordBatch_t = std::vector<std::pair<Record *, bool>>;
+
+    // a record read by a cursor: a view on the stored record,
+    // or a decoded copy when the engine can't read it in place
+    struct CursorRecord
+    {
+        std::unique_ptr<RecordView> view;
+        std::unique_ptr<Record> record;
+    };
+
+    //interface RecordCursor
+    // streams the records matching a search as a snapshot sees them
+    class IRecordCursor
+    {
+    public:
+        // append the next records found to batch, at most max
+        // fewer than max are appended only when no record is left
+        // returns false when none was appended
+        virtual bool NextBatch(std::vector<CursorRecord> &batch, size_t max) = 0;
+
+        // a new cursor on the same candidates and snapshot, back at the first record
+        // the records it reads don't depend on the writes made since this one was opened
+        virtual std::unique_ptr<IRecordCursor> Clone() const = 0;
+
+        virtual ~IRecordCursor() {}
+    };
+    using RecordCursorPtr = std::unique_ptr<IRecordCursor>;
 
     //APIs
     //interface StorgeEngine
+    // the database calls Lookup, LoadRecord and LoadRecordView from several threads at once,
+    // and Flush while they run; the other calls have the engine to themselves
     class IStorageEngine
     {
     public:
@@ -97,6 +136,10 @@ namespace ruru
         // LoadRecord
         virtual Record *LoadRecord(RecordId id) = 0;
 
+        // Point view at the stored record without copying it
+        // engines without in place access return false, the record is then loaded with LoadRecord
+        virtual bool LoadRecordView(RecordId, RecordView &) { return false; }
+
         // Save a record and set a record id
         virtual bool Save(Record &record, bool isNew) = 0;
 
@@ -106,6 +149,53 @@ namespace ruru
         // Drop Storage
         virtual bool DropStorage() = 0;
 
+        // Create a secondary index on a column, or open it when it already exists
+        // engines without secondary indexes keep answering filters by a full scan
+        virtual bool CreateIndex(const std::string &, uint16_t, DataTypes) { return false; }
+
+        // Drop a secondary index
+        virtual bool DropIndex(const std::string &) { return false; }
+
+        // Apply a record read from the write-ahead log at recovery, the record keeps its row id
+        // engines without recovery ignore the log
+        virtual bool Replay(Record &) { return false; }
+
+        // Save a record as the version committed at commit_ts
+        // the version it replaces is kept while a snapshot older than commit_ts is pinned
+        // engines without versions save the record in place of the previous one
+        virtual bool SaveVersion(Record &record, bool isNew, uint64_t, uint64_t) { return Save(record, isNew); }
+
+        // the version of a record seen by a snapshot: the last one committed up to it
+        // nullptr or false when the record was created after the snapshot
+        virtual Record *LoadRecord(RecordId id, uint64_t) { return LoadRecord(id); }
+        virtual bool LoadRecordView(RecordId id, uint64_t, RecordView &view) { return LoadRecordView(id, view); }
+
+        // drop the versions older than the one seen by oldest_snapshot
+        virtual void ReleaseVersions(uint64_t) {}
+
+        // check the records of a transaction and give the new ones their row id, nothing is written
+        // returns false when an updated record is not found
+        // engines without batches can't take part in a transaction
+        virtual bool PrepareBatch(RecordBatch_t &) { return false; }
+
+        // give back the row ids taken by PrepareBatch, the transaction is not written
+        virtual void CancelBatch(const RecordBatch_t &) {}
+
+        // save the records checked by PrepareBatch as the versions committed at commit_ts
+        virtual bool SaveBatch(const RecordBatch_t &, uint64_t, uint64_t) { return false; }
+
+        // open a cursor on the records matching filters, as seen by snapshot
+        // the database calls NextBatch with the table latched for reading
+        // engines without cursors return nullptr, the ids found by Lookup are then loaded one by one
+        virtual RecordCursorPtr OpenCursor(const Filters_t &, uint64_t) { return nullptr; }
+
+        // share the page cache of the database, engines without a cache ignore it
+        // the pool outlives the engine
+        virtual void SetBufferPool(internal::BufferPool *) {}
+
+        // declare the type of a column, engines storing untyped records ignore it
+        virtual void SetColumnType(uint16_t, DataTypes) {}
+
         virtual ~IStorageEngine(){};
     };
     //interface StorageEngineFactory
@@ -115,6 +205,46 @@ namespace ruru
         virtual IStorageEngine* createStorageEngine( const std::string& name) = 0;
         virtual std::string getName(  ) = 0 ;
     };
+    // settings of the background flush of a database
+    struct FlushPolicy
+    {
+        // time between two flushes in milliseconds, 0 stops the background flush
+        uint32_t interval_ms = 1000;
+        // the flush starts as soon as this amount of data was saved since the last one
+        uint64_t dirty_threshold = 16 * 1024 * 1024;
+        // Save waits for the flush while more data than this is not flushed
+        uint64_t dirty_budget = 256 * 1024 * 1024;
+    };
+
+    // settings of Table::Import
+    struct ImportOptions
+    {
+        enum class Format : uint8_t
+        {
+            // comma separated values, quoted as in RFC 4180
+            eCsv = 1,
+            // one flat JSON object per line, keys are column names
+            eJsonLines
+        };
+        Format format = Format::eCsv;
+        // csv: the first line names the columns, otherwise the values follow the columns of the table
+        bool header = true;
+        char delimiter = ',';
+        // parser threads, 0: one per core
+        unsigned threads = 0;
+        // input is parsed by chunks of about this size, every chunk is inserted with one BulkInsert
+        size_t chunk_size = 1024 * 1024;
+    };
+
+    // outcome of Table::Import
+    struct ImportResult
+    {
+        // records inserted
+        uint64_t rows = 0;
+        // line of the first record that could not be read, 0 when all were read
+        uint64_t error_line = 0;
+    };
+
     //Interface IDatabase
     class IDatabase  : public std::enable_shared_from_this<IDatabase>
     {
@@ -149,6 +279,28 @@ namespace ruru
         */
         virtual bool setStorageEngineFactory ( IStorageEngineFactory* factory) = 0;
 
+        // durability of RecordTable::Save
+        /*
+            \param sync true: Save returns once the change is synced in the write-ahead log,
+                   the saves committing at the same time share one sync.
+                   false (default): the log is written in the background of the saves
+                   and synced at the next checkpoint.
+        */
+        virtual void setSyncCommit(bool sync) = 0;
+
+        // flush the tables and restart the write-ahead log
+        virtual bool checkpoint() = 0;
+
+        // settings of the background flush, the tables are flushed every second by default
+        virtual void setFlushPolicy(const FlushPolicy &policy) = 0;
+
+        // start a transaction, see Transaction
+        virtual TransactionPtr beginTransaction() = 0;
+
+        // memory in bytes of the pages cached by the tables of the database (64MB by default)
+        // over it the pages not used recently are evicted
+        virtual void setCacheBudget(uint64_t bytes) = 0;
+
         virtual ~IDatabase() {};
 
     };
@@ -158,11 +310,30 @@ namespace ruru
     {
         Table* table_;
         Filters_t filters_;
-        std::vector<RecordId> records_id_;
+        // the records are read by batches from the storage engine
+        RecordCursorPtr cursor_;
+        // records of the current batch, batch_start_ is the position of the first one
+        std::vector<RecordTablePtr> batch_;
+        int64_t batch_start_;
+        // the cursor has no record left
+        bool exhausted_;
         int64_t iter_;
+        // count of the records, -1 until it is known
+        int64_t size_;
+        // the records are read as they were when the search ran
+        std::shared_ptr<const uint64_t> snapshot_;
         ResultSet(const Filters_t &filters);
         friend class Table;
 
+        // a small first batch returns the first record at once
+        static constexpr size_t FIRST_BATCH_SIZE = 64;
+        static constexpr size_t BATCH_SIZE = 1024;
+
+        // read the batch following the current one, false when no record is left
+        bool _NextBatch();
+        // the record at iter_, nullptr past the end
+        RecordTablePtr _Current();
+
     public:
         // get the first record
         std::shared_ptr<RecordTable> First();
@@ -181,6 +352,10 @@ namespace ruru
         Value_t value1;
         Value_t value2;
 
+        // eIn: list of accepted values
+        std::vector<Value_t> values;
+
+        // eInRange and eOutRange bounds are [v1, v2], both included in the range
         Filter(uint16_t column_indx, OperatorType oper, const Value_t &v1, const Value_t &v2)
         :column_indx(column_indx)
         ,oper(oper)
@@ -188,6 +363,14 @@ namespace ruru
         ,value2(v2)
         {}
 
+        // IN list filter
+        Filter(uint16_t column_indx, const std::vector<Value_t> &in_values)
+        :column_indx(column_indx)
+        ,oper(OperatorType::eIn)
+        ,values(in_values)
+        {}
+
+        // apply the filter on a non null value
         template <typename T>
         bool Apply(const T &value) const
         {
@@ -216,15 +399,28 @@ namespace ruru
                 Value_t v = value;
                 return v <= value1;
             }
-            else if (oper == OperatorType::eIsNull)
+            else if (oper == OperatorType::eInRange)
             {
                 Value_t v = value;
-                return v <= value1;
+                return v >= value1 && v <= value2;
             }
-            else if (oper == OperatorType::eIsNotNull)
+            else if (oper == OperatorType::eOutRange)
             {
                 Value_t v = value;
-                return v <= value1;
+                return v < value1 || v > value2;
+            }
+            else if (oper == OperatorType::eIn)
+            {
+                Value_t v = value;
+                return std::find(values.begin(), values.end(), v) != values.end();
+            }
+            else if (oper == OperatorType::eIsNull)
+            {
+                return false;
+            }
+            else if (oper == OperatorType::eIsNotNull)
+            {
+                return true;
             }
             else
             {
@@ -233,6 +429,12 @@ namespace ruru
             }
             return false;
         }
+
+        // apply the filter on a null value
+        bool ApplyNull() const
+        {
+            return oper == OperatorType::eIsNull;
+        }
     };
 
 
@@ -297,9 +499,20 @@ namespace ruru
 
         // friend class
         friend class Database;
+        friend class ResultSet;
 
         // private member function
         RecordTablePtr _CreateRecordTableFromRec(Record *rec);
+        RecordTablePtr _CreateRecordTableFromView(RecordView *view);
+
+        // get the version of a record seen by a snapshot
+        RecordTablePtr _GetRecord(RecordId id, const uint64_t *snapshot);
+
+        // open a cursor on the records matching filters, as seen by snapshot
+        RecordCursorPtr _OpenCursor(const Filters_t &filters, uint64_t snapshot);
+
+        // read the next records of a cursor, false when no record is left
+        bool _FetchBatch(IRecordCursor &cursor, size_t max, std::vector<RecordTablePtr> &batch);
 
         Table(std::string name, std::shared_ptr<IDatabase> db);
 
@@ -344,17 +557,42 @@ namespace ruru
 
         // get record from storage
         RecordTablePtr GetRecord(RecordId id);
+
+        // insert new records of the table with a single write
+        // the records are encoded into one buffer appended to the data file, the index
+        // entries are sorted and merged into each index in one pass. A batch of up to 64MB
+        // is one transaction: all the records are inserted or none. A larger batch is
+        // inserted by transactions of about 64MB, a failure leaves the ones before it inserted.
+        // Every record gets its row id.
+        bool BulkInsert(const std::vector<RecordTablePtr> &records);
+
+        // insert the records of a CSV or newline-delimited JSON file
+        // several threads parse the file by chunks, the values are converted to the
+        // column types, the chunks are inserted in file order by the calling thread.
+        // Empty values and JSON nulls are nulls, binary columns are left null.
+        // Stops at the first record that can't be read, the chunks before it stay inserted.
+        bool Import(const std::filesystem::path &path, const ImportOptions &options, ImportResult *result = nullptr);
     };
 
     // RecordTable represent a record inside the table
-    // it encapsulates the Record
+    // it encapsulates the Record, or a view on the stored record until
+    // the record is modified
     class RecordTable
     {
         Table *table;
         Record *record;
+        RecordView *view;
         RecordType type;
         RecordTable(Table *tbl, Record *rec);
+        RecordTable(Table *tbl, RecordView *view);
         friend class Table;
+        friend class Database;
+
+        // type and payload of a field, data is nullptr for a null
+        bool _GetField(const std::string &field_name, DataTypes &type, const char *&data) const;
+
+        // copy the viewed record before a modification
+        void _Materialize();
 
     public:
         RecordTable() = delete;
@@ -380,6 +618,11 @@ namespace ruru
         bool
         GetFieldValue(const std::string &field_name, std::string &value);
 
+        // the string points into the record, valid as long as the RecordTable
+        // is alive and the field is not modified
+        bool
+        GetFieldValue(const std::string &field_name, std::string_view &value);
+
         // binary
         bool
         GetFieldValue(const std::string &field_name, std::shared_ptr<char> &value);
@@ -391,6 +634,49 @@ namespace ruru
         virtual ~RecordTable();
     };
 
+    /*
+        \class Transaction
+        \brief records saved together, in one or more tables of a database
+               save adds a record to the transaction, it is written by commit as it is
+               at that time. commit writes all the records or none of them: the new
+               ones get their row id, the log gets a single entry and every table is
+               written once. The readers see the records of a transaction together.
+               A transaction that is not committed is rolled back when it is released.
+    */
+    class Transaction
+    {
+        std::weak_ptr<IDatabase> database;
+        // records in save order
+        std::vector<RecordTablePtr> records;
+        // position of each record in records
+        std::unordered_map<const RecordTable *, size_t> saved;
+        bool active;
+        Transaction(const std::weak_ptr<IDatabase> &db);
+        friend class Database;
+
+    public:
+        Transaction() = delete;
+        Transaction(const Transaction &) = delete;
+        Transaction &operator=(const Transaction &) = delete;
+
+        // add a record to the transaction, a record saved twice is written once
+        // returns false once the transaction is committed or rolled back
+        bool save(const RecordTablePtr &record);
+
+        // write the records of the transaction
+        // returns false when none are written: an updated record is missing,
+        // a table is gone, or the transaction is over
+        bool commit();
+
+        // drop the records of the transaction, nothing is written
+        void rollback();
+
+        // records can be added
+        bool isActive() const { return active; }
+
+        ~Transaction();
+    };
+
 
 
     bool registerEngineFactory( const std::string& name , IStorageEngineFactory* engineFactory);
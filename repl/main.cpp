@@ -39,6 +39,12 @@ unsigned info(const std::vector<std::string> &args)
         std::cout << "\nOpen an already existing database\n"
                   << "ex: open path/to/db.ru\n\n";
     }
+    else if (args[1] == "database")
+    {
+        std::cout << "\nImport a CSV file (with a header line) or a JSON lines file into a table\n"
+                  << "ex: database table Employee import path/to/employees.csv\n"
+                  << "    database table Employee import path/to/employees.json json\n\n";
+    }
 
     return ret::Ok;
 }
@@ -142,6 +148,22 @@ unsigned describe_table(std::shared_ptr<ruru::Table> tbl)
     return ret::Ok;
 }
 
+unsigned import_file(std::shared_ptr<ruru::Table> tbl, const std::string &path, const std::string &format)
+{
+    if (tbl == nullptr)
+        return ret::Error;
+
+    ruru::ImportOptions options;
+    if (format == "json")
+        options.format = ruru::ImportOptions::Format::eJsonLines;
+    ruru::ImportResult result;
+    bool ok = tbl->Import(path, options, &result);
+    std::cout << result.rows << " records imported\n";
+    if (!ok && result.error_line != 0)
+        std::cout << "cannot read line " << result.error_line << "\n";
+    return ok ? ret::Ok : ret::Error;
+}
+
 unsigned openDB(const std::vector<std::string> &args)
 {
     if (args.size() < 2)
@@ -194,6 +216,11 @@ unsigned dbCmd(const std::vector<std::string> &args)
         {
             return describe_table(table);
         }
+        else if ( args.size() > 4 && args[3] == "import")
+        {
+            // database table <name> import <file> [csv|json]
+            return import_file(table, args[4], args.size() > 5 ? args[5] : "csv");
+        }
     }
 
     return ret::Ok;
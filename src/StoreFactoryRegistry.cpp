@@ -2,6 +2,7 @@
 #include "ruru.h"
 #include "internal/basic_storage_engine.h"
 #include "internal/basic_storage_with_cache.h"
+#include "internal/columnar_storage_engine.h"
 
 static std::map<std::string, ruru::IStorageEngineFactory *> gEngineFactoryRegistry;
 
@@ -34,7 +35,12 @@ namespace ruru
             internal::BasicCachedStorageEngineFactory *factory = new internal::BasicCachedStorageEngineFactory();
             gEngineFactoryRegistry[_basic_cached_factory] = factory;
         }
-        
+        if (gEngineFactoryRegistry.find(_columnar_factory) == gEngineFactoryRegistry.end())
+        {
+            internal::ColumnarStorageEngineFactory *factory = new internal::ColumnarStorageEngineFactory();
+            gEngineFactoryRegistry[_columnar_factory] = factory;
+        }
+
     }
 
     void Init()
@@ -5,6 +5,10 @@
 #include "database.h"
 #include "record.h"
 #include "internal/basic_storage_engine.h"
+#include "internal/wal.h"
+#include "internal/buffer_pool.h"
+#include "flusher.h"
+#include "version_clock.h"
 namespace ruru
 {
     // constants
@@ -48,10 +52,18 @@ namespace ruru
 #pragma region
 
     Database::Database(const std::filesystem::path &path)
-        : name(path.filename()), path(path), schema(nullptr),storeFactory(nullptr)
+        : name(path.filename()), path(path), schema(nullptr),storeFactory(nullptr), syncCommit(false),
+          versionClock(std::make_shared<VersionClock>()), bufferPool(new internal::BufferPool())
     {
     }
 
+    void Database::_initLog(bool truncate)
+    {
+        wal.reset(new internal::WriteAheadLog(path.string() + ".wal"));
+        if (!wal->Open(truncate))
+            wal.reset();
+    }
+
     void Database::_initSchemaDB()
     {
         assert(schema == nullptr);
@@ -70,6 +82,7 @@ namespace ruru
         Database *impl_schema = reinterpret_cast<Database *>(schema.get());
         impl_schema->tables[__schema] = schemaTable;
         impl_schema->storageEngines[__schema] = schemaStore;
+        impl_schema->tableLatches[__schema].reset(new std::shared_mutex());
     }
 
     std::shared_ptr<IDatabase> IDatabase::newDatabase(const std::filesystem::path &path)
@@ -78,6 +91,8 @@ namespace ruru
         auto xdb = new Database(path);
         db.reset(xdb);
         xdb->_initSchemaDB();
+        xdb->_initLog(true);
+        xdb->_initFlusher();
 
         return db;
     }
@@ -122,6 +137,12 @@ namespace ruru
                 Column cl(xname, getTypeFromString(xtype));
                 tbl->addColumn(cl);
             }
+            else if (xkind == "INDEX")
+            {
+                // object_type holds the indexed column
+                TablePtr tbl = db->getTable(xparent);
+                tbl->addIndex(xtype, xname);
+            }
             else if ( xkind == "ENGINEFACTORY")
             {
                 // the factory to be used for the DB
@@ -137,11 +158,15 @@ namespace ruru
                 assert(false && "NOT IMPLEMENTED");
             }
         }
+        db->_initLog(false);
+        db->_recover();
+        db->_initFlusher();
         return ptr;
     }
 
     TablePtr Database::newTable(const std::string &table_name)
     {
+        std::unique_lock<std::shared_mutex> lock(catalogLatch);
         if (tables.find(table_name) != tables.end())
             return tables[table_name];
 
@@ -154,12 +179,16 @@ namespace ruru
             store = storeFactory->createStorageEngine(parent.append(table_name + db_extension));
         else
             store = new BasicStorageEngine(parent.append(table_name + db_extension));
+        store->SetBufferPool(bufferPool.get());
         storageEngines[table_name] = store;
+        if (tableLatches.find(table_name) == tableLatches.end())
+            tableLatches[table_name].reset(new std::shared_mutex());
         return tbl;
     }
 
     TablePtr Database::getTable(const std::string &tableName)
     {
+        std::shared_lock<std::shared_mutex> lock(catalogLatch);
         auto it = tables.find(tableName);
         if (it == tables.end())
             return nullptr;
@@ -169,6 +198,7 @@ namespace ruru
 
     std::vector<TablePtr> Database::getAllTables()
     {
+        std::shared_lock<std::shared_mutex> lock(catalogLatch);
         std::vector<TablePtr> res;
         for (auto &[name, table] : tables)
         {
@@ -179,12 +209,14 @@ namespace ruru
 
     void Database::removeTable(const std::string &tableName)
     {
+        std::unique_lock<std::shared_mutex> lock(catalogLatch);
         tables.erase(tableName);
         storageEngines.erase(tableName);
     }
 
     IStorageEngine *Database::getStorageEngine(const std::string &tableName)
     {
+        std::shared_lock<std::shared_mutex> lock(catalogLatch);
         auto it = storageEngines.find(tableName);
         if (it == storageEngines.end())
             return nullptr;
@@ -192,6 +224,12 @@ namespace ruru
             return it->second;
     }
 
+    std::shared_mutex &Database::getTableLatch(const std::string &tableName)
+    {
+        std::shared_lock<std::shared_mutex> lock(catalogLatch);
+        return *tableLatches.at(tableName);
+    }
+
     bool Database::saveSchema(const std::filesystem::path &path)
     {
         bool result = true;
@@ -203,12 +241,13 @@ namespace ruru
         store_schema->DropStorage();
         //store the engine factory 
         auto rec = tbl_schema->CreateRecord();
-        rec->SetFieldValue("object_name", _basic_factory);
+        rec->SetFieldValue("object_name", storeFactory != nullptr ? storeFactory->getName() : std::string(_basic_factory));
         rec->SetFieldValue("object_kind", "ENGINEFACTORY");
         rec->SetFieldValue("object_type", "");
         rec->SetFieldValue("object_parent", "");
         rec->Save();
 
+        std::shared_lock<std::shared_mutex> lock(catalogLatch);
         for (auto &&tbl : tables)
         {
             auto rec = tbl_schema->CreateRecord();
@@ -227,6 +266,16 @@ namespace ruru
                 rec->SetFieldValue("object_parent", tbl.first);
                 rec->Save();
             }
+            // indexes are stored after the columns they refer to
+            for (const auto &it : tbl.second->indices)
+            {
+                auto rec = tbl_schema->CreateRecord();
+                rec->SetFieldValue("object_name", it.first.first);
+                rec->SetFieldValue("object_kind", "INDEX");
+                rec->SetFieldValue("object_type", it.first.second);
+                rec->SetFieldValue("object_parent", tbl.first);
+                rec->Save();
+            }
         }
 
         return result;
@@ -240,11 +289,236 @@ namespace ruru
         return true;
     }
 
+    void Database::_recover()
+    {
+        if (wal == nullptr)
+            return;
+
+        // a record saved several times since the checkpoint is only applied in its last version
+        std::map<std::pair<std::string, RecordId>, uint64_t> last;
+        uint64_t entries = 0;
+        wal->Read([&](const std::string &table, Record &record)
+                  { last[{table, record.row_id_}] = entries++; });
+        if (entries == 0)
+            return;
+
+        uint64_t entry = 0;
+        wal->Read([&](const std::string &table, Record &record)
+                  {
+                      if (last[{table, record.row_id_}] == entry++)
+                      {
+                          IStorageEngine *store = getStorageEngine(table);
+                          if (store != nullptr)
+                              store->Replay(record);
+                      } });
+        // the tables hold the log, it can be restarted
+        checkpoint();
+    }
+
+    void Database::setSyncCommit(bool sync)
+    {
+        syncCommit = sync;
+    }
+
+    void Database::_initFlusher()
+    {
+        flusher.reset(new Flusher([this]
+                                  { return checkpoint(); }));
+        flusher->Start(FlushPolicy());
+    }
+
+    void Database::setCacheBudget(uint64_t bytes)
+    {
+        bufferPool->SetBudget(bytes);
+    }
+
+    void Database::setFlushPolicy(const FlushPolicy &policy)
+    {
+        if (flusher != nullptr)
+            flusher->Start(policy);
+    }
+
+    bool Database::checkpoint()
+    {
+        std::unique_lock<std::shared_mutex> lock(logLatch);
+        return _checkpoint();
+    }
+
+    bool Database::_checkpoint()
+    {
+        // the log can only be restarted once the tables hold all the logged changes
+        // the writers are held by the log latch, the readers go on during the flush
+        bool result = true;
+        uint64_t oldest = versionClock->GetOldest();
+        std::shared_lock<std::shared_mutex> lock(catalogLatch);
+        for (auto &&it : storageEngines)
+        {
+            std::shared_lock<std::shared_mutex> table_lock(*tableLatches.at(it.first));
+            result = it.second->Flush() && result;
+            // the versions no snapshot sees anymore are dropped with the flush
+            it.second->ReleaseVersions(oldest);
+        }
+        if (result && wal != nullptr)
+            result = wal->Checkpoint();
+        return result;
+    }
+
+    TransactionPtr Database::beginTransaction()
+    {
+        return TransactionPtr(new Transaction(weak_from_this()));
+    }
+
+    bool Database::commitTransaction(const std::vector<RecordTablePtr> &records)
+    {
+        if (records.empty())
+            return true;
+
+        // the records of each table, the tables are latched in name order
+        std::map<std::string, RecordBatch_t> batches;
+        size_t size = 0;
+        for (auto &&rec : records)
+        {
+            rec->_Materialize();
+            batches[rec->table->getName()].push_back({rec->record, rec->type == RecordType::eNew});
+            size += rec->record->GetRowSize();
+        }
+
+        waitForFlush();
+        // the storage engines are fetched before the latches are taken
+        std::vector<IStorageEngine *> stores;
+        std::vector<std::shared_mutex *> tableLatchList;
+        for (auto &&it : batches)
+        {
+            IStorageEngine *store = getStorageEngine(it.first);
+            if (store == nullptr)
+                return false;
+            stores.push_back(store);
+            tableLatchList.push_back(&getTableLatch(it.first));
+        }
+        std::shared_lock<std::shared_mutex> log_latch(logLatch);
+        std::vector<std::unique_lock<std::shared_mutex>> table_latches;
+        for (auto &&latch : tableLatchList)
+            table_latches.emplace_back(*latch);
+
+        // the row ids of the records, given back when the transaction is not written
+        std::vector<RecordId> row_ids;
+        row_ids.reserve(records.size());
+        for (auto &&it : batches)
+        {
+            for (auto &&rec : it.second)
+                row_ids.push_back(rec.first->row_id_);
+        }
+        auto cancel = [&](size_t prepared)
+        {
+            size_t i = 0, j = 0;
+            for (auto &&it : batches)
+            {
+                if (i < prepared)
+                    stores[i]->CancelBatch(it.second);
+                i++;
+                for (auto &&rec : it.second)
+                    rec.first->row_id_ = row_ids[j++];
+            }
+        };
+
+        // nothing is written until every table accepts its records
+        size_t i = 0;
+        for (auto &&it : batches)
+        {
+            if (!stores[i]->PrepareBatch(it.second))
+            {
+                cancel(i);
+                return false;
+            }
+            i++;
+        }
+
+        // the transaction is a single log entry, written before the tables
+        // so that a crash leaves the whole transaction in the log
+        if (wal != nullptr)
+        {
+            std::vector<std::pair<std::string, const Record *>> entries;
+            entries.reserve(records.size());
+            for (auto &&it : batches)
+            {
+                for (auto &&rec : it.second)
+                    entries.push_back({it.first, rec.first});
+            }
+            uint64_t lsn = wal->AppendTransaction(entries);
+            if (lsn == 0 || !(syncCommit ? wal->Commit(lsn) : wal->Write(lsn)))
+            {
+                cancel(batches.size());
+                return false;
+            }
+        }
+
+        // the records share a commit timestamp, a snapshot sees all of them or none
+        uint64_t commit_ts = versionClock->Commit();
+        uint64_t oldest = versionClock->GetOldest();
+        bool result = true;
+        i = 0;
+        for (auto &&it : batches)
+        {
+            IStorageEngine *store = stores[i++];
+            if (store->SaveBatch(it.second, commit_ts, oldest))
+                continue;
+            // without a log the other tables keep their records
+            if (wal == nullptr)
+            {
+                result = false;
+                continue;
+            }
+            // the transaction is committed once logged: the table gets its records
+            // back from the log entry as a recovery would, or the database must be reopened
+            for (auto &&rec : it.second)
+            {
+                if (!store->Replay(*rec.first))
+                    throw std::runtime_error("transaction logged but not saved in table " + it.first +
+                                             ", the database must be reopened to recover it");
+            }
+        }
+        if (flusher != nullptr)
+            flusher->AddDirty(size);
+        return result;
+    }
+
+    std::shared_ptr<const uint64_t> Database::pinSnapshot()
+    {
+        return versionClock->Pin();
+    }
+
+    uint64_t Database::logSave(const std::string &tableName, const Record &record)
+    {
+        if (flusher != nullptr)
+            flusher->AddDirty(record.GetRowSize());
+        if (wal == nullptr)
+            return 0;
+        uint64_t lsn = wal->Append(tableName, record);
+        return syncCommit ? lsn : 0;
+    }
+
+    bool Database::commitLog(uint64_t lsn)
+    {
+        if (wal == nullptr || lsn == 0)
+            return true;
+        return wal->Commit(lsn);
+    }
+
+    void Database::waitForFlush()
+    {
+        // data files and index pages are checkpointed lazily,
+        // by the background flush when it runs
+        if (flusher != nullptr && flusher->IsRunning())
+            flusher->WaitForBudget();
+        else if (wal != nullptr && wal->GetSize() > internal::WriteAheadLog::CHECKPOINT_SIZE)
+            checkpoint();
+    }
+
     Database::~Database()
     {
         // before leaving must flush all data
-        for (auto &&it : storageEngines)
-            it.second->Flush();
+        flusher.reset();
+        checkpoint();
 
         for (auto &&it : storageEngines)
             delete it.second;
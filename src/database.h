@@ -2,11 +2,20 @@
 #define _H_DATABASE_HH__
 
 #include "ruru.h"
+#include <mutex>
+#include <shared_mutex>
 namespace ruru
 {
     //forward declaration
     class IStorageEngine;
     class Table;
+    class Flusher;
+    class VersionClock;
+    namespace internal
+    {
+        class WriteAheadLog;
+        class BufferPool;
+    }
     
     //Database class is an implementation of interface IDatabase
     class Database : public IDatabase
@@ -17,11 +26,39 @@ namespace ruru
         std::map<std::string, IStorageEngine *> storageEngines;
         std::shared_ptr<Database> schema; //{nullptr};
         IStorageEngineFactory*  storeFactory;
+        // redo log of the saves, the schema database has none
+        std::unique_ptr<internal::WriteAheadLog> wal;
+        bool syncCommit;
+        // background flush of the storage engines
+        std::unique_ptr<Flusher> flusher;
+        // latch on tables, storageEngines and tableLatches
+        std::shared_mutex catalogLatch;
+        // latch of each table: shared by the readers, exclusive to the writers
+        // kept until the database is closed, a removed table may still be in use
+        std::map<std::string, std::unique_ptr<std::shared_mutex>> tableLatches;
+        // shared by the writers, exclusive to the checkpoint
+        std::shared_mutex logLatch;
+        // commit timestamps of the saved versions and pinned snapshots
+        std::shared_ptr<VersionClock> versionClock;
+        // pages cached by the storage engines of the tables
+        std::unique_ptr<internal::BufferPool> bufferPool;
         
         Database(const std::filesystem::path &path);
 
         void _initSchemaDB();
 
+        // open the write-ahead log next to the schema file
+        void _initLog(bool truncate);
+
+        // apply the write-ahead log to the tables after a crash
+        void _recover();
+
+        // start the background flush with the default policy
+        void _initFlusher();
+
+        // checkpoint, logLatch is held by the caller
+        bool _checkpoint();
+
         friend class IDatabase;
 
     public:
@@ -47,6 +84,50 @@ namespace ruru
         // set The storage Engine Factory
         bool setStorageEngineFactory ( IStorageEngineFactory* factory) override; 
 
+        // durability of RecordTable::Save
+        void setSyncCommit(bool sync) override;
+
+        // flush the tables and restart the write-ahead log
+        bool checkpoint() override;
+
+        // settings of the background flush
+        void setFlushPolicy(const FlushPolicy &policy) override;
+
+        // start a transaction
+        TransactionPtr beginTransaction() override;
+
+        // memory of the pages cached by the tables
+        void setCacheBudget(uint64_t bytes) override;
+
+        // write the records of a transaction, all of them or none
+        // throws when the transaction is logged but a table can't save its records
+        bool commitTransaction(const std::vector<RecordTablePtr> &records);
+
+        // latch held while the storage engine of a table is used
+        std::shared_mutex &getTableLatch(const std::string &tableName);
+
+        // latch held by the writers while they save and log a record
+        std::shared_mutex &getLogLatch() { return logLatch; }
+
+        // timestamps of the versions saved in the tables
+        VersionClock &getVersionClock() { return *versionClock; }
+
+        // pin a snapshot of the tables, the saved versions it sees are kept until it is released
+        std::shared_ptr<const uint64_t> pinSnapshot();
+
+        // log a record saved in a table, the table latch and the log latch are held by the caller
+        // returns the position to commit, 0 when nothing is to wait for
+        uint64_t logSave(const std::string &tableName, const Record &record);
+
+        // in sync commit mode, wait until the log is synced up to lsn
+        // called without the latches so that concurrent commits share the sync
+        bool commitLog(uint64_t lsn);
+
+        // wait while too much data is waiting for the background flush,
+        // checkpoint when the log is too large and there is no background flush
+        // called before the latches are taken
+        void waitForFlush();
+
         virtual ~Database();
     };
 
@@ -12,37 +12,68 @@ namespace ruru
     {
     }
 
+    template <typename T>
+    void Field::SetValue(const T &value, Arena &arena)
+    {
+    }
+
     template <>
-    void Field::SetValue(const int64_t &value)
+    void Field::SetValue(const int64_t &value, Arena &arena)
     {
         type_ = DataTypes::eInteger;
-        value_.reset((char *)malloc(sizeof(value))); // TODO: use allocator
-        memcpy(value_.get(), &value, sizeof(value));
+        memcpy(Allocate(sizeof(value), arena), &value, sizeof(value));
     }
 
     template <>
-    void Field::SetValue(const double &value)
+    void Field::SetValue(const double &value, Arena &arena)
     {
         type_ = DataTypes::eDouble;
-        value_.reset((char *)malloc(sizeof(value))); // TODO: use allocator
-        memcpy(value_.get(), &value, sizeof(value));
+        memcpy(Allocate(sizeof(value), arena), &value, sizeof(value));
     }
 
     template <>
-    void Field::SetValue(const std::string &value)
+    void Field::SetValue(const std::string_view &value, Arena &arena)
     {
         type_ = DataTypes::eVarChar;
         uint64_t len = value.size();
-        value_.reset((char *)malloc(sizeof(uint64_t) + len)); // TODO: use allocator
-        memcpy(value_.get(), &len, sizeof(len));
-        memcpy(value_.get() + sizeof(len), value.c_str(), len);
+        char *data = Allocate(sizeof(uint64_t) + len, arena);
+        memcpy(data, &len, sizeof(len));
+        memcpy(data + sizeof(len), value.data(), len);
+    }
+
+    template <>
+    void Field::SetValue(const std::string &value, Arena &arena)
+    {
+        SetValue(std::string_view(value), arena);
+    }
+
+    // a field outside of a record gets a block of its own when the value is not inline
+    template <>
+    void Field::SetValue(const int64_t &value)
+    {
+        Arena arena;
+        SetValue(value, arena);
+    }
+
+    template <>
+    void Field::SetValue(const double &value)
+    {
+        Arena arena;
+        SetValue(value, arena);
+    }
+
+    template <>
+    void Field::SetValue(const std::string &value)
+    {
+        Arena arena;
+        SetValue(value, arena);
     }
 
     template<>
     void Field::SetValue( const nullptr_t& value)
     {
         type_ = DataTypes::eNull;
-        value_ = nullptr;
+        Clear();
     }
 
 }
@@ -0,0 +1,94 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "ruru.h"
+#include "flusher.h"
+
+namespace ruru
+{
+    Flusher::Flusher(FlushCallback_t flush)
+        : flush_(std::move(flush)), dirty_(0), dirty_threshold_(policy_.dirty_threshold),
+          dirty_budget_(policy_.dirty_budget), stop_(false)
+    {
+    }
+
+    void Flusher::Start(const FlushPolicy &policy)
+    {
+        Stop();
+        std::unique_lock<std::mutex> lock(mutex_);
+        policy_ = policy;
+        dirty_threshold_ = policy.dirty_threshold;
+        dirty_budget_ = policy.dirty_budget;
+        stop_ = false;
+        if (policy_.interval_ms > 0)
+            thread_ = std::thread(&Flusher::_Run, this);
+    }
+
+    void Flusher::Stop()
+    {
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        if (thread_.joinable())
+            thread_.join();
+        // the writers don't wait for a stopped flusher
+        flushed_.notify_all();
+    }
+
+    void Flusher::AddDirty(uint64_t bytes)
+    {
+        uint64_t threshold = dirty_threshold_;
+        uint64_t dirty = dirty_.fetch_add(bytes) + bytes;
+        // only the save crossing the threshold wakes the thread
+        if (dirty >= threshold && dirty - bytes < threshold)
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            wake_.notify_one();
+        }
+    }
+
+    void Flusher::WaitForBudget()
+    {
+        if (dirty_ <= dirty_budget_)
+            return;
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!thread_.joinable())
+            return;
+        wake_.notify_one();
+        flushed_.wait(lock, [this]
+                      { return dirty_ <= dirty_budget_ || stop_; });
+    }
+
+    void Flusher::_Run()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (!stop_)
+        {
+            wake_.wait_for(lock, std::chrono::milliseconds(policy_.interval_ms), [this]
+                           { return stop_ || dirty_ >= dirty_threshold_; });
+            if (stop_)
+                break;
+            if (dirty_ == 0)
+                continue;
+
+            // the data saved during the flush stays dirty
+            uint64_t flushing = dirty_;
+            lock.unlock();
+            bool ok = flush_();
+            lock.lock();
+            if (ok)
+                dirty_ -= flushing;
+            flushed_.notify_all();
+        }
+    }
+
+    Flusher::~Flusher()
+    {
+        Stop();
+    }
+}
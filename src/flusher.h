@@ -6,11 +6,64 @@
 #ifndef _H_FLUSHER_HH__
 #define _H_FLUSHER_HH__
 
+#include "ruru.h"
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+
 namespace ruru
 {
-
+    /*
+        \class Flusher
+        \brief background thread flushing the storage engines of a database
+               the flush runs every policy interval, or as soon as the data saved
+               since the last flush reaches the dirty threshold. Writers are held
+               while the data not flushed is over the dirty budget.
+    */
     class Flusher
     {
+    public:
+        using FlushCallback_t = std::function<bool()>;
+
+        Flusher(FlushCallback_t flush);
+        Flusher(const Flusher &) = delete;
+        Flusher &operator=(const Flusher &) = delete;
+
+        // start the thread with policy, restart it when already running
+        // a policy with a zero interval leaves the thread stopped
+        void Start(const FlushPolicy &policy);
+
+        // stop the thread, the data saved since the last flush stays dirty
+        void Stop();
+
+        bool IsRunning() const { return thread_.joinable(); }
+
+        // account bytes saved by a writer
+        void AddDirty(uint64_t bytes);
+
+        // wait while the data not flushed is over the budget
+        void WaitForBudget();
+
+        ~Flusher();
+
+    private:
+        FlushCallback_t flush_;
+        FlushPolicy policy_;
+        std::thread thread_;
+        std::mutex mutex_;
+        // wakes the thread: threshold reached or stop
+        std::condition_variable wake_;
+        // wakes the writers waiting for the budget
+        std::condition_variable flushed_;
+        // bytes saved since the last flush, the writers account them without the lock
+        std::atomic<uint64_t> dirty_;
+        std::atomic<uint64_t> dirty_threshold_;
+        std::atomic<uint64_t> dirty_budget_;
+        bool stop_;
+
+        void _Run();
     };
 }
 
@@ -5,9 +5,12 @@
 
 namespace ruru::internal
 {
+    // upper bound of the number of fields in a record
+    constexpr uint64_t MAX_FIELDS_PER_RECORD = 0xFFFF;
 
+    // the payload is allocated in arena
     template <typename T>
-    bool ReadField(T &stream, Field &rec)
+    bool ReadField(T &stream, Field &rec, Arena &arena)
     {
         // Read the 8-bit type field
         stream.read(reinterpret_cast<char *>(&rec.type_), sizeof(rec.type_));
@@ -20,19 +23,17 @@ namespace ruru::internal
         switch (rec.type_)
         {
         case DataTypes::eNull:
-            rec.value_ = nullptr;
+            rec.Clear();
             break;
         case DataTypes::eInteger:
         {
-            rec.value_.reset((char *)malloc(sizeof(int64_t)));
-            stream.read(rec.value_.get(), sizeof(uint64_t)); // TODO: manage endiness
+            stream.read(rec.Allocate(sizeof(int64_t), arena), sizeof(uint64_t)); // TODO: manage endiness
         }
         break;
 
         case DataTypes::eDouble:
         {
-            rec.value_.reset((char *)malloc(sizeof(double)));
-            stream.read(rec.value_.get(), sizeof(double)); // TODO: manage endiness
+            stream.read(rec.Allocate(sizeof(double), arena), sizeof(double)); // TODO: manage endiness
         }
         break;
         case DataTypes::eVarChar:
@@ -43,9 +44,10 @@ namespace ruru::internal
             if (stream.fail())
                 return false;
 
-            rec.value_.reset((char *)malloc(len + sizeof(len)));
-            memcpy(rec.value_.get(), &len, sizeof(len));
-            stream.read(rec.value_.get() + sizeof(len), len);
+            // short strings stay in the field, the arena is only used for the others
+            char *data = rec.Allocate(len + sizeof(len), arena);
+            memcpy(data, &len, sizeof(len));
+            stream.read(data + sizeof(len), len);
             break;
         }
             // missing eBinary, until implementation of binary vector
@@ -67,7 +69,7 @@ namespace ruru::internal
     {
         // Write the 8-bit type field
 
-        if (rec.value_ == nullptr)
+        if (rec.IsNull())
         {
             // NULL is a parent type. every types derive for it
             DataTypes v = DataTypes::eNull;
@@ -81,16 +83,16 @@ namespace ruru::internal
         case DataTypes::eNull:
             break;
         case DataTypes::eInteger:
-            stream.write(reinterpret_cast<const char *>(rec.value_.get()), sizeof(uint64_t));
+            stream.write(rec.Data(), sizeof(uint64_t));
             break;
         case DataTypes::eDouble:
-            stream.write(reinterpret_cast<const char *>(rec.value_.get()), sizeof(double));
+            stream.write(rec.Data(), sizeof(double));
             break;
         case DataTypes::eVarChar:
         {
             // read the length
-            uint64_t len = *(uint64_t *)(rec.value_.get());
-            stream.write(reinterpret_cast<const char *>(rec.value_.get()), len + sizeof(len));
+            uint64_t len = *(const uint64_t *)(rec.Data());
+            stream.write(rec.Data(), len + sizeof(len));
             break;
         }
         case DataTypes::eBinary:
@@ -123,13 +125,17 @@ namespace ruru::internal
                 // Read field list
                 uint64_t field_nbr;
                 file_stream_.read(reinterpret_cast<char *>(&field_nbr), sizeof(field_nbr));
-                if (file_stream_.fail())
+                // column indexes are 16 bits, anything bigger is not a record
+                if (file_stream_.fail() || field_nbr > MAX_FIELDS_PER_RECORD)
                     return false;
 
+                // the previous payloads are released before the arena is reused
+                record->fields_.clear();
+                record->arena_.Reset();
                 record->fields_.resize(field_nbr);
                 for (uint64_t i = 0; i < field_nbr; ++i)
                 {
-                    if (!ReadField(file_stream_, record->fields_[i]))
+                    if (!ReadField(file_stream_, record->fields_[i], record->arena_))
                     {
                         // error
                         return false;
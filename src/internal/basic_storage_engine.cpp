@@ -7,12 +7,20 @@
 #include "ruru.h"
 #include "internal/basic_storage_engine.h"
 #include "record.h"
+#include "record_view.h"
 #include "internal/RecordStream.h"
-#include "tools.h"
+#include "internal/record_scanner.h"
+#include "utils/memory_stream.h"
+#include "internal/predicate.h"
 
 using namespace ruru;
 using namespace ruru::internal;
 
+// number of bytes read when the record length is unknown
+constexpr size_t DEFAULT_RECORD_READ = 4096;
+// checkpoint file: magic | data file size
+constexpr char CHECKPOINT_MAGIC[8] = {'R', 'U', 'R', 'U', 'C', 'K', 'P', '1'};
+
 IStorageEngine* BasicStorageEngineFactory::createStorageEngine( const std::string& file_name)
 {
     return new BasicStorageEngine(file_name);
@@ -30,64 +38,70 @@ std::string  BasicStorageEngineFactory::getName( )
 // Constructor
 BasicStorageEngine::BasicStorageEngine(const std::string &file_name, bool forSchema)
     : file_name_(file_name),
-      current_rec_id_(-1),
-      is_for_schema_(forSchema)
+      current_rec_id_(0), // row ids start at 1
+      is_for_schema_(forSchema),
+      data_file_(file_name),
+      mapped_file_(data_file_),
+      rebuilt_indexes_(false)
 {
+    // the data file may not exist yet, it is created by the first append
+    data_file_.Open(false);
+
     if (!is_for_schema_)
     {
         // Load the index from the index file
         LoadIndex();
         // Load row_id index
         LoadHiddenIndex();
+        // the indexes may miss the records written after the last flush
+        _Recover();
     }
 }
 
 // Insert a record into the table
 void BasicStorageEngine::Insert(const Record &record)
 {
-    // Open the file in append mode
-    std::fstream file(file_name_, std::ios::app);
+    // encode the record then append it with a single positional write
+    std::vector<char> buffer;
+    _EncodeRecord(record, buffer);
+    RecordPosition_t position = data_file_.Append(buffer.data(), buffer.size());
+    if (position < 0)
+        return;
+    _Appended(record.row_id_, position, buffer.size());
 
     if (!is_for_schema_)
-    {
-        // Update the index
-        index_.Insert(record.GetKey(), file.tellp());
+        _IndexRecord(record, buffer.size(), position);
+}
 
-        // update hidden index
-        row_id_index_.Insert(record.row_id_, std::make_pair<RecordLength_t, RecordPosition_t>(record.GetRowSize(), file.tellp()));
-    }
+void BasicStorageEngine::_IndexRecord(const Record &record, RecordLength_t length, RecordPosition_t position)
+{
+    // Update the index
+    index_.Insert(record.GetHash(), position);
 
-    RecordFile record_file(file);
-    record_file.Write(record);
+    // update hidden index
+    row_id_index_.Insert(record.row_id_, std::make_pair(length, position));
 
-    // Close the file
-    file.close();
+    // update secondary indexes
+    for (auto &&it : secondary_indexes_)
+        it.second->Insert(record);
 }
 
 // Select all records from the table
 std::vector<Record> BasicStorageEngine::SelectAll()
 {
-    // Open the file in read mode
-    std::fstream file(file_name_);
-
     std::vector<Record> records;
-    if (!file.is_open())
-        return records;
 
-    //!!<< Implement a Cache system
-    while (!file.eof())
+    // sequential scan of the data file
+    RecordScanner scanner(data_file_);
+    Record rec;
+    RecordPosition_t position;
+    RecordLength_t length;
+    while (scanner.Next(rec, position, length))
     {
-        // read record from
-        RecordFile rec_file(file);
-        Record rec;
-        RecordId rec_id = -1;
-        if (rec_file.Read(rec_id, &rec))
+        if (_IsLiveVersion(rec.row_id_, position))
             records.push_back(rec);
     }
 
-    // Close the file
-    file.close();
-
     return records;
 }
 
@@ -96,24 +110,21 @@ std::vector<Record> BasicStorageEngine::Lookup(const std::string &key)
 {
     if (is_for_schema_)
         return {};
-    // Use the index to find the offset of the record in the file
-    int offset = index_.Lookup(key);
-
-    // Open the file in read mode
-    std::fstream file(file_name_);
+    // keys are the decimal form of the record hash
+    char *end = nullptr;
+    uint64_t hash = std::strtoull(key.c_str(), &end, 10);
+    if (key.empty() || *end != '\0')
+        return {};
 
-    // Seek to the offset of the record
-    file.seekg(offset);
+    // Use the index to find the offset of the record in the file
+    RecordPosition_t offset;
+    if (!index_.Find(hash, offset))
+        return {};
 
     std::vector<Record> values;
-    RecordFile f(file);
     Record v;
-    RecordId id = -1;
-    f.Read(id, &v);
-    values.push_back(v);
-
-    // Close the file
-    file.close();
+    if (_LoadRecord(offset, v) > 0)
+        values.push_back(v);
 
     return values;
 }
@@ -122,55 +133,334 @@ std::vector<RecordId> BasicStorageEngine::Lookup(const Filters_t &filters)
 {
 
     std::vector<RecordId> rowsid;
+    // filters are compiled once for the whole lookup
+    CompiledFilters compiled(filters);
+
+    // a secondary index on one of the filtered columns narrows the candidates
+    std::vector<RecordId> candidates;
+    bool exact = false;
+    if (_LookupSecondaryIndex(filters, candidates, exact))
+    {
+        // index scans return the ids in key order, merge them into a sorted list
+        // the index only narrows the candidates, the records read are checked against the filters
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+        RecordView view;
+        Record rec;
+        for (auto &&id : candidates)
+        {
+            if (LoadRecordView(id, view))
+            {
+                if (compiled.Match(view))
+                    rowsid.push_back(id);
+                continue;
+            }
+            std::pair<RecordLength_t, RecordPosition_t> entry;
+            if (!row_id_index_.Find(id, entry))
+                continue;
+            if (!_LoadCached(entry, rec, false) && _LoadRecord(entry.second, rec, entry.first) == 0)
+                continue;
+            if (compiled.Match(rec))
+                rowsid.push_back(id);
+        }
+        return rowsid;
+    }
 
     // table full scan
-    auto entries = row_id_index_.GetEntries();
-    for (auto &it : entries)
+    _ScanLookup(compiled, rowsid);
+
+    // updated records are found in file order, keep the result in row id order
+    std::sort(rowsid.begin(), rowsid.end());
+    return rowsid;
+}
+
+void BasicStorageEngine::_ScanLookup(const CompiledFilters &compiled, std::vector<RecordId> &rowsid)
+{
+    // the data file is read front to back, the hidden index is only used
+    // to skip the dead versions of updated records
+    RecordPosition_t position;
+    RecordLength_t length;
+    MappedFile::Mapping mapping;
+    if (mapped_file_.Cover(data_file_.GetSize(), mapping))
     {
+        // the records are evaluated in place in the mapping
+        ViewScanner scanner(mapping);
+        RecordView view;
+        while (scanner.Next(view, position, length))
+        {
+            if (!_IsLiveVersion(view.row_id_, position))
+                continue;
+
+            if (compiled.Match(view))
+                rowsid.push_back(view.row_id_);
+        }
+    }
+    else
+    {
+        RecordScanner scanner(data_file_);
         Record rec;
-        if (_LoadRecord(it.second.second, rec) > 0)
+        while (scanner.Next(rec, position, length))
         {
-            // apply filters
-            bool ok = true;
-            for (auto &&filter : filters)
+            if (!_IsLiveVersion(rec.row_id_, position))
+                continue;
+
+            if (compiled.Match(rec))
+                rowsid.push_back(rec.row_id_);
+        }
+    }
+}
+
+class BasicStorageEngine::Cursor : public IRecordCursor
+{
+    // row id and position of the version seen by the snapshot
+    using Entry_t = std::pair<RecordId, std::pair<RecordLength_t, RecordPosition_t>>;
+
+public:
+    // every record up to last_id, in row id order
+    Cursor(BasicStorageEngine *engine, const Filters_t &filters, uint64_t snapshot, RecordId last_id)
+        : engine_(engine), filters_(filters), compiled_(filters), snapshot_(snapshot), scan_(true),
+          next_id_(0), last_id_(last_id), next_(0)
+    {
+    }
+
+    // the sorted candidate ids
+    Cursor(BasicStorageEngine *engine, const Filters_t &filters, uint64_t snapshot, std::vector<RecordId> ids)
+        : engine_(engine), filters_(filters), compiled_(filters), snapshot_(snapshot), scan_(false),
+          next_id_(0), last_id_(0), ids_(std::move(ids)), next_(0)
+    {
+    }
+
+    // the candidates and the last id of the scan are the ones found at open
+    RecordCursorPtr Clone() const override
+    {
+        if (scan_)
+            return std::make_unique<Cursor>(engine_, filters_, snapshot_, last_id_);
+        return std::make_unique<Cursor>(engine_, filters_, snapshot_, ids_);
+    }
+
+    bool NextBatch(std::vector<CursorRecord> &batch, size_t max) override
+    {
+        size_t start = batch.size();
+        _HandOver(batch, start + max);
+        while (batch.size() - start < max)
+        {
+            if (ahead_.empty() && !_Step(max - (batch.size() - start), ahead_))
+                break;
+            current_.swap(ahead_);
+            ahead_.clear();
+            // the system reads the next step while this one is decoded and handed over
+            _Step(max - (batch.size() - start), ahead_);
+            _ReadStep(read_);
+            _HandOver(batch, start + max);
+        }
+        return batch.size() > start;
+    }
+
+private:
+    // records closer than this are prefetched with one request
+    static constexpr RecordPosition_t PREFETCH_GAP = 64 * 1024;
+
+    BasicStorageEngine *engine_;
+    Filters_t filters_;
+    CompiledFilters compiled_;
+    uint64_t snapshot_;
+    // walk the hidden index, otherwise the ids
+    bool scan_;
+    RecordId next_id_;
+    // records created after the cursor was opened are not seen
+    RecordId last_id_;
+    std::vector<RecordId> ids_;
+    size_t next_;
+    // records read now, records of the next step already prefetched
+    std::vector<Entry_t> current_;
+    std::vector<Entry_t> ahead_;
+    // records read past the max of a batch, handed over first by the next one
+    std::vector<CursorRecord> read_;
+    // reused until a record matches
+    std::unique_ptr<RecordView> view_;
+    std::unique_ptr<Record> cached_;
+
+    // find the versions of the next records, at most wanted, and prefetch them
+    // returns false when no record is left
+    bool _Step(size_t wanted, std::vector<Entry_t> &entries)
+    {
+        std::pair<RecordLength_t, RecordPosition_t> entry;
+        while (entries.empty())
+        {
+            if (!scan_)
             {
-                if (!_ApplyFilter(rec, *filter.get()))
+                if (next_ >= ids_.size())
+                    return false;
+                for (; next_ < ids_.size() && entries.size() < wanted; next_++)
                 {
-                    ok = false;
-                    break;
+                    // deleted records are skipped
+                    if (engine_->_FindVersion(ids_[next_], snapshot_, entry) && entry.first > 0)
+                        entries.emplace_back(ids_[next_], entry);
                 }
+                continue;
+            }
+
+            if (next_id_ > last_id_)
+                return false;
+            // the index is latched during the scan, the versions are resolved after it
+            size_t found = 0;
+            engine_->row_id_index_.Scan(next_id_, [&](const RecordId &id, const std::pair<RecordLength_t, RecordPosition_t> &value)
+                                        {
+                                            if (id > last_id_)
+                                                return false;
+                                            entries.emplace_back(id, value);
+                                            return ++found < wanted; });
+            if (entries.empty())
+            {
+                next_id_ = last_id_ + 1;
+                return false;
             }
-            if (ok)
-                rowsid.push_back(it.first);
+            next_id_ = entries.back().first + 1;
+            entries.erase(std::remove_if(entries.begin(), entries.end(), [&](Entry_t &it)
+                                         { return !engine_->_SeenVersion(it.first, snapshot_, it.second) || it.second.first <= 0; }),
+                          entries.end());
         }
+        _Prefetch(entries);
+        return true;
     }
 
-    return rowsid;
+    // ask for the byte ranges of the records, neighbours are merged into one request
+    void _Prefetch(const std::vector<Entry_t> &entries)
+    {
+        std::vector<std::pair<RecordPosition_t, RecordPosition_t>> ranges;
+        ranges.reserve(entries.size());
+        for (auto &&it : entries)
+            ranges.emplace_back(it.second.second, it.second.second + it.second.first);
+        if (!std::is_sorted(ranges.begin(), ranges.end()))
+            std::sort(ranges.begin(), ranges.end());
+
+        auto range = ranges.front();
+        for (size_t i = 1; i < ranges.size(); i++)
+        {
+            if (ranges[i].first - range.second <= PREFETCH_GAP)
+            {
+                range.second = std::max(range.second, ranges[i].second);
+                continue;
+            }
+            engine_->data_file_.Prefetch(range.first, range.second - range.first);
+            range = ranges[i];
+        }
+        engine_->data_file_.Prefetch(range.first, range.second - range.first);
+    }
+
+    // read the records of the current step in file order, hand them over in row id order
+    void _ReadStep(std::vector<CursorRecord> &batch)
+    {
+        std::vector<size_t> order(current_.size());
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = i;
+        std::sort(order.begin(), order.end(), [&](size_t a, size_t b)
+                  { return current_[a].second.second < current_[b].second.second; });
+
+        std::vector<CursorRecord> records(current_.size());
+        for (auto &&i : order)
+            _Read(current_[i].second, records[i]);
+        for (auto &&rec : records)
+        {
+            if (rec.view != nullptr || rec.record != nullptr)
+                batch.push_back(std::move(rec));
+        }
+        current_.clear();
+    }
+
+    // move the records read to batch until it holds size records
+    void _HandOver(std::vector<CursorRecord> &batch, size_t size)
+    {
+        size_t count = std::min(read_.size(), size - std::min(size, batch.size()));
+        std::move(read_.begin(), read_.begin() + count, std::back_inserter(batch));
+        read_.erase(read_.begin(), read_.begin() + count);
+    }
+
+    // read the record at entry from the cache of the engine, else in place when the mapping covers it
+    // out is left empty when the record does not match the filters
+    void _Read(const std::pair<RecordLength_t, RecordPosition_t> &entry, CursorRecord &out)
+    {
+        if (cached_ == nullptr)
+            cached_ = std::make_unique<Record>();
+        if (engine_->_LoadCached(entry, *cached_, scan_))
+        {
+            if (compiled_.Match(*cached_))
+                out.record = std::move(cached_);
+            return;
+        }
+        if (view_ == nullptr)
+            view_ = std::make_unique<RecordView>();
+        if (engine_->_ViewAt(entry, *view_))
+        {
+            if (compiled_.Match(*view_))
+                out.view = std::move(view_);
+            return;
+        }
+        auto rec = std::make_unique<Record>();
+        if (engine_->_LoadRecord(entry.second, *rec, entry.first) > 0 && compiled_.Match(*rec))
+            out.record = std::move(rec);
+    }
+};
+
+RecordCursorPtr BasicStorageEngine::OpenCursor(const Filters_t &filters, uint64_t snapshot)
+{
+    // the schema storage has no hidden index
+    if (is_for_schema_)
+        return nullptr;
+
+    // a secondary index on one of the filtered columns narrows the candidates
+    std::vector<RecordId> candidates;
+    bool exact = false;
+    if (_LookupSecondaryIndex(filters, candidates, exact))
+    {
+        // the index holds the current versions: the records with older versions kept
+        // for the snapshots may have matched before an update, they are candidates too.
+        // every version read is checked against the filters.
+        {
+            std::lock_guard<std::mutex> lock(versions_mutex_);
+            for (auto &&it : versions_)
+                candidates.push_back(it.first);
+        }
+        std::sort(candidates.begin(), candidates.end());
+        candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+        return _OpenCursor(std::move(candidates), filters, snapshot);
+    }
+
+    // the writers wait for the readers: every id given so far is committed
+    return std::make_unique<Cursor>(this, filters, snapshot, current_rec_id_);
+}
+
+RecordCursorPtr BasicStorageEngine::_OpenCursor(std::vector<RecordId> ids, const Filters_t &filters, uint64_t snapshot)
+{
+    return std::make_unique<Cursor>(this, filters, snapshot, std::move(ids));
 }
 
 Record *BasicStorageEngine::LoadRecord(RecordId id)
 {
     if (!is_for_schema_)
     {
-        if (!row_id_index_.Exists(id))
+        std::pair<RecordLength_t, RecordPosition_t> entry;
+        if (!row_id_index_.Find(id, entry))
             return nullptr;
-        auto entry = row_id_index_.Lookup(id);
         Record *rec = new Record();
-        _LoadRecord(entry.second, *rec);
+        if (!_LoadCached(entry, *rec, false) && _LoadRecord(entry.second, *rec, entry.first) == 0)
+        {
+            delete rec;
+            return nullptr;
+        }
         return rec;
     }
     else
     {
         // schema file is a small file, quick scan
-        std::fstream file(file_name_);
-        if (!file.is_open())
-            return nullptr;
+        RecordScanner scanner(data_file_);
         Record *rec = new Record();
-        while (!file.eof())
+        RecordPosition_t position;
+        RecordLength_t length;
+        while (scanner.Next(*rec, position, length))
         {
-            RecordFile recfile(file);
-            RecordId zid = -1;
-            if (recfile.Read(zid, rec) && rec->row_id_ == id)
+            if (rec->row_id_ == id)
                 return rec;
         }
         delete rec;
@@ -179,79 +469,620 @@ Record *BasicStorageEngine::LoadRecord(RecordId id)
     }
 }
 
+bool BasicStorageEngine::LoadRecordView(RecordId id, RecordView &view)
+{
+    if (is_for_schema_)
+        return false;
+
+    std::pair<RecordLength_t, RecordPosition_t> entry;
+    if (!row_id_index_.Find(id, entry))
+        return false;
+    return _ViewAt(entry, view);
+}
+
+bool BasicStorageEngine::_ViewAt(const std::pair<RecordLength_t, RecordPosition_t> &entry, RecordView &view)
+{
+    // a length of 0 is a deleted record, or a record indexed without its length
+    if (entry.first <= 0)
+        return false;
+    MappedFile::Mapping mapping;
+    if (!mapped_file_.Cover(entry.second + entry.first, mapping))
+        return false;
+    return view.Reset(mapping.Data() + entry.second, entry.first, mapping.region) &&
+           view.GetLength() > 0;
+}
+
+Record *BasicStorageEngine::LoadRecord(RecordId id, uint64_t snapshot)
+{
+    if (is_for_schema_)
+        return LoadRecord(id);
+    std::pair<RecordLength_t, RecordPosition_t> entry;
+    if (!_FindVersion(id, snapshot, entry))
+        return nullptr;
+    Record *rec = new Record();
+    if (!_LoadCached(entry, *rec, false) && _LoadRecord(entry.second, *rec, entry.first) == 0)
+    {
+        delete rec;
+        return nullptr;
+    }
+    return rec;
+}
+
+bool BasicStorageEngine::LoadRecordView(RecordId id, uint64_t snapshot, RecordView &view)
+{
+    if (is_for_schema_)
+        return false;
+    std::pair<RecordLength_t, RecordPosition_t> entry;
+    if (!_FindVersion(id, snapshot, entry))
+        return false;
+    return _ViewAt(entry, view);
+}
+
+bool BasicStorageEngine::_FindVersion(RecordId id, uint64_t snapshot, std::pair<RecordLength_t, RecordPosition_t> &entry)
+{
+    {
+        std::lock_guard<std::mutex> lock(versions_mutex_);
+        auto it = versions_.find(id);
+        if (it != versions_.end())
+        {
+            for (auto v = it->second.rbegin(); v != it->second.rend(); ++v)
+            {
+                if (v->commit_ts <= snapshot)
+                {
+                    entry = std::make_pair(v->length, v->position);
+                    return true;
+                }
+            }
+            return false;
+        }
+    }
+    // the record has a single version
+    return row_id_index_.Find(id, entry);
+}
+
+bool BasicStorageEngine::_SeenVersion(RecordId id, uint64_t snapshot, std::pair<RecordLength_t, RecordPosition_t> &entry)
+{
+    std::lock_guard<std::mutex> lock(versions_mutex_);
+    auto it = versions_.find(id);
+    // the record has a single version
+    if (it == versions_.end())
+        return true;
+    for (auto v = it->second.rbegin(); v != it->second.rend(); ++v)
+    {
+        if (v->commit_ts <= snapshot)
+        {
+            entry = std::make_pair(v->length, v->position);
+            return true;
+        }
+    }
+    return false;
+}
+
+bool BasicStorageEngine::SaveVersion(Record &record, bool isNew, uint64_t commit_ts, uint64_t oldest_snapshot)
+{
+    if (is_for_schema_)
+        return Save(record, isNew);
+
+    // the version replaced is only needed while an older snapshot is pinned
+    bool keep = oldest_snapshot < commit_ts;
+    std::pair<RecordLength_t, RecordPosition_t> previous;
+    if (keep && !isNew && !row_id_index_.Find(record.row_id_, previous))
+        return false;
+
+    // the new version is appended at the end of the data file
+    RecordPosition_t position = data_file_.GetSize();
+    if (!Save(record, isNew))
+        return false;
+    RecordLength_t length = data_file_.GetSize() - position;
+
+    _TrackVersion(record.row_id_, keep && !isNew ? &previous : nullptr, commit_ts, oldest_snapshot, length, position);
+    return true;
+}
+
+bool BasicStorageEngine::PrepareBatch(RecordBatch_t &records)
+{
+    if (is_for_schema_)
+        return false;
+
+    // nothing is written unless every updated record exists
+    std::pair<RecordLength_t, RecordPosition_t> info;
+    for (auto &&it : records)
+    {
+        if (!it.second && !row_id_index_.Find(it.first->row_id_, info))
+            return false;
+    }
+    for (auto &&it : records)
+    {
+        if (it.second)
+            it.first->row_id_ = ++current_rec_id_;
+    }
+    return true;
+}
+
+void BasicStorageEngine::CancelBatch(const RecordBatch_t &records)
+{
+    // the ids were given in order and no other writer took one since
+    for (auto it = records.rbegin(); it != records.rend(); ++it)
+    {
+        if (it->second && it->first->row_id_ == current_rec_id_)
+            current_rec_id_--;
+    }
+}
+
+bool BasicStorageEngine::SaveBatch(const RecordBatch_t &records, uint64_t commit_ts, uint64_t oldest_snapshot)
+{
+    if (is_for_schema_)
+        return false;
+
+    // the records are appended with a single positional write
+    std::vector<char> buffer;
+    std::vector<RecordLength_t> lengths;
+    size_t size = 0;
+    for (auto &&it : records)
+        size += it.first->GetRowSize();
+    buffer.reserve(size);
+    lengths.reserve(records.size());
+    for (auto &&it : records)
+    {
+        size_t start = buffer.size();
+        _EncodeRecord(*it.first, buffer);
+        lengths.push_back(buffer.size() - start);
+    }
+    RecordPosition_t position = data_file_.Append(buffer.data(), buffer.size());
+    if (position < 0)
+        return false;
+    RecordPosition_t at = position;
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        _Appended(records[i].first->row_id_, at, lengths[i]);
+        at += lengths[i];
+    }
+
+    // a record saved twice in the batch is indexed in its last version only
+    std::unordered_map<RecordId, size_t> last;
+    for (size_t i = 0; i < records.size(); i++)
+    {
+        if (!records[i].second)
+            last[records[i].first->row_id_] = i;
+    }
+
+    // the entries of each index are sorted and merged into it in one pass
+    bool keep = oldest_snapshot < commit_ts;
+    std::vector<std::pair<uint64_t, RecordPosition_t>> hashes;
+    std::vector<std::pair<RecordId, std::pair<RecordLength_t, RecordPosition_t>>> rows;
+    std::vector<const Record *> indexed;
+    hashes.reserve(records.size());
+    rows.reserve(records.size());
+    indexed.reserve(records.size());
+    for (size_t i = 0; i < records.size(); position += lengths[i], i++)
+    {
+        const Record &record = *records[i].first;
+        bool isNew = records[i].second;
+        if (!isNew && last[record.row_id_] != i)
+            continue;
+
+        std::pair<RecordLength_t, RecordPosition_t> previous;
+        bool replaced = !isNew && row_id_index_.Find(record.row_id_, previous);
+        // the secondary index entries of the previous version are replaced
+        if (replaced && !secondary_indexes_.empty())
+        {
+            Record old;
+            if (_LoadRecord(previous.second, old, previous.first) > 0)
+            {
+                for (auto &&it : secondary_indexes_)
+                    it.second->Remove(old);
+            }
+        }
+        hashes.emplace_back(record.GetHash(), position);
+        rows.emplace_back(record.row_id_, std::make_pair(lengths[i], position));
+        indexed.push_back(&record);
+        _TrackVersion(record.row_id_, keep && replaced ? &previous : nullptr, commit_ts, oldest_snapshot, lengths[i], position);
+    }
+    index_.InsertBatch(std::move(hashes));
+    row_id_index_.InsertBatch(std::move(rows));
+    for (auto &&it : secondary_indexes_)
+        it.second->InsertBatch(indexed);
+    return true;
+}
+
+void BasicStorageEngine::_TrackVersion(RecordId id, const std::pair<RecordLength_t, RecordPosition_t> *previous,
+                                       uint64_t commit_ts, uint64_t oldest_snapshot,
+                                       RecordLength_t length, RecordPosition_t position)
+{
+    std::lock_guard<std::mutex> lock(versions_mutex_);
+    // no pinned snapshot is older than the new version: every reader sees it,
+    // the record goes back to a single version
+    if (oldest_snapshot >= commit_ts || length <= 0)
+    {
+        versions_.erase(id);
+        return;
+    }
+    auto &chain = versions_[id];
+    // the version replaced was seen by all
+    if (chain.empty() && previous != nullptr)
+        chain.push_back({0, previous->first, previous->second});
+    chain.push_back({commit_ts, length, position});
+    _PruneVersions(chain, oldest_snapshot);
+}
+
+void BasicStorageEngine::ReleaseVersions(uint64_t oldest_snapshot)
+{
+    std::lock_guard<std::mutex> lock(versions_mutex_);
+    for (auto it = versions_.begin(); it != versions_.end();)
+    {
+        if (_PruneVersions(it->second, oldest_snapshot))
+            it = versions_.erase(it);
+        else
+            ++it;
+    }
+}
+
+bool BasicStorageEngine::_PruneVersions(std::vector<Version> &chain, uint64_t oldest_snapshot)
+{
+    // a version is hidden from all the snapshots when the next one is seen by the oldest
+    size_t hidden = 0;
+    while (hidden + 1 < chain.size() && chain[hidden + 1].commit_ts <= oldest_snapshot)
+        hidden++;
+    chain.erase(chain.begin(), chain.begin() + hidden);
+    return chain.size() == 1 && chain.front().commit_ts <= oldest_snapshot;
+}
+
 // Load the index from the index file
 void BasicStorageEngine::LoadIndex()
 {
-    // Open the index file in read mode
-    std::ifstream index_file(file_name_ + ".index");
-    std::string line;
-    while (std::getline(index_file, line))
+    std::string path = file_name_ + ".index";
+    std::vector<std::pair<uint64_t, RecordPosition_t>> legacy;
+    if (_IsLegacyIndexFile(path))
     {
-        // Split the line by ',' to get the key and file offset
-        size_t pos = line.find(',');
-        std::string key = line.substr(0, pos);
-        int offset = std::stoi(line.substr(pos + 1));
-        index_.Insert(key, offset);
+        // index written as text by older versions: "key,offset" lines
+        std::ifstream index_file(path);
+        std::string line;
+        while (std::getline(index_file, line))
+        {
+            // Split the line by ',' to get the key and file offset
+            size_t pos = line.find(',');
+            if (pos == std::string::npos)
+                continue;
+            legacy.emplace_back(std::stoull(line.substr(0, pos)), std::stoll(line.substr(pos + 1)));
+        }
+        index_file.close();
+        std::filesystem::remove(path);
     }
-    index_file.close();
+
+    if (!index_.Open(path))
+        throw std::runtime_error("cannot open index " + path);
+    for (auto &&it : legacy)
+        index_.Insert(it.first, it.second);
+    // the legacy file is gone, persist the converted index right away
+    if (!legacy.empty())
+        index_.Flush();
 }
+
 // Load the index from the index file
 void BasicStorageEngine::LoadHiddenIndex()
 {
-    // Open the index file in read mode
-    std::ifstream index_file(file_name_ + ".row.index"); // keylenghpos
-    if (!index_file.is_open())
-        return;
-    while (!index_file.eof())
+    std::string path = file_name_ + ".row.index";
+    std::vector<std::pair<RecordId, std::pair<RecordLength_t, RecordPosition_t>>> legacy;
+    if (_IsLegacyIndexFile(path))
     {
+        // flat file written by older versions: (key, length, position) triplets
+        std::ifstream index_file(path, std::ios::binary);
         RecordId key;
         RecordLength_t rec_len;
         RecordPosition_t rec_pos;
-        index_file.read(reinterpret_cast<char *>(&key), sizeof(RecordId));
-        index_file.read(reinterpret_cast<char *>(&rec_len), sizeof(RecordLength_t));
-        index_file.read(reinterpret_cast<char *>(&rec_pos), sizeof(RecordPosition_t));
-        row_id_index_.Insert(key, std::make_pair(rec_len, rec_pos));
+        while (index_file.read(reinterpret_cast<char *>(&key), sizeof(RecordId)) &&
+               index_file.read(reinterpret_cast<char *>(&rec_len), sizeof(RecordLength_t)) &&
+               index_file.read(reinterpret_cast<char *>(&rec_pos), sizeof(RecordPosition_t)))
+        {
+            legacy.emplace_back(key, std::make_pair(rec_len, rec_pos));
+        }
+        index_file.close();
+        std::filesystem::remove(path);
     }
-    index_file.close();
+
+    if (!row_id_index_.Open(path))
+        throw std::runtime_error("cannot open index " + path);
+    for (auto &&it : legacy)
+        row_id_index_.Insert(it.first, it.second);
+    if (!legacy.empty())
+        row_id_index_.Flush();
 
     if (row_id_index_.GetSize())
         current_rec_id_ = row_id_index_.GetMax();
 }
 
+void BasicStorageEngine::_Recover()
+{
+    RecordPosition_t end = data_file_.GetSize();
+    RecordPosition_t start = 0;
+    bool found = false;
+    {
+        std::ifstream file(_CheckpointPath(), std::ios::binary);
+        char magic[sizeof(CHECKPOINT_MAGIC)];
+        if (file.read(magic, sizeof(magic)) && memcmp(magic, CHECKPOINT_MAGIC, sizeof(magic)) == 0 &&
+            file.read(reinterpret_cast<char *>(&start), sizeof(start)))
+            found = true;
+    }
+    // the index files can't be trusted when the checkpoint is missing or doesn't match
+    // the data file: a data file truncated or created again next to older index files,
+    // or an index file left unclean by a crash, which may miss entries or hold stale pages
+    bool corrupt = !found || start > end || !index_.IsClean() || !row_id_index_.IsClean();
+    if (!corrupt && row_id_index_.GetSize())
+    {
+        // the last record indexed was written before the checkpoint
+        std::pair<RecordLength_t, RecordPosition_t> last;
+        corrupt = !row_id_index_.Find(row_id_index_.GetMax(), last) || last.second + last.first > start;
+    }
+    if (corrupt)
+    {
+        // all the indexes are rebuilt from the whole data file
+        _ClearIndexes();
+        start = 0;
+    }
+    if (start >= end)
+        return;
+
+    // the scan is bounded by the data written since the last flush
+    RecordScanner scanner(data_file_, start);
+    Record rec;
+    RecordPosition_t position;
+    RecordLength_t length;
+    while (scanner.Next(rec, position, length))
+    {
+        // the secondary index files are rebuilt as a whole after a rebuild
+        if (!rebuilt_indexes_)
+        {
+            std::pair<RecordLength_t, RecordPosition_t> previous;
+            if (row_id_index_.Find(rec.row_id_, previous) && previous.second < start)
+                recovered_.push_back({rec.row_id_, previous});
+            recovered_.push_back({rec.row_id_, {length, position}});
+        }
+
+        index_.Insert(rec.GetHash(), position);
+        row_id_index_.Insert(rec.row_id_, std::make_pair(length, position));
+        current_rec_id_ = std::max(current_rec_id_, rec.row_id_);
+    }
+
+    // a record cut by the crash is dropped, the write-ahead log still holds it
+    if (scanner.Tell() < end)
+        data_file_.Truncate(scanner.Tell());
+}
+
+void BasicStorageEngine::_ClearIndexes()
+{
+    if (!index_.Clear() || !row_id_index_.Clear())
+        throw std::runtime_error("cannot clear the indexes of " + file_name_);
+    current_rec_id_ = 0;
+    recovered_.clear();
+    rebuilt_indexes_ = true;
+}
+
+std::string BasicStorageEngine::_CheckpointPath() const
+{
+    return file_name_ + ".checkpoint";
+}
+
+bool BasicStorageEngine::_SaveCheckpoint()
+{
+    RecordPosition_t size = data_file_.GetSize();
+    std::string tmp_file = _CheckpointPath() + ".tmp";
+    {
+        std::ofstream file(tmp_file, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+            return false;
+        file.write(CHECKPOINT_MAGIC, sizeof(CHECKPOINT_MAGIC));
+        file.write(reinterpret_cast<const char *>(&size), sizeof(size));
+        if (!file.good())
+            return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp_file, _CheckpointPath(), ec);
+    return !ec;
+}
+
+void BasicStorageEngine::_ApplyRecovered(ISecondaryIndex &index)
+{
+    // the file may hold entries of any of these versions
+    Record rec;
+    for (auto &&it : recovered_)
+    {
+        if (_LoadRecord(it.second.second, rec, it.second.first) > 0)
+            index.Remove(rec);
+    }
+    for (auto &&it : recovered_)
+    {
+        std::pair<RecordLength_t, RecordPosition_t> entry;
+        if (row_id_index_.Find(it.first, entry) && entry == it.second &&
+            _LoadRecord(entry.second, rec, entry.first) > 0)
+            index.Insert(rec);
+    }
+}
+
+bool BasicStorageEngine::Replay(Record &record)
+{
+    if (is_for_schema_)
+        return false;
+
+    std::pair<RecordLength_t, RecordPosition_t> entry;
+    if (row_id_index_.Find(record.row_id_, entry) && entry.second + entry.first <= data_file_.GetSize())
+    {
+        std::vector<char> buffer;
+        _EncodeRecord(record, buffer);
+        if (entry.first == (RecordLength_t)buffer.size())
+        {
+            // the logged version reached the data file
+            std::vector<char> stored(buffer.size());
+            if (data_file_.ReadAt(entry.second, stored.data(), stored.size()) == (int64_t)stored.size() &&
+                stored == buffer)
+                return true;
+        }
+        return Save(record, false);
+    }
+
+    // the record was lost with the tail of the data file
+    current_rec_id_ = std::max(current_rec_id_, record.row_id_);
+    Insert(record);
+    return row_id_index_.Find(record.row_id_, entry);
+}
+
 // Save the index to the index file
 void BasicStorageEngine::SaveIndex()
 {
-    // Open the index file in write mode
+    // only the dirty pages are written back
+    index_.Flush();
+    row_id_index_.Flush();
+    for (auto &&it : secondary_indexes_)
+        it.second->Flush();
+}
+
+bool BasicStorageEngine::CreateIndex(const std::string &index_name, uint16_t column_indx, DataTypes type)
+{
+    if (is_for_schema_)
+        return false;
+    if (secondary_indexes_.find(index_name) != secondary_indexes_.end())
+        return true;
+
+    std::unique_ptr<ISecondaryIndex> index(CreateSecondaryIndex(column_indx, type));
+    if (index == nullptr)
+        return false;
+
+    // an index file written by a previous session is reused as is,
+    // unless the other indexes were rebuilt from the data file
+    std::string path = _SecondaryIndexPath(index_name);
+    std::error_code ec;
+    if (rebuilt_indexes_)
+        std::filesystem::remove(path, ec);
+    bool build = !std::filesystem::exists(path, ec) || std::filesystem::file_size(path, ec) == 0;
+    if (!index->Open(path))
     {
-        std::ofstream index_file(file_name_ + ".index", std::ios::trunc);
+        std::filesystem::remove(path, ec);
+        if (!index->Open(path))
+            return false;
+        build = true;
+    }
 
-        // Iterate over the index and write the key-offset pairs to the file
-        std::vector<std::pair<std::string, int>> entries = index_.GetEntries();
-        for (const auto &entry : entries)
+    if (!build)
+        _ApplyRecovered(*index);
+    else
+    {
+        // index the live records of the table
+        RecordScanner scanner(data_file_);
+        Record rec;
+        RecordPosition_t position;
+        RecordLength_t length;
+        while (scanner.Next(rec, position, length))
         {
-            index_file << entry.first << "," << entry.second << "\n";
+            if (_IsLiveVersion(rec.row_id_, position))
+                index->Insert(rec);
         }
-
-        // Close the index file
-        index_file.close();
+        index->Flush();
     }
-    // Open the index file in write mode
+
+    secondary_indexes_[index_name] = std::move(index);
+    return true;
+}
+
+bool BasicStorageEngine::DropIndex(const std::string &index_name)
+{
+    auto it = secondary_indexes_.find(index_name);
+    if (it == secondary_indexes_.end())
+        return false;
+    secondary_indexes_.erase(it);
+    std::error_code ec;
+    return std::filesystem::remove(_SecondaryIndexPath(index_name), ec);
+}
+
+std::string BasicStorageEngine::_SecondaryIndexPath(const std::string &index_name) const
+{
+    return file_name_ + "." + index_name + ".secondary.index";
+}
+
+bool BasicStorageEngine::_LookupSecondaryIndex(const Filters_t &filters, std::vector<RecordId> &ids, bool &exact)
+{
+    if (secondary_indexes_.empty())
+        return false;
+
+    auto find_index = [this](uint16_t column) -> ISecondaryIndex *
     {
-        std::ofstream index_file(file_name_ + ".row.index", std::ios::trunc);
-        if (!index_file.is_open())
-            return;
-        // Iterate over the index and write the key-offset pairs to the file
-        auto entries = row_id_index_.GetEntries();
-        for (const auto &entry : entries)
+        for (auto &&it : secondary_indexes_)
         {
-            index_file.write(reinterpret_cast<const char *>(&entry.first), sizeof(RecordId));
-            index_file.write(reinterpret_cast<const char *>(&entry.second.first), sizeof(RecordLength_t));
-            index_file.write(reinterpret_cast<const char *>(&entry.second.second), sizeof(RecordPosition_t));
+            if (it.second->GetColumn() == column)
+                return it.second.get();
         }
+        return nullptr;
+    };
 
-        // Close the index file
-        index_file.close();
+    // the most selective filters are tried first:
+    // equality and IN lists, ranges, one sided comparisons, out of range
+    auto rank = [](OperatorType oper)
+    {
+        switch (oper)
+        {
+        case OperatorType::eEqual:
+        case OperatorType::eIn:
+            return 0;
+        case OperatorType::eInRange:
+            return 1;
+        case OperatorType::eGreater:
+        case OperatorType::eGreaterOrEq:
+        case OperatorType::eLesser:
+        case OperatorType::eLesserOrEq:
+            return 2;
+        case OperatorType::eOutRange:
+            return 3;
+        default:
+            return 4;
+        }
+    };
+
+    for (int pass = 0; pass < 4; pass++)
+    {
+        for (auto &&filter : filters)
+        {
+            if (rank(filter->oper) != pass)
+                continue;
+            ISecondaryIndex *index = find_index(filter->column_indx);
+            if (index == nullptr)
+                continue;
+
+            if (pass == 2)
+            {
+                // a lower and an upper bound on the same column, e.g. a time window,
+                // are scanned as a single range and checked against both filters
+                bool lower = filter->oper == OperatorType::eGreater || filter->oper == OperatorType::eGreaterOrEq;
+                for (auto &&other : filters)
+                {
+                    if (other == filter || other->column_indx != filter->column_indx)
+                        continue;
+                    bool other_upper = other->oper == OperatorType::eLesser || other->oper == OperatorType::eLesserOrEq;
+                    bool other_lower = other->oper == OperatorType::eGreater || other->oper == OperatorType::eGreaterOrEq;
+                    if ((lower && other_upper) || (!lower && other_lower))
+                    {
+                        Filter range(filter->column_indx, OperatorType::eInRange,
+                                     lower ? filter->value1 : other->value1,
+                                     lower ? other->value1 : filter->value1);
+                        if (index->Lookup(range, ids, exact))
+                        {
+                            exact = false;
+                            return true;
+                        }
+                    }
+                }
+            }
+
+            if (index->Lookup(*filter, ids, exact))
+                return true;
+        }
     }
+    return false;
+}
+
+bool BasicStorageEngine::_IsLegacyIndexFile(const std::string &path)
+{
+    std::error_code ec;
+    if (!std::filesystem::exists(path, ec) || std::filesystem::file_size(path, ec) == 0)
+        return false;
+    return !BTreeIndex<uint64_t, int>::IsIndexFile(path);
 }
 
 // Save the record into storage
@@ -267,68 +1098,107 @@ bool BasicStorageEngine::Save(Record &record, bool isNew)
     else
     {
         // the record isn't a new one
-        // get the position inside the hidden index
-        // if the old version have  size greater or equal to the new size --> write on the same position
-        // else modify the hidden index and put at the end
-        // it worths to notice this implementation still need to handle "holes" generated by this mecanism
-        auto info = row_id_index_.Lookup(record.row_id_);
-        RecordLength_t size = record.GetRowSize();
-        if (info.first >= size)
+        // the new version is appended and the hidden index points to it.
+        // A version is never written over: the record views read without the
+        // table latch point into the mapping and must not change under the reader.
+        std::pair<RecordLength_t, RecordPosition_t> info;
+        if (!row_id_index_.Find(record.row_id_, info))
+            return false;
+
+        // the secondary index entries of the previous version are replaced
+        if (!secondary_indexes_.empty())
         {
-            // update in the same position
-            std::fstream file(file_name_);
-            if (file.is_open())
+            Record previous;
+            if (_LoadRecord(info.second, previous, info.first) > 0)
             {
-                return false;
+                for (auto &&it : secondary_indexes_)
+                    it.second->Remove(previous);
             }
-            file.seekp(info.second);
-            RecordFile rec_file(file);
-            if (!rec_file.Write(record))
-                return false;
-            info.first = size;
-            row_id_index_.Insert(record.row_id_, info);
-            file.close();
-        }
-        else
-        {
-            // insert it at the end
-            Insert(record);
-            return true;
         }
+
+        Insert(record);
+        return true;
     }
     return false;
 }
 
 bool BasicStorageEngine::Flush()
 {
-    if (!is_for_schema_)
-    {
-        SaveIndex();
-    }
-    return true;
+    if (is_for_schema_)
+        return data_file_.Sync();
+
+    SaveIndex();
+    // the data file must be on disk before the write-ahead log is restarted
+    if (!data_file_.Sync())
+        return false;
+    // the index files cover the whole data file
+    recovered_.clear();
+    return _SaveCheckpoint();
 }
 
 bool BasicStorageEngine::DropStorage()
 {
+    mapped_file_.Unmap();
+    data_file_.Close();
+    std::error_code ec;
+    std::filesystem::remove(_CheckpointPath(), ec);
     return std::filesystem::remove(file_name_);
 }
 
-RecordLength_t BasicStorageEngine::_LoadRecord(RecordPosition_t position, Record &rec)
+RecordLength_t BasicStorageEngine::_LoadRecord(RecordPosition_t position, Record &rec, RecordLength_t len_hint)
 {
-    RecordLength_t len = 0;
-    std::fstream file(file_name_);
-
-    RecordFile recInFile(file);
-    RecordId id = -1;
-    file.seekg(position);
-    if (recInFile.Read(id, &rec))
+    // the hint comes from the hidden index and is exact for records written
+    // by this engine; when unknown, read a default amount and grow on need
+    thread_local std::vector<char> buffer;
+    size_t want = len_hint > 0 ? len_hint : DEFAULT_RECORD_READ;
+    while (true)
     {
-        len = file.tellg() - position;
+        buffer.resize(want);
+        int64_t got = data_file_.ReadAt(position, buffer.data(), want);
+        if (got <= 0)
+            return 0;
+
+        // small payloads are stored in the fields, when the record is too large
+        // for that one arena block holds the others: each field takes at most
+        // its encoded size plus the alignment padding
+        uint64_t field_nbr = 0;
+        if (got >= 16)
+            memcpy(&field_nbr, buffer.data() + sizeof(RecordId), sizeof(field_nbr));
+        if (field_nbr <= MAX_FIELDS_PER_RECORD &&
+            (uint64_t)got > 16 + field_nbr * (1 + Field::INLINE_SIZE))
+            rec.arena_.Reserve(got + 8 * field_nbr);
+
+        MemoryReader stream(buffer.data(), got);
+        RecordStream<MemoryReader> recInFile(stream);
+        RecordId id = -1;
+        if (recInFile.Read(id, &rec))
+            return stream.tell();
+
+        // the record is truncated by the end of file
+        if ((size_t)got < want)
+            return 0;
+        want *= 2;
     }
-    file.close();
-    return len;
 }
 
+bool BasicStorageEngine::_IsLiveVersion(RecordId id, RecordPosition_t position)
+{
+    // the schema storage has no hidden index, every record is alive
+    if (is_for_schema_)
+        return true;
+    std::pair<RecordLength_t, RecordPosition_t> entry;
+    if (!row_id_index_.Find(id, entry))
+        return false;
+    return entry.second == position;
+}
+
+void BasicStorageEngine::_EncodeRecord(const Record &record, std::vector<char> &buffer)
+{
+    buffer.reserve(buffer.size() + record.GetRowSize());
+    MemoryWriter stream(buffer);
+    RecordStream<MemoryWriter> rec_stream(stream);
+    rec_stream.Write(record);
+}
 
 
 
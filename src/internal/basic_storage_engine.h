@@ -12,6 +12,9 @@
 #define _H_BASIC_STORAGE_ENGINE_HH_
 
 #include "btreeindex.h"
+#include "file_handle.h"
+#include "mapped_file.h"
+#include "secondary_index.h"
 #include "ruru.h"
 
 namespace ruru
@@ -19,6 +22,8 @@ namespace ruru
     namespace internal
     {
 
+        class CompiledFilters;
+
         class BasicStorageEngineFactory : public IStorageEngineFactory
         {
 
@@ -54,6 +59,9 @@ namespace ruru
             // LoadRecord
             Record *LoadRecord(RecordId id) override;
 
+            // Point view at the record inside the mapping of the data file
+            bool LoadRecordView(RecordId id, RecordView &view) override;
+
             // Save a record and set a record id
             bool Save(Record &record, bool isNew) override;
 
@@ -63,19 +71,82 @@ namespace ruru
             // Drop Storage
             bool DropStorage() override;
 
+            // Create a secondary index on a column, or open it when it already exists
+            bool CreateIndex(const std::string &index_name, uint16_t column_indx, DataTypes type) override;
+
+            // Drop a secondary index
+            bool DropIndex(const std::string &index_name) override;
+
+            // Apply a record read from the write-ahead log, skipped when the stored version is the same
+            bool Replay(Record &record) override;
+
+            // Save a record, the position of the version it replaces is kept for the older snapshots
+            bool SaveVersion(Record &record, bool isNew, uint64_t commit_ts, uint64_t oldest_snapshot) override;
+
+            // Load the version of a record seen by a snapshot
+            Record *LoadRecord(RecordId id, uint64_t snapshot) override;
+            bool LoadRecordView(RecordId id, uint64_t snapshot, RecordView &view) override;
+
+            // drop the positions of the versions no snapshot sees anymore
+            void ReleaseVersions(uint64_t oldest_snapshot) override;
+
+            // check the updated records exist and give the new ones their row id
+            bool PrepareBatch(RecordBatch_t &records) override;
+
+            // give back the row ids of the new records, the table is latched since PrepareBatch
+            void CancelBatch(const RecordBatch_t &records) override;
+
+            // append the records with one write, then index them
+            bool SaveBatch(const RecordBatch_t &records, uint64_t commit_ts, uint64_t oldest_snapshot) override;
+
+            // cursor walking the hidden index, or the ids found by a secondary index
+            RecordCursorPtr OpenCursor(const Filters_t &filters, uint64_t snapshot) override;
+
             ~BasicStorageEngine() = default;
 
-        private:
+        protected:
             bool is_for_schema_;
             std::string file_name_;
             RecordId current_rec_id_;
-            BTreeIndex<std::string, int> index_;
+
+            // long-lived handle on the data file, all accesses are positional
+            FileHandle data_file_;
+            // read-only mapping of the data file, records are read in place
+            MappedFile mapped_file_;
+            // record hash --> position
+            BTreeIndex<uint64_t, RecordPosition_t> index_;
 
             // row_id_index_ is a hidden index
             // it allows quick retrieval and detection of deletion
             // if the record is deleted --> RecordLength_t = 0
             BTreeIndex<RecordId, std::pair<RecordLength_t, RecordPosition_t>> row_id_index_;
 
+            // secondary indexes by name
+            std::map<std::string, std::unique_ptr<ISecondaryIndex>> secondary_indexes_;
+
+            // versions of the records found past the checkpoint at open, with the version
+            // they replaced. The secondary index files opened before the next flush
+            // are updated with them.
+            std::vector<std::pair<RecordId, std::pair<RecordLength_t, RecordPosition_t>>> recovered_;
+
+            // the indexes were rebuilt from the data file at open, the secondary index
+            // files left by the previous session are stale
+            bool rebuilt_indexes_;
+
+            // a version of a record in the data file
+            struct Version
+            {
+                uint64_t commit_ts;
+                RecordLength_t length;
+                RecordPosition_t position;
+            };
+            // versions of the records saved while an older snapshot was pinned, oldest first,
+            // the last one is the current version. The other records have one version seen by all.
+            // versions are never written over, the old ones stay readable in the data file.
+            std::unordered_map<RecordId, std::vector<Version>> versions_;
+            // the readers look the versions up while the flush releases them
+            std::mutex versions_mutex_;
+
             // Load the index from the index file
             void LoadIndex();
 
@@ -85,8 +156,81 @@ namespace ruru
             // Load hidden index
             void LoadHiddenIndex();
 
+            // index the records appended after the last flush
+            // the scan starts at the data file size saved in the checkpoint file
+            void _Recover();
+
+            // empty the hash and hidden indexes before they are rebuilt from the data file
+            void _ClearIndexes();
+
+            // path of the checkpoint file: data file size covered by the index files
+            std::string _CheckpointPath() const;
+
+            // save the data file size after a flush
+            bool _SaveCheckpoint();
+
+            // update a secondary index file with the recovered records
+            void _ApplyRecovered(ISecondaryIndex &index);
+
+            // true for an index file written in the format preceding the paged B+tree
+            static bool _IsLegacyIndexFile(const std::string &path);
+
+            // position of the version of id seen by snapshot
+            // returns false when the record was created after the snapshot
+            bool _FindVersion(RecordId id, uint64_t snapshot, std::pair<RecordLength_t, RecordPosition_t> &entry);
+
+            // entry holds the current version of id, it is replaced by the version seen by snapshot
+            // returns false when the record was created after the snapshot
+            bool _SeenVersion(RecordId id, uint64_t snapshot, std::pair<RecordLength_t, RecordPosition_t> &entry);
+
+            // records matching filters read from the hidden index or from a list of ids
+            class Cursor;
+
+            // cursor reading the sorted candidate ids, the records are checked against filters
+            RecordCursorPtr _OpenCursor(std::vector<RecordId> ids, const Filters_t &filters, uint64_t snapshot);
+
+            // add the version of id stored at position to its chain, previous is the version
+            // it replaces when an older snapshot may still see it
+            void _TrackVersion(RecordId id, const std::pair<RecordLength_t, RecordPosition_t> *previous,
+                               uint64_t commit_ts, uint64_t oldest_snapshot,
+                               RecordLength_t length, RecordPosition_t position);
+
+            // drop the versions hidden from oldest_snapshot by a later one
+            // returns true when the current version is the only one left, seen by all
+            static bool _PruneVersions(std::vector<Version> &chain, uint64_t oldest_snapshot);
+
+            // the record stored at entry read from a cache of the engine, false on a miss
+            // scan is true for the records read in a sequence
+            virtual bool _LoadCached(const std::pair<RecordLength_t, RecordPosition_t> &, Record &, bool) { return false; }
+
+            // a version of id of length bytes was appended at position
+            virtual void _Appended(RecordId, RecordPosition_t, RecordLength_t) {}
+
+            // ids of the live records matching compiled, read front to back
+            virtual void _ScanLookup(const CompiledFilters &compiled, std::vector<RecordId> &rowsid);
+
+            // point view at the record stored at entry
+            bool _ViewAt(const std::pair<RecordLength_t, RecordPosition_t> &entry, RecordView &view);
+
             // Load record by position
-            RecordLength_t _LoadRecord(RecordPosition_t position, Record &rec);
+            // len_hint is the length stored in the hidden index, 0 when unknown
+            RecordLength_t _LoadRecord(RecordPosition_t position, Record &rec, RecordLength_t len_hint = 0);
+
+            // path of the file of a secondary index
+            std::string _SecondaryIndexPath(const std::string &index_name) const;
+
+            // candidate ids from the secondary index serving the most selective filter
+            // returns false when no index can serve the filters
+            bool _LookupSecondaryIndex(const Filters_t &filters, std::vector<RecordId> &ids, bool &exact);
+
+            // true when the record found at position is the current version of id
+            bool _IsLiveVersion(RecordId id, RecordPosition_t position);
+
+            // index a record stored at position
+            void _IndexRecord(const Record &record, RecordLength_t length, RecordPosition_t position);
+
+            // Serialize a record into buffer
+            void _EncodeRecord(const Record &record, std::vector<char> &buffer);
         };
 
         class IRecordLoader
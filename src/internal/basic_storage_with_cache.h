@@ -8,6 +8,7 @@
 
 
 #include "btreeindex.h"
+#include "basic_storage_engine.h"
 #include "ruru.h"
 
 namespace ruru
@@ -26,29 +27,28 @@ namespace ruru
             virtual std::string getName() override;
         };
 
-        class BasicCachedStorageEngine : public IStorageEngine
+        /*
+            BasicCachedStorageEngine : BasicStorageEngine with a table cache
+            the data file, its handle and the indexes are managed by BasicStorageEngine.
+            The records are read from the pages of the cache, from the data file on a miss;
+            the hidden index gives the position of a record, its page holds it.
+        */
+        class BasicCachedStorageEngine : public BasicStorageEngine
         {
         public:
             // Constructor
             BasicCachedStorageEngine(const std::string &file_name);
 
-            // Insert a record into the table
-            void Insert(const Record &record) override;
-
             // Select all records from the table
             std::vector<Record> SelectAll() override;
 
-            // Look up a record by key
-            std::vector<Record> Lookup(const std::string &key) override;
-
-            // Look up records by filter
-            std::vector<RecordId> Lookup(const Filters_t &filters) override;
-
-            // LoadRecord
+            // the current version is found in the directory of the cache, without the hidden index
             Record *LoadRecord(RecordId id) override;
+            using BasicStorageEngine::LoadRecord;
 
-            // Save a record and set a record id
-            bool Save(Record &record, bool isNew) override;
+            // the records are copied out of the cache, never viewed in the data file
+            bool LoadRecordView(RecordId id, RecordView &view) override;
+            bool LoadRecordView(RecordId id, uint64_t snapshot, RecordView &view) override;
 
             // Flush
             bool Flush() override;
@@ -56,36 +56,27 @@ namespace ruru
             // Drop Storage
             bool DropStorage() override;
 
+            // keep the pages in the pool of the database, the cache is loaded again in the background
+            void SetBufferPool(BufferPool *pool) override;
+
             ~BasicCachedStorageEngine() = default;
 
-        private:
-            std::string file_name_;
-            RecordId current_rec_id_;
-            BTreeIndex<std::string, int> index_;
+        protected:
+            bool _LoadCached(const std::pair<RecordLength_t, RecordPosition_t> &entry, Record &rec, bool scan) override;
+
+            // the page of the record is read again
+            void _Appended(RecordId id, RecordPosition_t position, RecordLength_t length) override;
 
-            // row_id_index_ is a hidden index
-            // it allows quick retrieval and detection of deletion
-            // if the record is deleted --> RecordLength_t = 0
-            BTreeIndex<RecordId, std::pair<RecordLength_t, RecordPosition_t>> row_id_index_;
+            // the pages are scanned instead of the data file
+            void _ScanLookup(const CompiledFilters &compiled, std::vector<RecordId> &rowsid) override;
 
+        private:
             // cache 
             std::unique_ptr<CacheStore>  cache_store_;
-
-            // Load the index from the index file
-            void LoadIndex();
-
-            // Save the index to the index file
-            void SaveIndex();
-
-            // Load hidden index
-            void LoadHiddenIndex();
-
-            // Load record by position
-            RecordLength_t _LoadRecord(RecordPosition_t position, Record &rec);
         };
 
 
     }
 }
 
-#endif
\ No newline at end of file
+#endif
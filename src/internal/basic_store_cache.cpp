@@ -2,276 +2,345 @@
 #include "ruru.h"
 #include "record.h"
 #include "internal/basic_store_cache.h"
-#include "internal/basic_storage_engine.h"
-#include "internal/RecordStream.h"
-#include "utils/binary_stream.h"
-#include "internal/tools.h"
+#include "internal/record_scanner.h"
+#include "internal/predicate.h"
 
 namespace ruru::internal
 {
 
-    // template<uint64_t seg_size>
-    CacheSegment::CacheSegment(CacheStore *parent, std::size_t begin_pos, std::size_t end_pos)
-        : parent(parent), start(begin_pos), end(end_pos), cur_pos(-1)
+    CacheSegment::CacheSegment(std::size_t begin_pos)
+        : start(begin_pos), end(begin_pos), memory_size(sizeof(CacheSegment))
     {
     }
 
-    bool CacheSegment::Flush(const std::string &file_path)
+    bool CacheSegment::GetSlot(uint32_t slot, Record &rec)
     {
-        bool result = true;
-        std::streampos current_pos = start;
-        std::fstream out(file_path, std::ios::binary | std::ios::app);
-        if (!out.is_open())
-        {
+        std::shared_lock<std::shared_mutex> lock(latch);
+        if (slot >= RecSeg.size())
             return false;
-        }
-
-        out.seekp(current_pos);
-        for (auto &&it : rawIDSeg)
-        {
-            if (dataMap.find(it) != dataMap.end())
-            {
-                uint64_t indice = dataMap[it];
-                Record *rec = RecSeg[indice];
-                if (rec != nullptr)
-                {
-                    assert(rec->row_id_ == it);
-                    assert(rec->GetRowSize() + current_pos <= end);
-                    assert(rec->RunCb());
-                    RecordFile rec_file(out);
-                    result = rec_file.Write(*rec);
-                    if (result != true)
-                        return false;
-                }
-            }
-        }
-
-        out.close();
-        return result;
+        rec = *RecSeg[slot];
+        return true;
     }
 
-    bool CacheSegment::GetRecord(RecordId id, Record &rec)
+    bool CacheSegment::GetRecordAt(RecordPosition_t position, Record &rec)
     {
-        bool result = true;
-        if (dataMap.find(id) == dataMap.end())
+        std::shared_lock<std::shared_mutex> lock(latch);
+        // the records are in file order
+        auto found = std::lower_bound(positions.begin(), positions.end(), position);
+        if (found == positions.end() || *found != position)
             return false;
+        rec = *RecSeg[found - positions.begin()];
+        return true;
+    }
 
-        auto indice = dataMap[id];
-        rec = *RecSeg[indice];
-
-        return result;
+    bool CacheSegment::SetRecord(RecordPosition_t position, const Record &rec)
+    {
+        std::unique_lock<std::shared_mutex> lock(latch);
+        return _SetRecord(position, rec);
     }
 
-    bool CacheSegment::SetRecord(RecordId id, const Record &rec)
+    bool CacheSegment::_SetRecord(RecordPosition_t position, const Record &rec)
     {
         bool result = true;
-        if (dataMap.find(id) == dataMap.end())
-            cur_pos++;
         Record *new_rec = new Record(rec);
-        RecSeg[cur_pos] = new_rec;
-        dataMap[id] = cur_pos;
-        rawIDSeg[cur_pos] = id;
+        RecSeg.push_back(new_rec);
+        positions.push_back(position);
+        end = position + rec.GetRowSize();
+        // the record, its fields and its entries in the segment
+        memory_size += sizeof(Record) + rec.fields_.size() * sizeof(Field) + rec.GetRowSize() +
+                       sizeof(Record *) + sizeof(RecordPosition_t);
 
         return result;
     }
 
+    uint64_t CacheSegment::GetMemorySize() const
+    {
+        std::shared_lock<std::shared_mutex> lock(latch);
+        return memory_size;
+    }
+
     CacheSegment::~CacheSegment()
     {
         for (auto &&it : RecSeg)
             delete it;
     }
 
-    bool CacheSegment::AlignPos(size_t pos_start, size_t& pos_end)
+#pragma region CacheStore
+
+    CacheStore::CacheStore(const std::string &file_path, BufferPool *pool)
+        : file_path(file_path), file(file_path), pool(pool), covered(0), stop_loading(false), loading(false)
     {
-        bool result = true;
-        start = pos_start;
-        size_t len = 0;
-        for ( auto&& r: RecSeg )
+        if (this->pool == nullptr)
         {
-            if ( r== nullptr)
-                break;
-            len+= r->GetRowSize();
+            own_pool.reset(new BufferPool());
+            this->pool = own_pool.get();
         }
+    }
 
-        pos_end = len;
-        end     = len;
+    bool CacheStore::Load(bool background)
+    {
+        _StopLoader();
+        RecordPosition_t end;
+        {
+            std::unique_lock<std::shared_mutex> lock(pages_latch);
+            page_first.clear();
+            page_records.clear();
+            directory.clear();
+            appended.clear();
+            covered = 0;
+            pool->DropAll(this);
+            // opened again to get the current size
+            file.Close();
+            // a new table: the file is opened with the first append
+            if (!file.Open(false))
+                return !std::filesystem::exists(file_path);
+            end = file.GetSize();
+            loading = true;
+        }
 
-        return result;
+        stop_loading = false;
+        if (background)
+            loader = std::thread(&CacheStore::_LoadPages, this, end);
+        else
+            _LoadPages(end);
+        return true;
     }
-#pragma region CacheStore
 
-    CacheStore::CacheStore(const std::string &file_path)
-        : file_path(file_path)
+    void CacheStore::_LoadPages(RecordPosition_t end)
     {
+        // the records are carried over between the reads of the scanner,
+        // the pages are kept while they fit in the budget, then only their records are noted
+        bool warm = true;
+        uint64_t page = 0;
+        std::vector<std::pair<RecordId, RecordPosition_t>> records;
+        std::unique_ptr<CacheSegment> seg;
+        RecordPosition_t loaded = 0;
+
+        RecordScanner scanner(file);
+        Record rec;
+        RecordPosition_t position;
+        RecordLength_t length;
+        while (!stop_loading && scanner.Next(rec, position, length) && position < end)
+        {
+            uint64_t p = position / CACHE_PAGE_SIZE;
+            if (p != page && !records.empty())
+            {
+                warm = _Publish(page, records, std::move(seg)) && warm;
+                records.clear();
+            }
+            if (records.empty())
+            {
+                page = p;
+                if (warm)
+                    seg.reset(new CacheSegment(p * CACHE_PAGE_SIZE));
+            }
+            records.emplace_back(rec.row_id_, position);
+            if (seg != nullptr)
+                seg->_SetRecord(position, rec);
+            loaded = position + length;
+        }
+        if (!records.empty())
+            _Publish(page, records, std::move(seg));
+
+        // the records appended meanwhile follow the scanned ones
+        std::unique_lock<std::shared_mutex> lock(pages_latch);
+        covered = loaded;
+        for (auto &&it : appended)
+        {
+            if (std::get<1>(it) == covered)
+                covered += std::get<2>(it);
+            _Note(std::get<0>(it), std::get<1>(it));
+            pool->Drop(this, std::get<1>(it) / CACHE_PAGE_SIZE);
+        }
+        appended.clear();
+        loading = false;
     }
 
-    bool CacheStore::Load()
+    bool CacheStore::_Publish(uint64_t page, const std::vector<std::pair<RecordId, RecordPosition_t>> &records,
+                              std::unique_ptr<CacheSegment> segment)
     {
-        // Load from the file
-        std::fstream in_file(file_path, std::ios::in | std::ios::binary);
-        if (!in_file.is_open())
+        std::unique_lock<std::shared_mutex> lock(pages_latch);
+        for (auto &&it : records)
+            _Note(it.first, it.second);
+        if (segment == nullptr)
             return false;
+        if (pool->GetUsage() + segment->GetMemorySize() > pool->GetBudget())
+            return false;
+        pool->Pin(this, page, [&]
+                  { return std::unique_ptr<ISegment>(std::move(segment)); }, BufferPool::Access::eScan);
+        return true;
+    }
 
-        std::size_t cur_pos, start_pos;
+    void CacheStore::WaitLoaded()
+    {
+        if (loader.joinable())
+            loader.join();
+    }
 
-        cur_pos = 0;
-        start_pos = 0;
-        CacheSegment *seg = new CacheSegment(this, start_pos, cur_pos);
+    void CacheStore::_StopLoader()
+    {
+        stop_loading = true;
+        WaitLoaded();
+    }
 
-        // char buffer[1024 * 1024]; // 1Mb
-        std::array<char, 1024 * 1024> buffer;
-        while (true)
+    std::unique_ptr<ISegment> CacheStore::_ReadPage(uint64_t page)
+    {
+        RecordPosition_t first;
         {
-
-            std::fill(buffer.begin(), buffer.end(), 0);
-
-            if ((int64_t)seg->cur_pos >= (int64_t)SEGMENT_SIZE)
-            {
-                seg->end = in_file.tellp();
-                seg->end--;
-                start_pos = in_file.tellp();
-                segments.push_back(seg);
-                CacheSegment *seg = new CacheSegment(this, start_pos, cur_pos);
-            }
-            in_file.read(buffer.begin(), buffer.size());
-
-            BinaryStream<decltype(buffer)> stream(buffer);
-            std::streamsize ss = in_file.gcount();
-            if (ss <= 0)
-                break;
-
-            while (!stream.eof() && !stream.fail() && stream.tell() < ss) 
-            {
-                RecordStream<BinaryStream<decltype(buffer)>> rec_stream(stream);
-                RecordId id = -1;
-                Record rec;
-                if (rec_stream.Read(id, &rec))
-                {
-                    seg->SetRecord(rec.row_id_, rec);
-                    cur_pos += rec.GetRowSize();
-                    seg->end = in_file.tellp();
-                    seg->end--;
-                }
-                else
-                {
-                    // a stream error occurs
-                    // meaning not all the rec is loaded from disk
-                    // continue loading next part of the rec
-                    std::streamsize remind = stream.tell();
-                    throw std::runtime_error("Not impement");
-                }
-            }
-            int a = 0;
+            std::shared_lock<std::shared_mutex> lock(pages_latch);
+            if (page >= page_first.size() || page_first[page] < 0)
+                return nullptr;
+            first = page_first[page];
         }
-        segments.push_back(seg);
+        RecordPosition_t limit = (page + 1) * CACHE_PAGE_SIZE;
+        std::unique_ptr<CacheSegment> seg(new CacheSegment(page * CACHE_PAGE_SIZE));
+
+        // the last record of the page may end in the next one
+        RecordScanner scanner(file, first, CACHE_PAGE_SIZE);
+        Record rec;
+        RecordPosition_t position;
+        RecordLength_t length;
+        while (scanner.Next(rec, position, length) && position < limit)
+            seg->_SetRecord(position, rec);
+        return seg;
+    }
 
-        in_file.close();
-        return true;
+    BufferPool::PageRef CacheStore::_PinPage(uint64_t page, BufferPool::Access access)
+    {
+        return pool->Pin(this, page, [this, page]
+                         { return _ReadPage(page); }, access);
     }
 
     std::vector<RecordId> CacheStore::Lookup(const Filters_t &filters)
     {
         std::vector<RecordId> result;
+        CompiledFilters compiled(filters);
+        Scan([&](const Record &rec, RecordPosition_t)
+             {
+                 // apply filters
+                 if (compiled.Match(rec))
+                     result.push_back(rec.row_id_); });
+        return result;
+    }
 
-        for ( auto&& seg : segments)
+    void CacheStore::Scan(const std::function<void(const Record &, RecordPosition_t)> &visit)
+    {
+        size_t pages;
         {
-            CacheSegment* c_seg = dynamic_cast<CacheSegment*>(seg);
-            for ( int i = 0; i< c_seg->cur_pos; i++)
-            {
-                // apply filters
-                bool ok = true;
-                auto rec= c_seg->RecSeg[i];
-
-                for (auto &&filter : filters)
-                {
-                    if (!_ApplyFilter(*rec, *filter.get()))
-                    {
-                        ok = false;
-                        break;
-                    }
-                }
-                if (ok)
-                    result.push_back(rec->row_id_);
-                }
+            std::shared_lock<std::shared_mutex> lock(pages_latch);
+            pages = page_first.size();
+        }
+        for (uint64_t page = 0; page < pages; page++)
+        {
+            // a full scan doesn't push the pages used by the point reads out of the pool
+            auto ref = _PinPage(page, BufferPool::Access::eScan);
+            if (!ref)
+                continue;
+            CacheSegment *c_seg = static_cast<CacheSegment *>(ref.Get());
+            std::shared_lock<std::shared_mutex> seg_lock(c_seg->latch);
+            for (size_t i = 0; i < c_seg->RecSeg.size(); i++)
+                visit(*c_seg->RecSeg[i], c_seg->positions[i]);
         }
-        return result;
     }
 
-    // Insert a record in the cache
-    bool CacheStore::Insert(const Record &rec)
+    bool CacheStore::Covers(RecordPosition_t size)
     {
-        //find the correct Segment
-        bool result = false;
-        if ( rec.row_id_ != -1)
+        std::shared_lock<std::shared_mutex> lock(pages_latch);
+        return !loading && covered == size;
+    }
+
+    bool CacheStore::GetRecordAt(RecordPosition_t position, Record &rec, BufferPool::Access access)
+    {
+        uint64_t page = position / CACHE_PAGE_SIZE;
         {
-            for( auto&& it : segments)
-            {
-                CacheSegment* seg = dynamic_cast<CacheSegment*>(it);
-            
-                if ( seg->cur_pos < SEGMENT_SIZE )
-                {
-                    return it->SetRecord(rec.row_id_, rec);
-                }
-            }
+            std::shared_lock<std::shared_mutex> lock(pages_latch);
+            if (page >= page_first.size())
+                return false;
         }
-        else
+        BufferPool::PageRef ref = access == BufferPool::Access::eScan
+                                      ? pool->Find(this, page, access)
+                                      : pool->TryPin(this, page, [this, page]
+                                                     { return _ReadPage(page); });
+        return ref && ref->GetRecordAt(position, rec);
+    }
+
+    void CacheStore::_Note(RecordId id, RecordPosition_t position)
+    {
+        uint64_t page = position / CACHE_PAGE_SIZE;
+        if (page >= page_first.size())
         {
-            //shoul calculate the rowid 
-            //get the last seg
-            auto r_it = segments.rbegin();
-            if ( r_it != segments.rend())
-            {
-                CacheSegment* seg = dynamic_cast<CacheSegment*>(*r_it);
-                if ( seg->cur_pos < SEGMENT_SIZE )
-                {
-                    return seg->SetRecord(rec.row_id_, rec);
-                }
-            }
-            
+            page_first.resize(page + 1, -1);
+            page_records.resize(page + 1, 0);
         }
-        if ( result == false)
+        if (page_first[page] < 0)
+            page_first[page] = position;
+
+        // row ids are dense, from 1
+        if (id >= directory.size())
+            directory.resize(std::max<size_t>(id + 1, directory.size() * 2), Slot{NO_PAGE, 0});
+        directory[id] = Slot{(uint32_t)page, page_records[page]++};
+    }
+
+    void CacheStore::Append(RecordId id, RecordPosition_t position, RecordLength_t length)
+    {
+        std::unique_lock<std::shared_mutex> lock(pages_latch);
+        if (loading)
         {
-            CacheSegment* seg = new CacheSegment(this,-1, -1);
-            result = seg->SetRecord( rec.row_id_, rec);
-            segments.push_back(seg);
+            appended.emplace_back(id, position, length);
+            return;
         }
-        return result;
+        if (!file.IsOpen())
+            file.Open(false);
+        // a record missed in between leaves the pages behind the file
+        if (position == covered)
+            covered = position + length;
+        _Note(id, position);
+        // the frame of the page misses the record
+        pool->Drop(this, position / CACHE_PAGE_SIZE);
+    }
+
+    void CacheStore::Clear()
+    {
+        _StopLoader();
+        std::unique_lock<std::shared_mutex> lock(pages_latch);
+        page_first.clear();
+        page_records.clear();
+        directory.clear();
+        appended.clear();
+        covered = 0;
+        pool->DropAll(this);
+        file.Close();
     }
 
     // flush data into disk
     bool CacheStore::Flush()
     {
-        //how to write down the content of the cache into file
-        // iterating over all segments
-        // calculating the positions of the segments then flush 
-        size_t pos = 0;
-        for ( auto&& it : segments)
-        {
-            CacheSegment* seg = dynamic_cast<CacheSegment*>(it);
-            seg->AlignPos(pos , pos);
-            it->Flush(file_path);
-        }
-        return false;
+        // the records are written by the storage engine, the pages only mirror the file
+        return true;
     }
 
     //get record
     bool CacheStore::GetRecord(RecordId id,  Record &rec)
     {
-        bool result = false;
-
-        for (auto&& it : segments )
+        Slot location;
         {
-           if (  it->GetRecord(id, rec) )
-            return true;
+            std::shared_lock<std::shared_mutex> lock(pages_latch);
+            // a later version may not be scanned yet
+            if (loading || id >= directory.size() || directory[id].page == NO_PAGE)
+                return false;
+            location = directory[id];
         }
-        return result;   
+        uint64_t page = location.page;
+        auto ref = pool->TryPin(this, page, [this, page]
+                                { return _ReadPage(page); });
+        return ref && ref->GetSlot(location.slot, rec) && rec.row_id_ == id;
     }
 
     // dtor
     CacheStore::~CacheStore()
     {
-        for (auto &&it : segments)
-            delete it;
+        _StopLoader();
+        pool->DropAll(this);
     }
 
 
@@ -6,6 +6,12 @@
 #ifndef _H_BASIC_STORE_CACHE_HH_
 #define _H_BASIC_STORE_CACHE_HH_
 
+#include <shared_mutex>
+#include <thread>
+#include <atomic>
+#include "internal/buffer_pool.h"
+#include "internal/file_handle.h"
+
 namespace ruru
 {
     class Record;
@@ -14,8 +20,7 @@ namespace ruru
 namespace ruru::internal
 {
     // constexps
-    constexpr uint64_t SEGMENT_SIZE = 1024;     // size of each segment
-    constexpr uint64_t SEGMENTS_PER_CACHE = 24; // number of segment per cache
+    constexpr uint64_t CACHE_PAGE_SIZE = 64 * 1024; // file bytes cached by a segment
 
     // forward declaration
     class CacheStore;
@@ -25,72 +30,162 @@ namespace ruru::internal
     {
 
     public:
-        virtual bool Flush(const std::string &file_path) = 0;
-        virtual bool GetRecord(RecordId id, Record &rec) = 0;
-        virtual bool SetRecord(RecordId id, const Record &rec) = 0;
+        // the record in a slot, the slots are numbered in file order
+        virtual bool GetSlot(uint32_t slot, Record &rec) = 0;
+        // the record stored at a file position
+        virtual bool GetRecordAt(RecordPosition_t position, Record &rec) = 0;
+        virtual bool SetRecord(RecordPosition_t position, const Record &rec) = 0;
+        // bytes held by the segment, counted in the budget of the buffer pool
+        virtual uint64_t GetMemorySize() const = 0;
         virtual ~ISegment(){};
     };
     /*
         \class CacheSegment
         \brief represents the cache of a file portion
-                it is related directly to the Cache
-
+                the records starting in one page of the data file, in file order.
+                It is the content of a frame of the buffer pool.
+                the segment latch is shared by the readers of its records,
+                exclusive to SetRecord
     */
-    // template <uint64_t seg_size>
     class CacheSegment : public ISegment
     {
-        // parent cache
-        CacheStore *parent;
-        // starting position
+        // starting position of the page
         std::size_t start;
-        // end position
+        // end position of the last record
         std::size_t end;
-        // managed rawids
-        std::array<RecordId, SEGMENT_SIZE /*seg_size*/> rawIDSeg;
         // record Segment
-        std::array<ruru::Record *, SEGMENT_SIZE /*seg_size*/> RecSeg;
-        // data pos map
-        std::unordered_map<RecordId, uint64_t> dataMap; // for each RecordId define its position in RegSeg
-        // array cursor
-        uint64_t cur_pos;
+        std::vector<ruru::Record *> RecSeg;
+        // file position of each record
+        std::vector<RecordPosition_t> positions;
+        // bytes held by the records
+        uint64_t memory_size;
+        // latch on the records of the segment
+        mutable std::shared_mutex latch;
         friend class CacheStore;
 
-        // private ctor
-        CacheSegment(CacheStore *, std::size_t begin_pos, std::size_t end_pos);
-
         CacheSegment() = delete;
 
-        //file position alignement
-        bool AlignPos(size_t pos_start, size_t& pos_end);
+        // SetRecord, latch held by the caller
+        bool _SetRecord(RecordPosition_t position, const Record &rec);
 
     public:
-        bool Flush(const std::string &file_path) override;
-        bool GetRecord(RecordId id, Record &rec) override;
-        bool SetRecord(RecordId id, const Record &rec) override;
+        CacheSegment(std::size_t begin_pos);
+        bool GetSlot(uint32_t slot, Record &rec) override;
+        bool GetRecordAt(RecordPosition_t position, Record &rec) override;
+        bool SetRecord(RecordPosition_t position, const Record &rec) override;
+        uint64_t GetMemorySize() const override;
         virtual ~CacheSegment();
     };
 
+    /*
+        \class CacheStore
+        \brief cache of a table file split in pages of CACHE_PAGE_SIZE bytes
+                the segment of a page is a frame of a buffer pool, it is read again
+                from the file after its eviction. Load notes the position of the first
+                record of every page, the pages are read from there.
+                The pages are images of the file: nothing is written back. The file is
+                only appended to, a record never changes at its position; the storage
+                engine tells the records it appends, the page they land in is read again.
+                A directory gives the page and the slot of the current version of every
+                record by row id.
+                Load may scan the file in a background thread, the pages are published
+                one by one; until the end of the scan the records are only read by
+                position and the appends are noted after the scanned part.
+    */
     class CacheStore
     {
+        // page and slot of a record in the directory
+        struct Slot
+        {
+            uint32_t page;
+            uint32_t slot;
+        };
+        static constexpr uint32_t NO_PAGE = UINT32_MAX;
+
         std::string file_path;
-        std::vector<ISegment *> segments;
+        // the data file, read by pages
+        FileHandle file;
+        // frames of the pages
+        BufferPool *pool;
+        // pool of a cache created without one
+        std::unique_ptr<BufferPool> own_pool;
+        // position of the first record starting in each page, -1 when none does
+        std::vector<RecordPosition_t> page_first;
+        // number of records starting in each page
+        std::vector<uint32_t> page_records;
+        // slot of the current version of each record, indexed by row id. A page read again
+        // holds the same records in the same slots, the directory stays valid after an eviction
+        std::vector<Slot> directory;
+        // end of the records known to page_first
+        RecordPosition_t covered;
+        // latch on page_first, page_records, directory, covered, loading and appended
+        std::shared_mutex pages_latch;
+        // background scan of Load
+        std::thread loader;
+        std::atomic<bool> stop_loading;
+        // the scan is not over: the directory may hold old versions
+        bool loading;
+        // records appended during the scan: id, position, length
+        std::vector<std::tuple<RecordId, RecordPosition_t, RecordLength_t>> appended;
         CacheStore() = delete;
+
+        // scan the records before end, publish each page once scanned
+        void _LoadPages(RecordPosition_t end);
+
+        // note the records of a scanned page, keep its segment when it fits in the budget
+        // returns false once the budget is reached
+        bool _Publish(uint64_t page, const std::vector<std::pair<RecordId, RecordPosition_t>> &records,
+                      std::unique_ptr<CacheSegment> segment);
+
+        // stop the background scan and wait for it
+        void _StopLoader();
+
+        // note a record stored at position, the last one noted for an id is its current version
+        // latch held
+        void _Note(RecordId id, RecordPosition_t position);
+
+        // read the records starting in a page
+        std::unique_ptr<ISegment> _ReadPage(uint64_t page);
+
+        // pin the frame of a page, read on a miss
+        BufferPool::PageRef _PinPage(uint64_t page, BufferPool::Access access = BufferPool::Access::ePoint);
+
     public:
         // ctor
-        CacheStore(const std::string &file_path);
+        // the frames are kept in pool, in a pool of BufferPool::DEFAULT_BUDGET bytes when it is null
+        CacheStore(const std::string &file_path, BufferPool *pool = nullptr);
+
+        // Scan the file into this cache. the pages are kept while they fit in the budget of the pool
+        // in background the scan goes on in a thread and Load returns once the file is open
+        bool Load(bool background = false);
 
-        // Load file into this cache. Cache have a limits, we only load the Max Segment ( SEGMENTS_PER_CACHE)
-        bool Load();
+        // wait for the end of a background Load
+        void WaitLoaded();
 
         // Lookup
         std::vector<RecordId> Lookup(const Filters_t &filters);
 
-        // Insert a record in the cache
-        bool Insert(const Record &rec);
+        // visit the records of every page in file order, old versions included
+        void Scan(const std::function<void(const Record &, RecordPosition_t)> &visit);
+
+        // true when the pages hold every record of a file of size bytes
+        bool Covers(RecordPosition_t size);
+
+        // the record stored at position, false when its page is not read for access:
+        // a scan only reads the pages in the pool, a point access the pages it would keep
+        bool GetRecordAt(RecordPosition_t position, Record &rec, BufferPool::Access access = BufferPool::Access::ePoint);
+
+        // a record of length bytes appended at position by the storage engine
+        void Append(RecordId id, RecordPosition_t position, RecordLength_t length);
+
+        // forget the pages, the file is dropped
+        void Clear();
 
-        // flush data into disk
+        // the pages are never modified, nothing to write
         bool Flush();
 
+        // the current version of a record, found through the directory
+        // false when its page is not kept by a point access
         bool GetRecord(RecordId id,  Record &rec);
 
         // dtor
@@ -99,4 +194,4 @@ namespace ruru::internal
 
 }
 
-#endif //_H_BASIC_STORE_CACHE_HH_
\ No newline at end of file
+#endif //_H_BASIC_STORE_CACHE_HH_
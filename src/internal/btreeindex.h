@@ -6,73 +6,732 @@
 #ifndef _H_BTREE_INDEX__
 #define _H_BTREE_INDEX__
 
+#include <list>
+#include <mutex>
+#include "file_handle.h"
+
 namespace ruru
 {
+    // size of a B+tree page on disk
+    constexpr size_t BTREE_PAGE_SIZE = 4096;
+    // number of leaf pages kept in memory before write back & eviction
+    constexpr size_t BTREE_CACHED_LEAVES = 1024;
+
+    /*
+        PageCodec: fixed-size encoding of keys and values inside a page
+        keys and values are copied as raw bytes, pairs field by field
+    */
+    template <typename T>
+    struct PageCodec
+    {
+        static constexpr size_t size = sizeof(T);
+        static void Write(char *dst, const T &value) { memcpy(dst, &value, sizeof(T)); }
+        static void Read(const char *src, T &value) { memcpy(&value, src, sizeof(T)); }
+    };
+
+    template <typename A, typename B>
+    struct PageCodec<std::pair<A, B>>
+    {
+        static constexpr size_t size = PageCodec<A>::size + PageCodec<B>::size;
+        static void Write(char *dst, const std::pair<A, B> &value)
+        {
+            PageCodec<A>::Write(dst, value.first);
+            PageCodec<B>::Write(dst + PageCodec<A>::size, value.second);
+        }
+        static void Read(const char *src, std::pair<A, B> &value)
+        {
+            PageCodec<A>::Read(src, value.first);
+            PageCodec<B>::Read(src + PageCodec<A>::size, value.second);
+        }
+    };
+
+    /*
+        \class BTreeIndex
+        \brief paged B+tree
+
+        file layout: page 0 is the header, every other page is a node of
+        BTREE_PAGE_SIZE bytes. Leaves are chained left to right.
+            node  : is_leaf(1) pad(1) count(2) pad(4) next_leaf(8)
+            leaf  : keys[LEAF_CAPACITY] values[LEAF_CAPACITY]
+            inner : keys[INNER_CAPACITY] children[INNER_CAPACITY + 1]
+
+        internal pages are never evicted once loaded; leaves are kept in an
+        LRU list and written back when evicted or on Flush, so only dirty
+        pages reach the disk.
+        the header is flagged unclean before the first page is written back and
+        flagged clean again by Flush, after all the pages: a file left unclean by
+        a crash may have leaves that its inner pages and header don't know of,
+        IsClean() tells the owner to rebuild it.
+        Delete removes the entry from its leaf, underfull leaves are not merged.
+
+        without an attached file (no Open call) the tree lives in memory only.
+
+        every public call holds the latch of the tree: a lookup moves its leaf in
+        the LRU list and may load or evict pages, so readers latch the tree too.
+        Scan and ForEach callbacks run with the latch held and must not call the tree.
+    */
     template <typename K, typename V>
     class BTreeIndex
     {
+        static constexpr size_t NODE_HEADER_SIZE = 16;
+        static constexpr size_t KEY_SIZE = PageCodec<K>::size;
+        static constexpr size_t VALUE_SIZE = PageCodec<V>::size;
+        static constexpr size_t LEAF_CAPACITY = (BTREE_PAGE_SIZE - NODE_HEADER_SIZE) / (KEY_SIZE + VALUE_SIZE);
+        static constexpr size_t INNER_CAPACITY = (BTREE_PAGE_SIZE - NODE_HEADER_SIZE - sizeof(uint64_t)) / (KEY_SIZE + sizeof(uint64_t));
+        static_assert(LEAF_CAPACITY >= 4 && INNER_CAPACITY >= 4, "key or value too big for a B+tree page");
+
+        static constexpr char MAGIC[8] = {'R', 'U', 'R', 'U', 'B', 'T', '0', '1'};
+        // header state, files written before the flag existed read as clean
+        static constexpr uint32_t STATE_CLEAN = 0;
+        static constexpr uint32_t STATE_UNCLEAN = 1;
+
+        struct Header
+        {
+            char magic[8];
+            uint32_t page_size;
+            uint32_t key_size;
+            uint32_t value_size;
+            uint32_t state;
+            uint64_t root;
+            uint64_t page_count;
+            uint64_t entry_count;
+        };
+
+        struct Node
+        {
+            uint64_t id;
+            bool leaf;
+            bool dirty;
+            uint64_t next;
+            std::vector<K> keys;
+            std::vector<V> values;          // leaf only
+            std::vector<uint64_t> children; // inner only
+            typename std::list<uint64_t>::iterator lru_it;
+        };
+
+        std::unique_ptr<internal::FileHandle> file_;
+        std::unordered_map<uint64_t, std::unique_ptr<Node>> nodes_;
+        // cached leaves, most recently used first
+        std::list<uint64_t> lru_;
+        size_t max_cached_leaves_;
+        uint64_t root_;
+        uint64_t page_count_;
+        uint64_t entry_count_;
+        bool header_dirty_;
+        // the header on disk is flagged unclean
+        bool unclean_;
+        std::mutex latch_;
+
     public:
+        BTreeIndex() : max_cached_leaves_(BTREE_CACHED_LEAVES)
+        {
+            _InitEmpty();
+        }
+
+        BTreeIndex(const BTreeIndex &) = delete;
+        BTreeIndex &operator=(const BTreeIndex &) = delete;
+
+        // attach the tree to an index file, the file is created when missing
+        // returns false when the file is not a B+tree file of this key/value type
+        bool Open(const std::string &path)
+        {
+            std::lock_guard<std::mutex> lock(latch_);
+            file_.reset(new internal::FileHandle(path));
+            if (!file_->Open(true))
+            {
+                file_.reset();
+                return false;
+            }
+            if (file_->GetSize() == 0)
+            {
+                _InitEmpty();
+                return true;
+            }
+
+            char page[BTREE_PAGE_SIZE];
+            Header header;
+            if (file_->ReadAt(0, page, BTREE_PAGE_SIZE) < (int64_t)sizeof(header))
+            {
+                file_.reset();
+                return false;
+            }
+            memcpy(&header, page, sizeof(header));
+            if (memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0 || header.page_size != BTREE_PAGE_SIZE ||
+                header.key_size != KEY_SIZE || header.value_size != VALUE_SIZE)
+            {
+                file_.reset();
+                return false;
+            }
+
+            nodes_.clear();
+            lru_.clear();
+            root_ = header.root;
+            page_count_ = header.page_count;
+            entry_count_ = header.entry_count;
+            header_dirty_ = false;
+            unclean_ = header.state != STATE_CLEAN;
+            return true;
+        }
+
+        // false when the file was left between two flushes, its content can't be trusted
+        bool IsClean()
+        {
+            std::lock_guard<std::mutex> lock(latch_);
+            return !unclean_;
+        }
+
+        // drop all the entries, the index file is emptied
+        bool Clear()
+        {
+            std::lock_guard<std::mutex> lock(latch_);
+            _InitEmpty();
+            return !file_ || file_->Truncate(0);
+        }
+
+        // check if the file at path starts with a B+tree header
+        static bool IsIndexFile(const std::string &path)
+        {
+            std::ifstream in(path, std::ios::binary);
+            char magic[sizeof(MAGIC)];
+            if (!in.read(magic, sizeof(magic)))
+                return false;
+            return memcmp(magic, MAGIC, sizeof(MAGIC)) == 0;
+        }
+
+        // number of leaves kept in memory
+        void SetCacheCapacity(size_t leaves)
+        {
+            std::lock_guard<std::mutex> lock(latch_);
+            max_cached_leaves_ = std::max<size_t>(leaves, 1);
+            _Evict(0);
+        }
+
         // Insert a key-value pair into the index
         void Insert(const K &key, const V &value)
         {
-            index_[key] = value;
+            std::lock_guard<std::mutex> lock(latch_);
+            std::vector<std::pair<Node *, size_t>> path;
+            Node *node = _FindLeaf(key, &path);
+
+            auto it = std::lower_bound(node->keys.begin(), node->keys.end(), key);
+            size_t pos = it - node->keys.begin();
+            if (it != node->keys.end() && !(key < *it))
+            {
+                node->values[pos] = value;
+            }
+            else
+            {
+                node->keys.insert(it, key);
+                node->values.insert(node->values.begin() + pos, value);
+                entry_count_++;
+                header_dirty_ = true;
+            }
+            node->dirty = true;
+
+            if (node->keys.size() > LEAF_CAPACITY)
+                _SplitLeaf(node, path);
+            _Evict(0);
+        }
+
+        // Insert a batch of key-value pairs, the last value of a key given twice wins
+        // the entries are sorted, then merged into the leaves they belong to, one leaf
+        // at a time: a run of keys falling into a leaf costs one descent of the tree
+        void InsertBatch(std::vector<std::pair<K, V>> entries)
+        {
+            if (entries.empty())
+                return;
+            std::stable_sort(entries.begin(), entries.end(), [](const std::pair<K, V> &a, const std::pair<K, V> &b)
+                             { return a.first < b.first; });
+
+            std::lock_guard<std::mutex> lock(latch_);
+            std::vector<std::pair<Node *, size_t>> path;
+            size_t i = 0;
+            while (i < entries.size())
+            {
+                path.clear();
+                Node *node = _FindLeaf(entries[i].first, &path);
+                // the keys of the leaf are below the nearest separator on its right
+                const K *bound = nullptr;
+                for (auto it = path.rbegin(); it != path.rend() && bound == nullptr; ++it)
+                {
+                    if (it->second < it->first->keys.size())
+                        bound = &it->first->keys[it->second];
+                }
+                size_t end = i;
+                while (end < entries.size() && (bound == nullptr || entries[end].first < *bound))
+                    end++;
+                _MergeLeaf(node, entries, i, end);
+                i = end;
+                if (node->keys.size() > LEAF_CAPACITY)
+                    _SplitRun(node);
+                _Evict(0);
+            }
         }
 
         bool Exists(const K &key)
         {
-            return index_.find(key) != index_.end();
+            std::lock_guard<std::mutex> lock(latch_);
+            V value;
+            return _Find(key, value);
+        }
+
+        // Look up the value for a given key, returns false when the key is missing
+        bool Find(const K &key, V &value)
+        {
+            std::lock_guard<std::mutex> lock(latch_);
+            return _Find(key, value);
         }
 
         // Look up the value for a given key
         V Lookup(const K &key)
         {
-            return index_[key];
+            std::lock_guard<std::mutex> lock(latch_);
+            V value{};
+            _Find(key, value);
+            return value;
         }
 
         // Delete the key-value pair for a given key
         void Delete(const K &key)
         {
-            index_.erase(key);
+            std::lock_guard<std::mutex> lock(latch_);
+            Node *node = _FindLeaf(key, nullptr);
+            auto it = std::lower_bound(node->keys.begin(), node->keys.end(), key);
+            if (it != node->keys.end() && !(key < *it))
+            {
+                size_t pos = it - node->keys.begin();
+                node->keys.erase(it);
+                node->values.erase(node->values.begin() + pos);
+                node->dirty = true;
+                entry_count_--;
+                header_dirty_ = true;
+            }
+            _Evict(0);
+        }
+
+        // visit the entries with key >= from in key order
+        // cb(key, value) returns false to stop the scan
+        template <typename F>
+        void Scan(const K &from, F &&cb)
+        {
+            std::lock_guard<std::mutex> lock(latch_);
+            Node *node = _FindLeaf(from, nullptr);
+            size_t pos = std::lower_bound(node->keys.begin(), node->keys.end(), from) - node->keys.begin();
+            _ScanLeaves(node, pos, cb);
+        }
+
+        // visit all the entries in key order
+        // cb(key, value) returns false to stop the scan
+        template <typename F>
+        void ForEach(F &&cb)
+        {
+            std::lock_guard<std::mutex> lock(latch_);
+            _ForEach(cb);
         }
 
         // Get all the entries in the index
         std::vector<std::pair<K, V>> GetEntries()
         {
+            std::lock_guard<std::mutex> lock(latch_);
             std::vector<std::pair<K, V>> entries;
-            for (const auto &kv : index_)
-            {
-                entries.push_back(kv);
-            }
+            entries.reserve(entry_count_);
+            _ForEach([&](const K &key, const V &value)
+                    { entries.emplace_back(key, value); return true; });
             return entries;
         }
 
         size_t GetSize()
         {
-            return index_.size();
+            std::lock_guard<std::mutex> lock(latch_);
+            return entry_count_;
         }
 
         K GetMax()
         {
-            return index_.rbegin()->first;
+            std::lock_guard<std::mutex> lock(latch_);
+            Node *node = _GetNode(root_);
+            while (!node->leaf)
+                node = _GetNode(node->children.back());
+            if (!node->keys.empty())
+            {
+                K key = node->keys.back();
+                _Evict(0);
+                return key;
+            }
+            // the rightmost leaf was emptied by deletions
+            K key{};
+            _ForEach([&](const K &k, const V &)
+                    { key = k; return true; });
+            return key;
         }
 
         std::vector<K> GetKeys()
         {
+            std::lock_guard<std::mutex> lock(latch_);
             std::vector<K> result;
-            size_t s = index_.size();
-            result.resize(s);
-            size_t i = 0;
-            for (auto &&it : index_)
+            result.reserve(entry_count_);
+            _ForEach([&](const K &key, const V &)
+                    { result.push_back(key); return true; });
+            return result;
+        }
+
+        // write the dirty pages and the header back to the index file
+        // the header is written last, once the pages are on disk
+        bool Flush()
+        {
+            std::lock_guard<std::mutex> lock(latch_);
+            if (!file_)
+                return true;
+            for (auto &&it : nodes_)
             {
-                result[i] = it.first;
-                i++;
+                if (it.second->dirty && (!_MarkUnclean() || !_WriteNode(*it.second)))
+                    return false;
             }
-            return result;
+            if (!unclean_)
+                return _WriteHeader(STATE_CLEAN);
+            if (!file_->Sync())
+                return false;
+            header_dirty_ = true;
+            if (!_WriteHeader(STATE_CLEAN) || !file_->Sync())
+                return false;
+            unclean_ = false;
+            return true;
         }
 
     private:
-        std::map<K, V> index_;
+        bool _Find(const K &key, V &value)
+        {
+            Node *node = _FindLeaf(key, nullptr);
+            auto it = std::lower_bound(node->keys.begin(), node->keys.end(), key);
+            bool found = it != node->keys.end() && !(key < *it);
+            if (found)
+                value = node->values[it - node->keys.begin()];
+            _Evict(0);
+            return found;
+        }
+
+        template <typename F>
+        void _ForEach(F &&cb)
+        {
+            Node *node = _GetNode(root_);
+            while (!node->leaf)
+                node = _GetNode(node->children.front());
+            _ScanLeaves(node, 0, cb);
+        }
+
+        void _InitEmpty()
+        {
+            nodes_.clear();
+            lru_.clear();
+            root_ = 1;
+            page_count_ = 1;
+            entry_count_ = 0;
+            header_dirty_ = true;
+            unclean_ = false;
+            _NewNode(true);
+        }
+
+        Node *_NewNode(bool leaf)
+        {
+            Node *node = new Node();
+            node->id = page_count_++;
+            node->leaf = leaf;
+            node->dirty = true;
+            node->next = 0;
+            if (leaf)
+            {
+                lru_.push_front(node->id);
+                node->lru_it = lru_.begin();
+            }
+            nodes_[node->id].reset(node);
+            header_dirty_ = true;
+            return node;
+        }
+
+        Node *_GetNode(uint64_t id)
+        {
+            auto it = nodes_.find(id);
+            if (it != nodes_.end())
+            {
+                Node *node = it->second.get();
+                if (node->leaf)
+                    lru_.splice(lru_.begin(), lru_, node->lru_it);
+                return node;
+            }
+            return _ReadNode(id);
+        }
+
+        Node *_FindLeaf(const K &key, std::vector<std::pair<Node *, size_t>> *path)
+        {
+            Node *node = _GetNode(root_);
+            while (!node->leaf)
+            {
+                size_t i = std::upper_bound(node->keys.begin(), node->keys.end(), key) - node->keys.begin();
+                if (path)
+                    path->emplace_back(node, i);
+                node = _GetNode(node->children[i]);
+            }
+            return node;
+        }
+
+        template <typename F>
+        void _ScanLeaves(Node *node, size_t pos, F &cb)
+        {
+            while (true)
+            {
+                for (; pos < node->keys.size(); pos++)
+                {
+                    if (!cb(node->keys[pos], node->values[pos]))
+                    {
+                        _Evict(0);
+                        return;
+                    }
+                }
+                if (node->next == 0)
+                    break;
+                node = _GetNode(node->next);
+                pos = 0;
+                // keep the memory bounded on long scans
+                _Evict(node->id);
+            }
+            _Evict(0);
+        }
+
+        // merge the sorted entries [from, to) into a leaf, keys already there get the new value
+        void _MergeLeaf(Node *node, const std::vector<std::pair<K, V>> &entries, size_t from, size_t to)
+        {
+            std::vector<K> keys;
+            std::vector<V> values;
+            keys.reserve(node->keys.size() + to - from);
+            values.reserve(node->keys.size() + to - from);
+            size_t pos = 0;
+            for (size_t i = from; i < to; i++)
+            {
+                const K &key = entries[i].first;
+                while (pos < node->keys.size() && node->keys[pos] < key)
+                {
+                    keys.push_back(node->keys[pos]);
+                    values.push_back(node->values[pos]);
+                    pos++;
+                }
+                if (pos < node->keys.size() && !(key < node->keys[pos]))
+                    pos++;
+                else if (!keys.empty() && !(keys.back() < key))
+                {
+                    // the same key twice in the batch
+                    values.back() = entries[i].second;
+                    continue;
+                }
+                else
+                    entry_count_++;
+                keys.push_back(key);
+                values.push_back(entries[i].second);
+            }
+            keys.insert(keys.end(), node->keys.begin() + pos, node->keys.end());
+            values.insert(values.end(), node->values.begin() + pos, node->values.end());
+            node->keys.swap(keys);
+            node->values.swap(values);
+            node->dirty = true;
+            header_dirty_ = true;
+        }
+
+        // split an overfull leaf into leaves of at most LEAF_CAPACITY entries
+        void _SplitRun(Node *node)
+        {
+            size_t count = node->keys.size();
+            size_t pieces = (count + LEAF_CAPACITY - 1) / LEAF_CAPACITY;
+            size_t piece = (count + pieces - 1) / pieces;
+            std::vector<K> keys;
+            std::vector<V> values;
+            keys.swap(node->keys);
+            values.swap(node->values);
+            node->keys.assign(keys.begin(), keys.begin() + piece);
+            node->values.assign(values.begin(), values.begin() + piece);
+            uint64_t next = node->next;
+
+            std::vector<std::pair<Node *, size_t>> path;
+            for (size_t start = piece; start < count; start += piece)
+            {
+                size_t end = std::min(start + piece, count);
+                Node *right = _NewNode(true);
+                right->keys.assign(keys.begin() + start, keys.begin() + end);
+                right->values.assign(values.begin() + start, values.begin() + end);
+                right->next = next;
+                // the leaf on the left is the one holding the keys below the new separator
+                path.clear();
+                Node *left = _FindLeaf(right->keys.front(), &path);
+                left->next = right->id;
+                left->dirty = true;
+                _InsertInParent(path, left, right->keys.front(), right);
+                _Evict(right->id);
+            }
+        }
+
+        void _SplitLeaf(Node *node, std::vector<std::pair<Node *, size_t>> &path)
+        {
+            Node *right = _NewNode(true);
+            size_t mid = node->keys.size() / 2;
+            right->keys.assign(node->keys.begin() + mid, node->keys.end());
+            right->values.assign(node->values.begin() + mid, node->values.end());
+            node->keys.resize(mid);
+            node->values.resize(mid);
+            right->next = node->next;
+            node->next = right->id;
+            node->dirty = true;
+            _InsertInParent(path, node, right->keys.front(), right);
+        }
+
+        void _InsertInParent(std::vector<std::pair<Node *, size_t>> &path, Node *left, const K &separator, Node *right)
+        {
+            if (path.empty())
+            {
+                // the root was split, grow the tree
+                Node *root = _NewNode(false);
+                root->keys.push_back(separator);
+                root->children.push_back(left->id);
+                root->children.push_back(right->id);
+                root_ = root->id;
+                return;
+            }
+
+            auto [parent, i] = path.back();
+            path.pop_back();
+            parent->keys.insert(parent->keys.begin() + i, separator);
+            parent->children.insert(parent->children.begin() + i + 1, right->id);
+            parent->dirty = true;
+
+            if (parent->keys.size() > INNER_CAPACITY)
+            {
+                Node *sibling = _NewNode(false);
+                size_t mid = parent->keys.size() / 2;
+                K up = parent->keys[mid];
+                sibling->keys.assign(parent->keys.begin() + mid + 1, parent->keys.end());
+                sibling->children.assign(parent->children.begin() + mid + 1, parent->children.end());
+                parent->keys.resize(mid);
+                parent->children.resize(mid + 1);
+                _InsertInParent(path, parent, up, sibling);
+            }
+        }
+
+        // write back and drop the least recently used leaves
+        // keep is a leaf in use by the caller
+        void _Evict(uint64_t keep)
+        {
+            if (!file_)
+                return;
+            while (lru_.size() > max_cached_leaves_)
+            {
+                uint64_t id = lru_.back();
+                if (id == keep)
+                    break;
+                auto it = nodes_.find(id);
+                if (it->second->dirty && (!_MarkUnclean() || !_WriteNode(*it->second)))
+                    break;
+                lru_.pop_back();
+                nodes_.erase(it);
+            }
+        }
+
+        Node *_ReadNode(uint64_t id)
+        {
+            char page[BTREE_PAGE_SIZE];
+            if (!file_ || file_->ReadAt(id * BTREE_PAGE_SIZE, page, BTREE_PAGE_SIZE) != (int64_t)BTREE_PAGE_SIZE)
+                throw std::runtime_error("btree: cannot read page " + std::to_string(id) + " of " + (file_ ? file_->GetPath() : ""));
+
+            Node *node = new Node();
+            node->id = id;
+            node->dirty = false;
+            node->leaf = page[0] != 0;
+            uint16_t count;
+            memcpy(&count, page + 2, sizeof(count));
+            memcpy(&node->next, page + 8, sizeof(node->next));
+
+            const char *keys = page + NODE_HEADER_SIZE;
+            node->keys.resize(count);
+            for (size_t i = 0; i < count; i++)
+                PageCodec<K>::Read(keys + i * KEY_SIZE, node->keys[i]);
+            if (node->leaf)
+            {
+                const char *values = keys + LEAF_CAPACITY * KEY_SIZE;
+                node->values.resize(count);
+                for (size_t i = 0; i < count; i++)
+                    PageCodec<V>::Read(values + i * VALUE_SIZE, node->values[i]);
+                lru_.push_front(id);
+                node->lru_it = lru_.begin();
+            }
+            else
+            {
+                const char *children = keys + INNER_CAPACITY * KEY_SIZE;
+                node->children.resize(count + 1);
+                memcpy(node->children.data(), children, (count + 1) * sizeof(uint64_t));
+            }
+            nodes_[id].reset(node);
+            return node;
+        }
+
+        bool _WriteNode(Node &node)
+        {
+            char page[BTREE_PAGE_SIZE] = {};
+            page[0] = node.leaf ? 1 : 0;
+            uint16_t count = node.keys.size();
+            memcpy(page + 2, &count, sizeof(count));
+            memcpy(page + 8, &node.next, sizeof(node.next));
+
+            char *keys = page + NODE_HEADER_SIZE;
+            for (size_t i = 0; i < count; i++)
+                PageCodec<K>::Write(keys + i * KEY_SIZE, node.keys[i]);
+            if (node.leaf)
+            {
+                char *values = keys + LEAF_CAPACITY * KEY_SIZE;
+                for (size_t i = 0; i < count; i++)
+                    PageCodec<V>::Write(values + i * VALUE_SIZE, node.values[i]);
+            }
+            else
+            {
+                char *children = keys + INNER_CAPACITY * KEY_SIZE;
+                memcpy(children, node.children.data(), node.children.size() * sizeof(uint64_t));
+            }
+            if (!file_->WriteAt(node.id * BTREE_PAGE_SIZE, page, BTREE_PAGE_SIZE))
+                return false;
+            node.dirty = false;
+            return true;
+        }
+
+        // flag the header on disk unclean before a page is written over
+        bool _MarkUnclean()
+        {
+            if (unclean_)
+                return true;
+            header_dirty_ = true;
+            if (!_WriteHeader(STATE_UNCLEAN) || !file_->Sync())
+                return false;
+            // the counters are written again by the next flush
+            header_dirty_ = true;
+            unclean_ = true;
+            return true;
+        }
+
+        bool _WriteHeader(uint32_t state)
+        {
+            if (!header_dirty_)
+                return true;
+            char page[BTREE_PAGE_SIZE] = {};
+            Header header = {};
+            memcpy(header.magic, MAGIC, sizeof(MAGIC));
+            header.page_size = BTREE_PAGE_SIZE;
+            header.key_size = KEY_SIZE;
+            header.value_size = VALUE_SIZE;
+            header.root = root_;
+            header.page_count = page_count_;
+            header.entry_count = entry_count_;
+            header.state = state;
+            memcpy(page, &header, sizeof(header));
+            if (!file_->WriteAt(0, page, BTREE_PAGE_SIZE))
+                return false;
+            header_dirty_ = false;
+            return true;
+        }
     };
 }
 
-#endif
\ No newline at end of file
+#endif
@@ -0,0 +1,281 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "ruru.h"
+#include "record.h"
+#include "internal/buffer_pool.h"
+#include "internal/basic_store_cache.h"
+
+namespace ruru::internal
+{
+    FrequencySketch::FrequencySketch(size_t width)
+        : additions_(0)
+    {
+        size_t size = 1;
+        while (size < width)
+            size <<= 1;
+        counters_.assign(size * ROWS, 0);
+        mask_ = size - 1;
+        sample_size_ = size * 10;
+    }
+
+    size_t FrequencySketch::_Index(uint64_t hash, size_t row) const
+    {
+        // one multiplier per row spreads the same hash over different counters
+        static const uint64_t seeds[ROWS] = {0xc3a5c85c97cb3127ULL, 0xb492b66fbe98f273ULL,
+                                             0x9ae16a3b2f90404fULL, 0xcbf29ce484222325ULL};
+        uint64_t h = (hash + seeds[row]) * seeds[row];
+        return row * (mask_ + 1) + ((h >> 32) & mask_);
+    }
+
+    void FrequencySketch::Increment(uint64_t hash)
+    {
+        for (size_t row = 0; row < ROWS; row++)
+        {
+            uint8_t &counter = counters_[_Index(hash, row)];
+            if (counter < 15)
+                counter++;
+        }
+        // age the counts
+        if (++additions_ >= sample_size_)
+        {
+            for (auto &&counter : counters_)
+                counter >>= 1;
+            additions_ /= 2;
+        }
+    }
+
+    uint8_t FrequencySketch::Estimate(uint64_t hash) const
+    {
+        uint8_t estimate = 15;
+        for (size_t row = 0; row < ROWS; row++)
+            estimate = std::min(estimate, counters_[_Index(hash, row)]);
+        return estimate;
+    }
+
+    BufferPool::PageRef &BufferPool::PageRef::operator=(PageRef &&other) noexcept
+    {
+        if (this != &other)
+        {
+            Release();
+            pool_ = other.pool_;
+            frame_ = other.frame_;
+            other.frame_ = nullptr;
+        }
+        return *this;
+    }
+
+    void BufferPool::PageRef::Release()
+    {
+        if (frame_ != nullptr)
+            pool_->_Unpin(frame_);
+        frame_ = nullptr;
+    }
+
+    BufferPool::BufferPool(uint64_t budget)
+        : budget_(budget), usage_(0), hand_(0)
+    {
+    }
+
+    void BufferPool::SetBudget(uint64_t budget)
+    {
+        std::lock_guard<std::mutex> lock(latch_);
+        budget_ = budget;
+        _Evict(0);
+    }
+
+    uint64_t BufferPool::GetBudget() const
+    {
+        std::lock_guard<std::mutex> lock(latch_);
+        return budget_;
+    }
+
+    uint64_t BufferPool::GetUsage() const
+    {
+        std::lock_guard<std::mutex> lock(latch_);
+        return usage_;
+    }
+
+    uint64_t BufferPool::_Hash(const void *owner, uint64_t page)
+    {
+        return KeyHash()({owner, page});
+    }
+
+    BufferPool::PageRef BufferPool::Pin(const void *owner, uint64_t page, const Loader_t &loader, Access access)
+    {
+        PageRef ref = Find(owner, page, access);
+        if (ref)
+            return ref;
+        return _Load(owner, page, loader, access);
+    }
+
+    BufferPool::PageRef BufferPool::TryPin(const void *owner, uint64_t page, const Loader_t &loader)
+    {
+        PageRef ref = Find(owner, page);
+        if (ref)
+            return ref;
+        {
+            // the page would only be lent: not worth reading it whole
+            std::lock_guard<std::mutex> lock(latch_);
+            if (usage_ >= budget_)
+            {
+                Frame *victim = _Victim();
+                if (victim == nullptr ||
+                    sketch_.Estimate(_Hash(victim->owner, victim->page)) >= sketch_.Estimate(_Hash(owner, page)))
+                    return PageRef();
+            }
+        }
+        return _Load(owner, page, loader, Access::ePoint);
+    }
+
+    BufferPool::PageRef BufferPool::_Load(const void *owner, uint64_t page, const Loader_t &loader, Access access)
+    {
+        // the page is read without the latch, another reader may load it meanwhile
+        std::unique_ptr<ISegment> content = loader();
+        if (content == nullptr)
+            return PageRef();
+        uint64_t size = content->GetMemorySize();
+
+        std::lock_guard<std::mutex> lock(latch_);
+        auto it = frames_.find({owner, page});
+        if (it != frames_.end())
+        {
+            it->second->pins++;
+            return PageRef(this, it->second);
+        }
+
+        if (!_Admit(_Hash(owner, page), size, access))
+        {
+            // the page is only lent to the caller
+            usage_ += size;
+            return PageRef(this, new Frame{owner, page, std::move(content), size, 1, false, true, 0});
+        }
+        // a page read by a scan waits for a point access to be recently used
+        Frame *frame = new Frame{owner, page, std::move(content), size, 1, access == Access::ePoint, false, clock_.size()};
+        frames_[{owner, page}] = frame;
+        clock_.push_back(frame);
+        usage_ += size;
+        return PageRef(this, frame);
+    }
+
+    BufferPool::PageRef BufferPool::Find(const void *owner, uint64_t page, Access access)
+    {
+        std::lock_guard<std::mutex> lock(latch_);
+        // the scans are not counted: they would make their pages look hot
+        if (access == Access::ePoint)
+            sketch_.Increment(_Hash(owner, page));
+        auto it = frames_.find({owner, page});
+        if (it == frames_.end())
+            return PageRef();
+        it->second->pins++;
+        if (access == Access::ePoint)
+            it->second->referenced = true;
+        return PageRef(this, it->second);
+    }
+
+    void BufferPool::Drop(const void *owner, uint64_t page)
+    {
+        std::lock_guard<std::mutex> lock(latch_);
+        auto it = frames_.find({owner, page});
+        if (it != frames_.end())
+            _Remove(it->second);
+    }
+
+    void BufferPool::DropAll(const void *owner)
+    {
+        std::lock_guard<std::mutex> lock(latch_);
+        std::vector<Frame *> dropped;
+        for (auto &&it : frames_)
+        {
+            if (it.first.owner == owner)
+                dropped.push_back(it.second);
+        }
+        for (auto &&frame : dropped)
+            _Remove(frame);
+    }
+
+    BufferPool::Frame *BufferPool::_Victim()
+    {
+        // two turns of the hand: the first one may only clear reference bits
+        size_t steps = clock_.size() * 2;
+        while (!clock_.empty() && steps-- > 0)
+        {
+            if (hand_ >= clock_.size())
+                hand_ = 0;
+            Frame *frame = clock_[hand_];
+            if (frame->pins == 0 && !frame->referenced)
+                return frame;
+            frame->referenced = false;
+            hand_++;
+        }
+        return nullptr;
+    }
+
+    void BufferPool::_Evict(uint64_t size)
+    {
+        while (usage_ + size > budget_)
+        {
+            Frame *victim = _Victim();
+            if (victim == nullptr)
+                break;
+            // the last frame takes the slot, the hand stays on it
+            _Remove(victim);
+        }
+    }
+
+    bool BufferPool::_Admit(uint64_t hash, uint64_t size, Access access)
+    {
+        if (usage_ + size <= budget_)
+            return true;
+        // a scan never evicts
+        if (access == Access::eScan)
+            return false;
+
+        uint8_t frequency = sketch_.Estimate(hash);
+        while (usage_ + size > budget_)
+        {
+            Frame *victim = _Victim();
+            if (victim == nullptr || sketch_.Estimate(_Hash(victim->owner, victim->page)) >= frequency)
+                return false;
+            _Remove(victim);
+        }
+        return true;
+    }
+
+    void BufferPool::_Remove(Frame *frame)
+    {
+        frames_.erase({frame->owner, frame->page});
+        Frame *last = clock_.back();
+        clock_[frame->slot] = last;
+        last->slot = frame->slot;
+        clock_.pop_back();
+
+        if (frame->pins > 0)
+        {
+            frame->dropped = true;
+            return;
+        }
+        usage_ -= frame->size;
+        delete frame;
+    }
+
+    void BufferPool::_Unpin(Frame *frame)
+    {
+        std::lock_guard<std::mutex> lock(latch_);
+        if (--frame->pins == 0 && frame->dropped)
+        {
+            usage_ -= frame->size;
+            delete frame;
+        }
+    }
+
+    BufferPool::~BufferPool()
+    {
+        // the caches release their frames before the pool
+        for (auto &&frame : clock_)
+            delete frame;
+    }
+}
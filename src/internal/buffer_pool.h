@@ -0,0 +1,195 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef _H_RURU_BUFFER_POOL_HH_
+#define _H_RURU_BUFFER_POOL_HH_
+
+#include <functional>
+#include <mutex>
+
+namespace ruru::internal
+{
+    class ISegment;
+
+    /*
+        \class FrequencySketch
+        \brief approximate count of the recent accesses to a key (count-min sketch)
+               4 rows of 4 bit counters; every counter is halved after a number of
+               accesses proportional to the width, so that old accesses fade out.
+    */
+    class FrequencySketch
+    {
+    public:
+        FrequencySketch(size_t width = 4096);
+
+        void Increment(uint64_t hash);
+
+        // estimated accesses, 0 to 15
+        uint8_t Estimate(uint64_t hash) const;
+
+    private:
+        static constexpr size_t ROWS = 4;
+        std::vector<uint8_t> counters_;
+        size_t mask_;
+        uint64_t additions_;
+        uint64_t sample_size_;
+
+        size_t _Index(uint64_t hash, size_t row) const;
+    };
+
+    /*
+        \class BufferPool
+        \brief memory budget shared by the table caches of a database
+               a frame holds the records of one page of a data file, it is pinned
+               while it is read. When a new frame doesn't fit in the budget the
+               unpinned frames are evicted with the CLOCK policy: the hand clears
+               the reference bit of the frames used since its last pass and evicts
+               the first one found without it.
+               The admission is scan resistant (TinyLFU): a page read by a point access
+               replaces the frame the hand would evict only when the page was used more
+               often lately; otherwise it is read for the caller and dropped when unpinned.
+               A page read by a scan is kept only when it fits without evicting anything,
+               and a scan doesn't make the frames it visits recently used.
+               The pool goes over its budget when every frame is pinned.
+    */
+    class BufferPool
+    {
+        struct Frame
+        {
+            const void *owner;
+            uint64_t page;
+            std::unique_ptr<ISegment> content;
+            // bytes counted in the budget
+            uint64_t size;
+            uint32_t pins;
+            // used since the last pass of the hand
+            bool referenced;
+            // dropped while pinned, freed by the last unpin
+            bool dropped;
+            // index in the clock
+            size_t slot;
+        };
+
+        // hash of the page in the frequency sketch
+        static uint64_t _Hash(const void *owner, uint64_t page);
+
+        struct Key
+        {
+            const void *owner;
+            uint64_t page;
+            bool operator==(const Key &other) const { return owner == other.owner && page == other.page; }
+        };
+
+        struct KeyHash
+        {
+            size_t operator()(const Key &key) const
+            {
+                return std::hash<const void *>()(key.owner) ^ (std::hash<uint64_t>()(key.page) * 0x9e3779b97f4a7c15ULL);
+            }
+        };
+
+    public:
+        // budget of a database until setCacheBudget is called
+        static constexpr uint64_t DEFAULT_BUDGET = 64 * 1024 * 1024;
+
+        // how a page is used
+        enum class Access : uint8_t
+        {
+            // a record read by id, the page may be used again
+            ePoint,
+            // a page read in a sequential scan
+            eScan
+        };
+
+        // a pinned frame, unpinned when the reference is released
+        class PageRef
+        {
+            BufferPool *pool_;
+            Frame *frame_;
+            friend class BufferPool;
+            PageRef(BufferPool *pool, Frame *frame) : pool_(pool), frame_(frame) {}
+
+        public:
+            PageRef() : pool_(nullptr), frame_(nullptr) {}
+            PageRef(PageRef &&other) noexcept : pool_(other.pool_), frame_(other.frame_) { other.frame_ = nullptr; }
+            PageRef &operator=(PageRef &&other) noexcept;
+            PageRef(const PageRef &) = delete;
+            PageRef &operator=(const PageRef &) = delete;
+            ~PageRef() { Release(); }
+
+            explicit operator bool() const { return frame_ != nullptr; }
+            ISegment *Get() const { return frame_ != nullptr ? frame_->content.get() : nullptr; }
+            ISegment *operator->() const { return Get(); }
+
+            // unpin the frame
+            void Release();
+        };
+
+        // reads the content of a frame, nullptr when the page can't be read
+        using Loader_t = std::function<std::unique_ptr<ISegment>()>;
+
+        BufferPool(uint64_t budget = DEFAULT_BUDGET);
+        BufferPool(const BufferPool &) = delete;
+        BufferPool &operator=(const BufferPool &) = delete;
+
+        // change the budget, the frames over it are evicted
+        void SetBudget(uint64_t budget);
+        uint64_t GetBudget() const;
+
+        // bytes held by the frames
+        uint64_t GetUsage() const;
+
+        // pin the frame of a page of owner, the page is read with loader when it is missing
+        // the page read is kept in the pool when it is admitted
+        PageRef Pin(const void *owner, uint64_t page, const Loader_t &loader, Access access = Access::ePoint);
+
+        // pin the frame of a page read by a point access, the page is read only when it would be admitted
+        // returns an empty reference otherwise: the caller reads what it needs from the file
+        PageRef TryPin(const void *owner, uint64_t page, const Loader_t &loader);
+
+        // pin the frame of a page when it is in the pool
+        PageRef Find(const void *owner, uint64_t page, Access access = Access::ePoint);
+
+        // drop the frame of a page, the readers holding it keep it until they unpin it
+        void Drop(const void *owner, uint64_t page);
+
+        // drop every frame of owner
+        void DropAll(const void *owner);
+
+        ~BufferPool();
+
+    private:
+        mutable std::mutex latch_;
+        uint64_t budget_;
+        uint64_t usage_;
+        std::unordered_map<Key, Frame *, KeyHash> frames_;
+        // frames in the order the hand visits them
+        std::vector<Frame *> clock_;
+        size_t hand_;
+        // recent point accesses to the pages, resident or not
+        FrequencySketch sketch_;
+
+        // the frame the hand stops on: unpinned and not used since the last pass
+        // nullptr when every frame is pinned, latch held
+        Frame *_Victim();
+
+        // read a missing page with loader and admit it
+        PageRef _Load(const void *owner, uint64_t page, const Loader_t &loader, Access access);
+
+        // evict unpinned frames until size more bytes fit in the budget, latch held
+        void _Evict(uint64_t size);
+
+        // make room for a page read by access, evicting frames used less often than it
+        // returns false when the page is not admitted, latch held
+        bool _Admit(uint64_t hash, uint64_t size, Access access);
+
+        // take a frame out of the pool, freed now or by its last unpin, latch held
+        void _Remove(Frame *frame);
+
+        void _Unpin(Frame *frame);
+    };
+}
+
+#endif //_H_RURU_BUFFER_POOL_HH_
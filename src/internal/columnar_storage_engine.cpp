@@ -0,0 +1,622 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "ruru.h"
+#include "record.h"
+#include "internal/columnar_storage_engine.h"
+#include "internal/record_scanner.h"
+#include "internal/RecordStream.h"
+#include "internal/simd_filter.h"
+#include "utils/memory_stream.h"
+
+using namespace ruru;
+using namespace ruru::internal;
+
+namespace
+{
+    const char COLUMNS_FILE_MAGIC[8] = {'R', 'U', 'R', 'U', 'C', 'O', 'L', '1'};
+
+    size_t BitmapWords(size_t rows)
+    {
+        return (rows + 63) / 64;
+    }
+
+    void SetBit(std::vector<uint64_t> &bitmap, uint64_t i, bool value)
+    {
+        if (value)
+            bitmap[i / 64] |= (uint64_t)1 << (i % 64);
+        else
+            bitmap[i / 64] &= ~((uint64_t)1 << (i % 64));
+    }
+
+    // make room for rows values, new slots are null
+    void EnsureRows(ColumnChunk &chunk, size_t rows)
+    {
+        if (chunk.nulls.size() < BitmapWords(rows))
+            chunk.nulls.resize(BitmapWords(rows), ~(uint64_t)0);
+        switch (chunk.type)
+        {
+        case DataTypes::eInteger:
+            if (chunk.integers.size() < rows)
+                chunk.integers.resize(rows);
+            break;
+        case DataTypes::eDouble:
+            if (chunk.doubles.size() < rows)
+                chunk.doubles.resize(rows);
+            break;
+        case DataTypes::eVarChar:
+            if (chunk.offsets.size() < rows)
+            {
+                chunk.offsets.resize(rows);
+                chunk.lengths.resize(rows);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    template <typename T>
+    bool ValuesOf(const Filter &filter, std::vector<T> &values)
+    {
+        for (auto &&v : filter.values)
+        {
+            if (!std::holds_alternative<T>(v))
+                return false;
+            values.push_back(std::get<T>(v));
+        }
+        return true;
+    }
+
+    template <typename T>
+    bool BoundsOf(const Filter &filter, T &value1, T &value2)
+    {
+        if (!std::holds_alternative<T>(filter.value1))
+            return false;
+        value1 = std::get<T>(filter.value1);
+        if (filter.oper == OperatorType::eInRange || filter.oper == OperatorType::eOutRange)
+        {
+            if (!std::holds_alternative<T>(filter.value2))
+                return false;
+            value2 = std::get<T>(filter.value2);
+        }
+        else
+            value2 = value1;
+        return true;
+    }
+
+    // varchar columns are compared one value at a time
+    bool FilterStrings(const ColumnChunk &chunk, size_t rows, const Filter &filter, uint64_t *selection)
+    {
+        std::string value1, value2;
+        std::vector<std::string> values;
+        if (filter.oper == OperatorType::eIn)
+        {
+            if (!ValuesOf(filter, values))
+                return false;
+            std::sort(values.begin(), values.end());
+        }
+        else if (!IsKernelOperator(filter.oper) || !BoundsOf(filter, value1, value2))
+            return false;
+
+        std::string_view v1(value1), v2(value2);
+        for (size_t w = 0; w < BitmapWords(rows); w++)
+        {
+            if (selection[w] == 0)
+                continue;
+            size_t base = w * 64;
+            size_t n = std::min<size_t>(64, rows - base);
+            uint64_t bits = 0;
+            for (size_t i = 0; i < n; i++)
+            {
+                std::string_view x(chunk.strings.data() + chunk.offsets[base + i], chunk.lengths[base + i]);
+                bool ok = false;
+                switch (filter.oper)
+                {
+                case OperatorType::eEqual:
+                    ok = x == v1;
+                    break;
+                case OperatorType::eGreater:
+                    ok = x > v1;
+                    break;
+                case OperatorType::eGreaterOrEq:
+                    ok = x >= v1;
+                    break;
+                case OperatorType::eLesser:
+                    ok = x < v1;
+                    break;
+                case OperatorType::eLesserOrEq:
+                    ok = x <= v1;
+                    break;
+                case OperatorType::eInRange:
+                    ok = x >= v1 && x <= v2;
+                    break;
+                case OperatorType::eOutRange:
+                    ok = x < v1 || x > v2;
+                    break;
+                case OperatorType::eIn:
+                    ok = std::binary_search(values.begin(), values.end(), x, std::less<>());
+                    break;
+                default:
+                    break;
+                }
+                bits |= (uint64_t)ok << i;
+            }
+            selection[w] &= bits;
+        }
+        return true;
+    }
+}
+
+IStorageEngine *ColumnarStorageEngineFactory::createStorageEngine(const std::string &file_name)
+{
+    return new ColumnarStorageEngine(file_name);
+}
+
+std::string ColumnarStorageEngineFactory::getName()
+{
+    return _columnar_factory;
+}
+
+//========================================================================================================
+//                                      ColumnarStorageEngine
+//========================================================================================================
+
+// Constructor
+ColumnarStorageEngine::ColumnarStorageEngine(const std::string &file_name)
+    : BasicStorageEngine(file_name),
+      columns_file_(file_name + ".col"),
+      columns_file_valid_(false)
+{
+    if (!_LoadColumns())
+        _BuildColumns();
+}
+
+void ColumnarStorageEngine::Insert(const Record &record)
+{
+    _Invalidate();
+    BasicStorageEngine::Insert(record);
+    _StoreColumns(record);
+}
+
+bool ColumnarStorageEngine::SaveBatch(const RecordBatch_t &records, uint64_t commit_ts, uint64_t oldest_snapshot)
+{
+    _Invalidate();
+    if (!BasicStorageEngine::SaveBatch(records, commit_ts, oldest_snapshot))
+        return false;
+    for (auto &&it : records)
+        _StoreColumns(*it.first);
+    return true;
+}
+
+std::vector<RecordId> ColumnarStorageEngine::Lookup(const Filters_t &filters)
+{
+    std::vector<RecordId> rowsid;
+    // filters the columns can't answer run on the row file
+    if (!_SelectRows(filters, rowsid))
+        return BasicStorageEngine::Lookup(filters);
+    return rowsid;
+}
+
+RecordCursorPtr ColumnarStorageEngine::OpenCursor(const Filters_t &filters, uint64_t snapshot)
+{
+    std::vector<RecordId> rowsid;
+    // filters the columns can't answer run on the records as the cursor reads them
+    if (!_SelectRows(filters, rowsid))
+        return BasicStorageEngine::OpenCursor(filters, snapshot);
+    return _OpenCursor(std::move(rowsid), {}, snapshot);
+}
+
+bool ColumnarStorageEngine::_SelectRows(const Filters_t &filters, std::vector<RecordId> &rowsid) const
+{
+    size_t rows = row_ids_.size();
+    std::vector<uint64_t> selection(BitmapWords(rows), ~(uint64_t)0);
+    if (rows % 64 != 0)
+        selection.back() = ((uint64_t)1 << (rows % 64)) - 1;
+
+    for (auto &&filter : filters)
+    {
+        if (!_FilterColumn(*filter, selection))
+            return false;
+    }
+
+    for (size_t w = 0; w < selection.size(); w++)
+    {
+        uint64_t bits = selection[w];
+        while (bits != 0)
+        {
+            rowsid.push_back(row_ids_[w * 64 + __builtin_ctzll(bits)]);
+            bits &= bits - 1;
+        }
+    }
+
+    // slots follow the insertion order, keep the result in row id order
+    if (!std::is_sorted(rowsid.begin(), rowsid.end()))
+        std::sort(rowsid.begin(), rowsid.end());
+    return true;
+}
+
+void ColumnarStorageEngine::SetColumnType(uint16_t column_indx, DataTypes type)
+{
+    if (column_indx >= column_types_.size())
+        column_types_.resize(column_indx + 1, DataTypes::eUnknown);
+    column_types_[column_indx] = type;
+    if (column_indx < columns_.size() && columns_[column_indx].type != DataTypes::eUnknown &&
+        columns_[column_indx].type != type)
+    {
+        // the column was typed by its first value, store the values again under the declared type
+        _Invalidate();
+        _BuildColumns();
+        return;
+    }
+    _TypeColumns();
+}
+
+void ColumnarStorageEngine::_TypeColumns()
+{
+    if (columns_.size() < column_types_.size())
+        columns_.resize(column_types_.size());
+    for (size_t c = 0; c < column_types_.size(); c++)
+    {
+        if (columns_[c].type == DataTypes::eUnknown && column_types_[c] != DataTypes::eUnknown)
+        {
+            columns_[c].type = column_types_[c];
+            EnsureRows(columns_[c], row_ids_.size());
+        }
+    }
+}
+
+bool ColumnarStorageEngine::Flush()
+{
+    bool result = BasicStorageEngine::Flush();
+    if (!columns_file_valid_)
+        result = _SaveColumns() && result;
+    return result;
+}
+
+bool ColumnarStorageEngine::DropStorage()
+{
+    std::error_code ec;
+    std::filesystem::remove(columns_file_, ec);
+    columns_file_valid_ = false;
+    row_ids_.clear();
+    slots_.clear();
+    columns_.clear();
+    return BasicStorageEngine::DropStorage();
+}
+
+void ColumnarStorageEngine::_StoreColumns(const Record &record)
+{
+    uint64_t slot;
+    auto it = slots_.find(record.row_id_);
+    if (it == slots_.end())
+    {
+        slot = row_ids_.size();
+        row_ids_.push_back(record.row_id_);
+        slots_[record.row_id_] = slot;
+    }
+    else
+        slot = it->second;
+
+    if (record.fields_.size() > columns_.size())
+        columns_.resize(record.fields_.size());
+
+    // a record shorter than the table has nulls in the last columns
+    Field null_field;
+    for (size_t c = 0; c < columns_.size(); c++)
+        _SetValue(columns_[c], slot, c < record.fields_.size() ? record.fields_[c] : null_field);
+}
+
+void ColumnarStorageEngine::_SetValue(ColumnChunk &chunk, uint64_t slot, const Field &field)
+{
+    EnsureRows(chunk, row_ids_.size());
+    if (field.type_ == DataTypes::eNull || field.IsNull())
+    {
+        SetBit(chunk.nulls, slot, true);
+        return;
+    }
+
+    if (chunk.type == DataTypes::eUnknown)
+    {
+        chunk.type = field.type_;
+        EnsureRows(chunk, row_ids_.size());
+    }
+    if (field.type_ != chunk.type)
+    {
+        // the value can't be stored in the typed column
+        chunk.mixed = true;
+        SetBit(chunk.nulls, slot, true);
+        return;
+    }
+
+    bool was_null = (chunk.nulls[slot / 64] >> (slot % 64)) & 1;
+    SetBit(chunk.nulls, slot, false);
+    const char *data = field.Data();
+    switch (chunk.type)
+    {
+    case DataTypes::eInteger:
+        memcpy(&chunk.integers[slot], data, sizeof(int64_t));
+        break;
+    case DataTypes::eDouble:
+        memcpy(&chunk.doubles[slot], data, sizeof(double));
+        break;
+    case DataTypes::eVarChar:
+    {
+        uint64_t len;
+        memcpy(&len, data, sizeof(len));
+        // a value that fits in the bytes of the previous one is written over it
+        if (was_null || len > chunk.lengths[slot])
+        {
+            chunk.offsets[slot] = chunk.strings.size();
+            chunk.strings.append(data + sizeof(len), len);
+        }
+        else
+            memcpy(&chunk.strings[chunk.offsets[slot]], data + sizeof(len), len);
+        chunk.lengths[slot] = len;
+    }
+    break;
+    default:
+        chunk.mixed = true;
+        SetBit(chunk.nulls, slot, true);
+        break;
+    }
+}
+
+bool ColumnarStorageEngine::_FilterColumn(const Filter &filter, std::vector<uint64_t> &selection) const
+{
+    size_t rows = row_ids_.size();
+    size_t words = selection.size();
+
+    // a column without any stored value only has nulls
+    if (filter.column_indx >= columns_.size() || columns_[filter.column_indx].type == DataTypes::eUnknown)
+    {
+        if (!filter.ApplyNull())
+            std::fill(selection.begin(), selection.end(), 0);
+        return true;
+    }
+
+    const ColumnChunk &chunk = columns_[filter.column_indx];
+    // the values of another type are marked in nulls too
+    if (chunk.mixed)
+        return false;
+    if (filter.oper == OperatorType::eIsNull)
+    {
+        for (size_t w = 0; w < words; w++)
+            selection[w] &= chunk.nulls[w];
+        return true;
+    }
+    if (filter.oper == OperatorType::eIsNotNull)
+    {
+        for (size_t w = 0; w < words; w++)
+            selection[w] &= ~chunk.nulls[w];
+        return true;
+    }
+
+    switch (chunk.type)
+    {
+    case DataTypes::eInteger:
+    {
+        int64_t value1, value2;
+        std::vector<int64_t> values;
+        if (filter.oper == OperatorType::eIn && ValuesOf(filter, values))
+            FilterInInt64(chunk.integers.data(), rows, values, selection.data());
+        else if (IsKernelOperator(filter.oper) && BoundsOf(filter, value1, value2))
+            FilterInt64(chunk.integers.data(), rows, filter.oper, value1, value2, selection.data());
+        else
+            return false;
+    }
+    break;
+    case DataTypes::eDouble:
+    {
+        double value1, value2;
+        std::vector<double> values;
+        if (filter.oper == OperatorType::eIn && ValuesOf(filter, values))
+            FilterInDouble(chunk.doubles.data(), rows, values, selection.data());
+        else if (IsKernelOperator(filter.oper) && BoundsOf(filter, value1, value2))
+            FilterDouble(chunk.doubles.data(), rows, filter.oper, value1, value2, selection.data());
+        else
+            return false;
+    }
+    break;
+    case DataTypes::eVarChar:
+        if (!FilterStrings(chunk, rows, filter, selection.data()))
+            return false;
+        break;
+    default:
+        return false;
+    }
+
+    // null values satisfy no comparison
+    for (size_t w = 0; w < words; w++)
+        selection[w] &= ~chunk.nulls[w];
+    return true;
+}
+
+void ColumnarStorageEngine::_Invalidate()
+{
+    if (!columns_file_valid_)
+        return;
+    // after a crash the columns are rebuilt from the data file
+    std::error_code ec;
+    std::filesystem::remove(columns_file_, ec);
+    columns_file_valid_ = false;
+}
+
+bool ColumnarStorageEngine::_SaveColumns()
+{
+    /*
+        columns file layout
+        magic | data file size | rows | columns | row ids
+        then for each column: type | mixed | null bitmap | values
+        varchar values are the lengths followed by the bytes of the non null values
+    */
+    uint64_t rows = row_ids_.size();
+    uint64_t ncols = columns_.size();
+    uint64_t data_size = data_file_.GetSize();
+
+    std::vector<char> buffer;
+    MemoryWriter out(buffer);
+    out.write(COLUMNS_FILE_MAGIC, sizeof(COLUMNS_FILE_MAGIC));
+    out.write(reinterpret_cast<const char *>(&data_size), sizeof(data_size));
+    out.write(reinterpret_cast<const char *>(&rows), sizeof(rows));
+    out.write(reinterpret_cast<const char *>(&ncols), sizeof(ncols));
+    out.write(reinterpret_cast<const char *>(row_ids_.data()), rows * sizeof(RecordId));
+
+    for (auto &&chunk : columns_)
+    {
+        EnsureRows(chunk, rows);
+        uint8_t type = (uint8_t)chunk.type;
+        uint8_t mixed = chunk.mixed;
+        out.write(reinterpret_cast<const char *>(&type), sizeof(type));
+        out.write(reinterpret_cast<const char *>(&mixed), sizeof(mixed));
+        out.write(reinterpret_cast<const char *>(chunk.nulls.data()), BitmapWords(rows) * sizeof(uint64_t));
+        switch (chunk.type)
+        {
+        case DataTypes::eInteger:
+            out.write(reinterpret_cast<const char *>(chunk.integers.data()), rows * sizeof(int64_t));
+            break;
+        case DataTypes::eDouble:
+            out.write(reinterpret_cast<const char *>(chunk.doubles.data()), rows * sizeof(double));
+            break;
+        case DataTypes::eVarChar:
+            out.write(reinterpret_cast<const char *>(chunk.lengths.data()), rows * sizeof(uint64_t));
+            for (uint64_t i = 0; i < rows; i++)
+            {
+                if (!((chunk.nulls[i / 64] >> (i % 64)) & 1))
+                    out.write(chunk.strings.data() + chunk.offsets[i], chunk.lengths[i]);
+            }
+            break;
+        default:
+            break;
+        }
+    }
+
+    // write a new file then replace the previous one
+    std::string tmp_file = columns_file_ + ".tmp";
+    {
+        std::ofstream file(tmp_file, std::ios::binary | std::ios::trunc);
+        if (!file.is_open())
+            return false;
+        file.write(buffer.data(), buffer.size());
+        if (!file.good())
+            return false;
+    }
+    std::error_code ec;
+    std::filesystem::rename(tmp_file, columns_file_, ec);
+    if (ec)
+        return false;
+    columns_file_valid_ = true;
+    return true;
+}
+
+bool ColumnarStorageEngine::_LoadColumns()
+{
+    std::error_code ec;
+    if (!std::filesystem::exists(columns_file_, ec))
+        return false;
+
+    std::vector<char> buffer(std::filesystem::file_size(columns_file_, ec));
+    if (ec)
+        return false;
+    {
+        std::ifstream file(columns_file_, std::ios::binary);
+        if (!file.is_open() || !file.read(buffer.data(), buffer.size()))
+            return false;
+    }
+
+    MemoryReader in(buffer.data(), buffer.size());
+    char magic[sizeof(COLUMNS_FILE_MAGIC)];
+    uint64_t data_size, rows, ncols;
+    in.read(magic, sizeof(magic));
+    in.read(reinterpret_cast<char *>(&data_size), sizeof(data_size));
+    in.read(reinterpret_cast<char *>(&rows), sizeof(rows));
+    in.read(reinterpret_cast<char *>(&ncols), sizeof(ncols));
+    if (in.fail() || memcmp(magic, COLUMNS_FILE_MAGIC, sizeof(magic)) != 0)
+        return false;
+
+    // the data file changed since the columns were written
+    if (data_size != (uint64_t)data_file_.GetSize() || rows != row_id_index_.GetSize())
+        return false;
+    // sizes are checked before allocating
+    if (rows > buffer.size() / sizeof(RecordId) || ncols > MAX_FIELDS_PER_RECORD)
+        return false;
+
+    std::vector<RecordId> row_ids(rows);
+    std::vector<ColumnChunk> columns(ncols);
+    in.read(reinterpret_cast<char *>(row_ids.data()), rows * sizeof(RecordId));
+    for (auto &&chunk : columns)
+    {
+        uint8_t type, mixed;
+        in.read(reinterpret_cast<char *>(&type), sizeof(type));
+        in.read(reinterpret_cast<char *>(&mixed), sizeof(mixed));
+        if (in.fail())
+            return false;
+        chunk.type = (DataTypes)type;
+        chunk.mixed = mixed != 0;
+        EnsureRows(chunk, rows);
+        in.read(reinterpret_cast<char *>(chunk.nulls.data()), BitmapWords(rows) * sizeof(uint64_t));
+        switch (chunk.type)
+        {
+        case DataTypes::eInteger:
+            in.read(reinterpret_cast<char *>(chunk.integers.data()), rows * sizeof(int64_t));
+            break;
+        case DataTypes::eDouble:
+            in.read(reinterpret_cast<char *>(chunk.doubles.data()), rows * sizeof(double));
+            break;
+        case DataTypes::eVarChar:
+        {
+            in.read(reinterpret_cast<char *>(chunk.lengths.data()), rows * sizeof(uint64_t));
+            uint64_t total = 0;
+            for (uint64_t i = 0; i < rows && !in.fail(); i++)
+            {
+                if (!((chunk.nulls[i / 64] >> (i % 64)) & 1))
+                {
+                    chunk.offsets[i] = total;
+                    total += chunk.lengths[i];
+                }
+            }
+            if (in.fail() || total > buffer.size())
+                return false;
+            chunk.strings.resize(total);
+            in.read(chunk.strings.data(), total);
+        }
+        break;
+        case DataTypes::eUnknown:
+            break;
+        default:
+            return false;
+        }
+        if (in.fail())
+            return false;
+    }
+
+    row_ids_ = std::move(row_ids);
+    columns_ = std::move(columns);
+    slots_.clear();
+    slots_.reserve(rows);
+    for (uint64_t i = 0; i < rows; i++)
+        slots_[row_ids_[i]] = i;
+    columns_file_valid_ = true;
+    return true;
+}
+
+void ColumnarStorageEngine::_BuildColumns()
+{
+    row_ids_.clear();
+    slots_.clear();
+    columns_.clear();
+    _TypeColumns();
+
+    RecordScanner scanner(data_file_);
+    Record rec;
+    RecordPosition_t position;
+    RecordLength_t length;
+    while (scanner.Next(rec, position, length))
+    {
+        if (_IsLiveVersion(rec.row_id_, position))
+            _StoreColumns(rec);
+    }
+}
@@ -0,0 +1,129 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef _H_COLUMNAR_STORAGE_ENGINE_HH_
+#define _H_COLUMNAR_STORAGE_ENGINE_HH_
+
+#include "basic_storage_engine.h"
+#include "ruru.h"
+
+namespace ruru
+{
+    namespace internal
+    {
+        class ColumnarStorageEngineFactory : public IStorageEngineFactory
+        {
+
+        public:
+            virtual IStorageEngine *createStorageEngine(const std::string &name) override;
+            virtual std::string getName() override;
+        };
+
+        /*
+            \struct ColumnChunk
+            \brief the values of one column for all the rows of a table
+                   values are contiguous and typed, slot i is the i-th row
+                   a set bit in nulls marks a null value
+        */
+        struct ColumnChunk
+        {
+            // type of the values: the declared type of the column
+            // or, for an undeclared column, the type of the first non null value
+            DataTypes type = DataTypes::eUnknown;
+            // values of another type were stored in the column, they are marked in nulls
+            // and every filter on the column is evaluated row by row
+            bool mixed = false;
+            std::vector<uint64_t> nulls;
+            std::vector<int64_t> integers;
+            std::vector<double> doubles;
+            // varchar: [offset, length] in strings
+            std::vector<uint64_t> offsets;
+            std::vector<uint64_t> lengths;
+            std::string strings;
+        };
+
+        /*
+            ColumnarStorageEngine : BasicStorageEngine keeping a columnar copy of the table
+            records are stored in the row file and the row indexes as usual, every column
+            is also kept as a ColumnChunk. Filters on integer and double columns are
+            evaluated with the vectorized kernels into a selection bitmap.
+            The columns are written to <table>.ru.col at Flush, and rebuilt from the
+            data file at open when that file is missing or stale.
+        */
+        class ColumnarStorageEngine : public BasicStorageEngine
+        {
+        public:
+            // Constructor
+            ColumnarStorageEngine(const std::string &file_name);
+
+            // Insert a record into the table
+            void Insert(const Record &record) override;
+
+            // save the records of a transaction, then copy them into the columns
+            bool SaveBatch(const RecordBatch_t &records, uint64_t commit_ts, uint64_t oldest_snapshot) override;
+
+            // Look up records by filter
+            std::vector<RecordId> Lookup(const Filters_t &filters) override;
+            using BasicStorageEngine::Lookup;
+
+            // cursor on the rows selected on the columns
+            RecordCursorPtr OpenCursor(const Filters_t &filters, uint64_t snapshot) override;
+
+            // values of another type make the column mixed
+            void SetColumnType(uint16_t column_indx, DataTypes type) override;
+
+            // Flush
+            bool Flush() override;
+
+            // Drop Storage
+            bool DropStorage() override;
+
+            ~ColumnarStorageEngine() = default;
+
+        private:
+            std::string columns_file_;
+            // row id of each slot
+            std::vector<RecordId> row_ids_;
+            // slot of each row id
+            std::unordered_map<RecordId, uint64_t> slots_;
+            std::vector<ColumnChunk> columns_;
+            // declared type of each column, eUnknown when not declared
+            std::vector<DataTypes> column_types_;
+            // the columns file matches the data file
+            bool columns_file_valid_;
+
+            // copy the fields of a record into its slot
+            void _StoreColumns(const Record &record);
+
+            // give the declared columns their type
+            void _TypeColumns();
+
+            // store one value
+            void _SetValue(ColumnChunk &chunk, uint64_t slot, const Field &field);
+
+            // clear the bits of the rows that don't satisfy the filter
+            // returns false when the filter can't be evaluated on the columns
+            bool _FilterColumn(const Filter &filter, std::vector<uint64_t> &selection) const;
+
+            // row ids of the rows satisfying all the filters, in row id order
+            // returns false when a filter can't be evaluated on the columns
+            bool _SelectRows(const Filters_t &filters, std::vector<RecordId> &rowsid) const;
+
+            // the columns are about to change, the columns file is no longer valid
+            void _Invalidate();
+
+            // write the columns file
+            bool _SaveColumns();
+
+            // read the columns file, false when it is missing or stale
+            bool _LoadColumns();
+
+            // read the data file to build the columns
+            void _BuildColumns();
+        };
+    }
+}
+
+#endif //_H_COLUMNAR_STORAGE_ENGINE_HH_
@@ -0,0 +1,155 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "ruru.h"
+#include "internal/file_handle.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <cerrno>
+
+namespace ruru::internal
+{
+    FileHandle::FileHandle(const std::string &path)
+        : path_(path), fd_(-1), end_(0)
+    {
+    }
+
+    bool FileHandle::Open(bool create)
+    {
+        if (fd_ != -1)
+            return true;
+
+        int flags = O_RDWR | O_CLOEXEC;
+        if (create)
+            flags |= O_CREAT;
+        fd_ = ::open(path_.c_str(), flags, 0644);
+        if (fd_ == -1)
+            return false;
+
+        struct stat st;
+        if (::fstat(fd_, &st) != 0)
+        {
+            Close();
+            return false;
+        }
+        end_ = st.st_size;
+        return true;
+    }
+
+    bool FileHandle::IsOpen() const
+    {
+        return fd_ != -1;
+    }
+
+    void FileHandle::Close()
+    {
+        if (fd_ != -1)
+            ::close(fd_);
+        fd_ = -1;
+        end_ = 0;
+    }
+
+    const std::string &FileHandle::GetPath() const
+    {
+        return path_;
+    }
+
+    int FileHandle::GetDescriptor() const
+    {
+        return fd_;
+    }
+
+    int64_t FileHandle::ReadAt(RecordPosition_t pos, char *buffer, size_t len) const
+    {
+        if (fd_ == -1)
+            return -1;
+
+        size_t done = 0;
+        while (done < len)
+        {
+            ssize_t r = ::pread(fd_, buffer + done, len - done, pos + done);
+            if (r < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return -1;
+            }
+            if (r == 0)
+                break; // end of file
+            done += r;
+        }
+        return done;
+    }
+
+    bool FileHandle::Prefetch(RecordPosition_t pos, size_t len) const
+    {
+        if (fd_ == -1)
+            return false;
+        return ::posix_fadvise(fd_, pos, len, POSIX_FADV_WILLNEED) == 0;
+    }
+
+    bool FileHandle::WriteAt(RecordPosition_t pos, const char *buffer, size_t len)
+    {
+        if (fd_ == -1)
+            return false;
+
+        size_t done = 0;
+        while (done < len)
+        {
+            ssize_t w = ::pwrite(fd_, buffer + done, len - done, pos + done);
+            if (w < 0)
+            {
+                if (errno == EINTR)
+                    continue;
+                return false;
+            }
+            done += w;
+        }
+        if (pos + (RecordPosition_t)len > end_)
+            end_ = pos + len;
+        return true;
+    }
+
+    RecordPosition_t FileHandle::Append(const char *buffer, size_t len)
+    {
+        if (!Open(true))
+            return -1;
+
+        RecordPosition_t pos = end_;
+        if (!WriteAt(pos, buffer, len))
+            return -1;
+        return pos;
+    }
+
+    RecordPosition_t FileHandle::GetSize() const
+    {
+        return end_;
+    }
+
+    bool FileHandle::Sync()
+    {
+        if (fd_ == -1)
+            return true;
+        return ::fsync(fd_) == 0;
+    }
+
+    bool FileHandle::Truncate(RecordPosition_t size)
+    {
+        if (fd_ == -1)
+            return false;
+        if (::ftruncate(fd_, size) != 0)
+            return false;
+        end_ = size;
+        return true;
+    }
+
+    FileHandle::~FileHandle()
+    {
+        Close();
+    }
+}
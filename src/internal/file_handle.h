@@ -0,0 +1,71 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef _H_RURU_FILE_HANDLE_HH_
+#define _H_RURU_FILE_HANDLE_HH_
+
+#include "ruru.h"
+
+namespace ruru::internal
+{
+    /*
+        \class FileHandle
+        \brief long-lived descriptor on a storage file
+               every read and write is positional (pread/pwrite), so the
+               handle never relies on a shared file offset and can be
+               kept open for the whole life of the storage engine
+    */
+    class FileHandle
+    {
+        std::string path_;
+        int fd_;
+        // logical end of file, where the next append lands
+        RecordPosition_t end_;
+
+    public:
+        FileHandle(const std::string &path);
+        FileHandle(const FileHandle &) = delete;
+        FileHandle &operator=(const FileHandle &) = delete;
+
+        // open the file, create it when asked to
+        // returns false when the file does not exist and create is false
+        bool Open(bool create);
+
+        bool IsOpen() const;
+
+        void Close();
+
+        const std::string &GetPath() const;
+
+        // descriptor of the open file, -1 when closed
+        int GetDescriptor() const;
+
+        // read up to len bytes at pos, returns the number of bytes read or -1
+        int64_t ReadAt(RecordPosition_t pos, char *buffer, size_t len) const;
+
+        // ask the system to read [pos, pos + len) into the page cache in the background
+        bool Prefetch(RecordPosition_t pos, size_t len) const;
+
+        // write len bytes at pos
+        bool WriteAt(RecordPosition_t pos, const char *buffer, size_t len);
+
+        // write len bytes at the end of file, returns the position or -1
+        // the file is created on the first append
+        RecordPosition_t Append(const char *buffer, size_t len);
+
+        // current size of the file
+        RecordPosition_t GetSize() const;
+
+        // flush the file content to the device
+        bool Sync();
+
+        // cut the file at size
+        bool Truncate(RecordPosition_t size);
+
+        ~FileHandle();
+    };
+}
+
+#endif //_H_RURU_FILE_HANDLE_HH_
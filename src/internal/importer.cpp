@@ -0,0 +1,641 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "ruru.h"
+#include "record.h"
+#include "internal/importer.h"
+
+#include <charconv>
+#include <deque>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace ruru::internal
+{
+    namespace
+    {
+        bool IsSpace(char c)
+        {
+            return c == ' ' || c == '\t' || c == '\r';
+        }
+
+        void SkipSpaces(std::string_view s, size_t &i)
+        {
+            while (i < s.size() && IsSpace(s[i]))
+                i++;
+        }
+
+        void AppendUtf8(std::string &out, uint32_t cp)
+        {
+            if (cp < 0x80)
+                out.push_back((char)cp);
+            else if (cp < 0x800)
+            {
+                out.push_back((char)(0xC0 | (cp >> 6)));
+                out.push_back((char)(0x80 | (cp & 0x3F)));
+            }
+            else if (cp < 0x10000)
+            {
+                out.push_back((char)(0xE0 | (cp >> 12)));
+                out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+                out.push_back((char)(0x80 | (cp & 0x3F)));
+            }
+            else
+            {
+                out.push_back((char)(0xF0 | (cp >> 18)));
+                out.push_back((char)(0x80 | ((cp >> 12) & 0x3F)));
+                out.push_back((char)(0x80 | ((cp >> 6) & 0x3F)));
+                out.push_back((char)(0x80 | (cp & 0x3F)));
+            }
+        }
+
+        bool ReadHex4(std::string_view s, size_t &i, uint32_t &value)
+        {
+            if (i + 4 > s.size())
+                return false;
+            auto res = std::from_chars(s.data() + i, s.data() + i + 4, value, 16);
+            if (res.ptr != s.data() + i + 4)
+                return false;
+            i += 4;
+            return true;
+        }
+
+        // JSON string starting at the quote at i, i moves past the closing quote
+        bool ReadJsonString(std::string_view s, size_t &i, std::string &out)
+        {
+            out.clear();
+            i++;
+            while (i < s.size())
+            {
+                // copy the run of plain characters at once
+                size_t run = i;
+                while (run < s.size() && s[run] != '"' && s[run] != '\\')
+                    run++;
+                out.append(s.data() + i, run - i);
+                i = run;
+                if (i >= s.size())
+                    return false;
+                if (s[i++] == '"')
+                    return true;
+                if (i >= s.size())
+                    return false;
+                char e = s[i++];
+                switch (e)
+                {
+                case '"':
+                case '\\':
+                case '/':
+                    out.push_back(e);
+                    break;
+                case 'b':
+                    out.push_back('\b');
+                    break;
+                case 'f':
+                    out.push_back('\f');
+                    break;
+                case 'n':
+                    out.push_back('\n');
+                    break;
+                case 'r':
+                    out.push_back('\r');
+                    break;
+                case 't':
+                    out.push_back('\t');
+                    break;
+                case 'u':
+                {
+                    uint32_t cp;
+                    if (!ReadHex4(s, i, cp))
+                        return false;
+                    // a surrogate pair encodes a code point over 0xFFFF
+                    uint32_t low;
+                    if (cp >= 0xD800 && cp < 0xDC00 && i + 1 < s.size() && s[i] == '\\' && s[i + 1] == 'u')
+                    {
+                        size_t j = i + 2;
+                        if (ReadHex4(s, j, low) && low >= 0xDC00 && low < 0xE000)
+                        {
+                            cp = 0x10000 + ((cp - 0xD800) << 10) + (low - 0xDC00);
+                            i = j;
+                        }
+                    }
+                    AppendUtf8(out, cp);
+                    break;
+                }
+                default:
+                    return false;
+                }
+            }
+            return false;
+        }
+
+        // JSON literal or number at i: the characters up to the next separator
+        std::string_view ReadJsonToken(std::string_view s, size_t &i)
+        {
+            size_t start = i;
+            while (i < s.size() && s[i] != ',' && s[i] != '}' && !IsSpace(s[i]))
+                i++;
+            return s.substr(start, i - start);
+        }
+    }
+
+    ImportParser::ImportParser(const std::vector<Column> &columns, const ImportOptions &options)
+        : options_(options)
+    {
+        for (auto &&col : columns)
+        {
+            names_.push_back(col.getName());
+            types_.push_back(col.getType());
+            Field field;
+            field.Reset();
+            field.type_ = col.getType();
+            prototype_.push_back(field);
+            // without a header the values follow the columns
+            mapping_.push_back(mapping_.size());
+        }
+    }
+
+    int ImportParser::_FindColumn(std::string_view name) const
+    {
+        for (size_t i = 0; i < names_.size(); i++)
+        {
+            if (names_[i] == name)
+                return i;
+        }
+        return -1;
+    }
+
+    bool ImportParser::ReadHeader(std::string_view line)
+    {
+        mapping_.clear();
+        bool found = false;
+        std::string scratch;
+        size_t pos = 0;
+        bool last = false;
+        while (!last)
+        {
+            std::string_view text;
+            bool quoted;
+            if (!_NextCsvField(line, pos, text, quoted, scratch, last))
+                return false;
+            int column = _FindColumn(text);
+            found = found || column != -1;
+            mapping_.push_back(column);
+        }
+        return found;
+    }
+
+    size_t ImportParser::FindRecordEnd(std::string_view data, bool first) const
+    {
+        if (options_.format == ImportOptions::Format::eJsonLines)
+        {
+            // a JSON record never holds a raw end of line
+            size_t end = first ? data.find('\n') : data.rfind('\n');
+            return end == std::string_view::npos ? 0 : end + 1;
+        }
+
+        // an end of line inside quotes belongs to the value
+        bool quoted = false;
+        size_t end = 0;
+        for (size_t i = 0; i < data.size(); i++)
+        {
+            char c = data[i];
+            if (c == '"')
+                quoted = !quoted;
+            else if (c == '\n' && !quoted)
+            {
+                end = i + 1;
+                if (first)
+                    break;
+            }
+        }
+        return end;
+    }
+
+    bool ImportParser::Parse(std::string_view chunk, std::vector<std::unique_ptr<Record>> &records, size_t &error_offset) const
+    {
+        std::string scratch;
+        size_t pos = 0;
+        while (pos < chunk.size())
+        {
+            // empty lines
+            if (chunk[pos] == '\n')
+            {
+                pos++;
+                continue;
+            }
+            if (chunk[pos] == '\r' && pos + 1 < chunk.size() && chunk[pos + 1] == '\n')
+            {
+                pos += 2;
+                continue;
+            }
+
+            size_t start = pos;
+            auto record = std::make_unique<Record>();
+            record->fields_ = prototype_;
+            bool ok = options_.format == ImportOptions::Format::eCsv ? _ParseCsv(chunk, pos, *record, scratch)
+                                                                      : _ParseJson(chunk, pos, *record, scratch);
+            if (!ok)
+            {
+                error_offset = start;
+                return false;
+            }
+            records.push_back(std::move(record));
+        }
+        return true;
+    }
+
+    bool ImportParser::_NextCsvField(std::string_view chunk, size_t &pos, std::string_view &text, bool &quoted,
+                                     std::string &scratch, bool &last) const
+    {
+        char delimiter = options_.delimiter;
+        quoted = pos < chunk.size() && chunk[pos] == '"';
+        if (quoted)
+        {
+            // "" is a quote inside a quoted value
+            scratch.clear();
+            pos++;
+            while (true)
+            {
+                size_t quote = chunk.find('"', pos);
+                if (quote == std::string_view::npos)
+                    return false;
+                scratch.append(chunk.data() + pos, quote - pos);
+                pos = quote + 1;
+                if (pos < chunk.size() && chunk[pos] == '"')
+                {
+                    scratch.push_back('"');
+                    pos++;
+                    continue;
+                }
+                break;
+            }
+            text = scratch;
+        }
+        else
+        {
+            size_t start = pos;
+            while (pos < chunk.size() && chunk[pos] != delimiter && chunk[pos] != '\n')
+                pos++;
+            size_t end = pos;
+            if (end > start && chunk[end - 1] == '\r')
+                end--;
+            text = chunk.substr(start, end - start);
+        }
+
+        if (pos < chunk.size() && chunk[pos] == delimiter)
+        {
+            pos++;
+            last = false;
+            return true;
+        }
+        // end of the record
+        if (pos < chunk.size() && chunk[pos] == '\r')
+            pos++;
+        if (pos < chunk.size() && chunk[pos] != '\n')
+            return false;
+        if (pos < chunk.size())
+            pos++;
+        last = true;
+        return true;
+    }
+
+    bool ImportParser::_ParseCsv(std::string_view chunk, size_t &pos, Record &record, std::string &scratch) const
+    {
+        size_t index = 0;
+        bool last = false;
+        while (!last)
+        {
+            std::string_view text;
+            bool quoted;
+            if (!_NextCsvField(chunk, pos, text, quoted, scratch, last) || index >= mapping_.size())
+                return false;
+            int column = mapping_[index++];
+            if (column != -1 && !_SetField(record, column, text, quoted))
+                return false;
+        }
+        return true;
+    }
+
+    bool ImportParser::_ParseJson(std::string_view chunk, size_t &pos, Record &record, std::string &scratch) const
+    {
+        // the record is the rest of the line
+        size_t eol = chunk.find('\n', pos);
+        if (eol == std::string_view::npos)
+            eol = chunk.size();
+        std::string_view line = chunk.substr(pos, eol - pos);
+        pos = eol < chunk.size() ? eol + 1 : eol;
+
+        size_t i = 0;
+        SkipSpaces(line, i);
+        if (i >= line.size() || line[i] != '{')
+            return false;
+        i++;
+        SkipSpaces(line, i);
+        bool more = i < line.size() && line[i] != '}';
+        std::string key;
+        while (more)
+        {
+            if (i >= line.size() || line[i] != '"' || !ReadJsonString(line, i, key))
+                return false;
+            SkipSpaces(line, i);
+            if (i >= line.size() || line[i] != ':')
+                return false;
+            i++;
+            SkipSpaces(line, i);
+            if (i >= line.size())
+                return false;
+
+            int column = _FindColumn(key);
+            if (line[i] == '"')
+            {
+                if (!ReadJsonString(line, i, scratch) || (column != -1 && !_SetField(record, column, scratch, true)))
+                    return false;
+            }
+            else if (line[i] == '{' || line[i] == '[')
+            {
+                // flat objects only
+                return false;
+            }
+            else
+            {
+                std::string_view token = ReadJsonToken(line, i);
+                if (token.empty())
+                    return false;
+                if (token == "true" || token == "false")
+                {
+                    // 1 and 0 in numeric columns
+                    if (column != -1 && types_[column] != DataTypes::eVarChar)
+                        token = token == "true" ? "1" : "0";
+                }
+                else if (token != "null" && token.find_first_not_of("+-.0123456789eE") != std::string_view::npos)
+                    return false;
+                if (column != -1 && token != "null" && !_SetField(record, column, token, false))
+                    return false;
+            }
+
+            SkipSpaces(line, i);
+            if (i < line.size() && line[i] == ',')
+            {
+                i++;
+                SkipSpaces(line, i);
+            }
+            else
+                more = false;
+        }
+        if (i >= line.size() || line[i] != '}')
+            return false;
+        i++;
+        SkipSpaces(line, i);
+        return i == line.size();
+    }
+
+    bool ImportParser::_SetField(Record &record, int column, std::string_view text, bool quoted) const
+    {
+        Field &field = record.fields_[column];
+        const char *end = text.data() + text.size();
+        switch (types_[column])
+        {
+        case DataTypes::eInteger:
+        {
+            if (text.empty())
+                return true;
+            int64_t value;
+            auto res = std::from_chars(text.data(), end, value);
+            if (res.ec != std::errc() || res.ptr != end)
+                return false;
+            field.SetValue(value, record.arena_);
+            return true;
+        }
+        case DataTypes::eDouble:
+        {
+            if (text.empty())
+                return true;
+            double value;
+            auto res = std::from_chars(text.data(), end, value);
+            if (res.ec != std::errc() || res.ptr != end)
+                return false;
+            field.SetValue(value, record.arena_);
+            return true;
+        }
+        case DataTypes::eVarChar:
+            if (!text.empty() || quoted)
+                field.SetValue(text, record.arena_);
+            return true;
+        default:
+            // binary columns are not imported
+            return true;
+        }
+    }
+
+    namespace
+    {
+        /*
+            \class ImportPipeline
+            \brief reader thread -> parser threads -> writer (the calling thread)
+                   the reader cuts the file into chunks at record boundaries, the parsers
+                   convert them in any order, the writer takes them back in file order.
+                   The reader waits while too many chunks are not written yet.
+        */
+        class ImportPipeline
+        {
+            struct Chunk
+            {
+                uint64_t seq;
+                std::string data;
+                // line number of the first line of the chunk
+                uint64_t first_line;
+            };
+
+            struct Parsed
+            {
+                std::vector<std::unique_ptr<Record>> records;
+                bool ok = true;
+                uint64_t error_line = 0;
+            };
+
+            std::ifstream &in_;
+            ImportParser &parser_;
+            const ImportOptions &options_;
+            size_t max_pending_;
+
+            std::mutex mutex_;
+            // a chunk was read, or the reading is over
+            std::condition_variable chunk_ready_;
+            // a chunk was parsed, or the reading is over
+            std::condition_variable parsed_ready_;
+            // a chunk was written
+            std::condition_variable room_;
+            std::deque<Chunk> chunks_;
+            std::map<uint64_t, Parsed> parsed_;
+            uint64_t read_count_;
+            uint64_t written_count_;
+            bool reading_;
+            bool stop_;
+            // the header can't be read
+            bool header_error_;
+
+            void _Read()
+            {
+                bool header = options_.format == ImportOptions::Format::eCsv && options_.header;
+                uint64_t line = 1;
+                std::string buffer;
+                bool eof = false;
+                while (!eof)
+                {
+                    size_t old = buffer.size();
+                    buffer.resize(old + options_.chunk_size);
+                    in_.read(buffer.data() + old, options_.chunk_size);
+                    buffer.resize(old + in_.gcount());
+                    eof = !in_;
+
+                    if (header)
+                    {
+                        size_t end = parser_.FindRecordEnd(buffer, true);
+                        if (end == 0 && !eof)
+                            continue;
+                        if (end == 0)
+                            end = buffer.size();
+                        if (!parser_.ReadHeader(std::string_view(buffer).substr(0, end)))
+                        {
+                            std::lock_guard<std::mutex> lock(mutex_);
+                            header_error_ = true;
+                            break;
+                        }
+                        line += std::count(buffer.begin(), buffer.begin() + end, '\n');
+                        buffer.erase(0, end);
+                        header = false;
+                    }
+
+                    // a record longer than a chunk is read on
+                    size_t end = eof ? buffer.size() : parser_.FindRecordEnd(buffer);
+                    if (end == 0)
+                        continue;
+                    Chunk chunk{0, buffer.substr(0, end), line};
+                    line += std::count(chunk.data.begin(), chunk.data.end(), '\n');
+                    buffer.erase(0, end);
+
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    room_.wait(lock, [this]
+                               { return read_count_ - written_count_ < max_pending_ || stop_; });
+                    if (stop_)
+                        break;
+                    chunk.seq = read_count_++;
+                    chunks_.push_back(std::move(chunk));
+                    chunk_ready_.notify_one();
+                }
+
+                std::lock_guard<std::mutex> lock(mutex_);
+                reading_ = false;
+                chunk_ready_.notify_all();
+                parsed_ready_.notify_all();
+            }
+
+            void _Parse()
+            {
+                while (true)
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    chunk_ready_.wait(lock, [this]
+                                      { return !chunks_.empty() || !reading_ || stop_; });
+                    if (stop_ || chunks_.empty())
+                        return;
+                    Chunk chunk = std::move(chunks_.front());
+                    chunks_.pop_front();
+                    lock.unlock();
+
+                    Parsed parsed;
+                    size_t error_offset = 0;
+                    parsed.ok = parser_.Parse(chunk.data, parsed.records, error_offset);
+                    if (!parsed.ok)
+                        parsed.error_line = chunk.first_line + std::count(chunk.data.begin(), chunk.data.begin() + error_offset, '\n');
+
+                    lock.lock();
+                    parsed_.emplace(chunk.seq, std::move(parsed));
+                    parsed_ready_.notify_all();
+                }
+            }
+
+        public:
+            ImportPipeline(std::ifstream &in, ImportParser &parser, const ImportOptions &options, size_t max_pending)
+                : in_(in), parser_(parser), options_(options), max_pending_(max_pending),
+                  read_count_(0), written_count_(0), reading_(true), stop_(false), header_error_(false)
+            {
+            }
+
+            bool Run(unsigned threads, const ImportWriter_t &write, ImportResult &result)
+            {
+                std::thread reader(&ImportPipeline::_Read, this);
+                std::vector<std::thread> parsers;
+                for (unsigned i = 0; i < threads; i++)
+                    parsers.emplace_back(&ImportPipeline::_Parse, this);
+
+                bool ok = true;
+                for (uint64_t next = 0;; next++)
+                {
+                    std::unique_lock<std::mutex> lock(mutex_);
+                    parsed_ready_.wait(lock, [&]
+                                       { return parsed_.count(next) != 0 || (!reading_ && next == read_count_); });
+                    auto it = parsed_.find(next);
+                    if (it == parsed_.end())
+                        break;
+                    Parsed parsed = std::move(it->second);
+                    parsed_.erase(it);
+                    written_count_ = next + 1;
+                    room_.notify_one();
+                    lock.unlock();
+
+                    if (!parsed.ok)
+                    {
+                        result.error_line = parsed.error_line;
+                        ok = false;
+                        break;
+                    }
+                    size_t rows = parsed.records.size();
+                    if (!rows)
+                        continue;
+                    if (!write(parsed.records))
+                    {
+                        ok = false;
+                        break;
+                    }
+                    result.rows += rows;
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(mutex_);
+                    stop_ = true;
+                    room_.notify_all();
+                    chunk_ready_.notify_all();
+                }
+                reader.join();
+                for (auto &&it : parsers)
+                    it.join();
+
+                if (header_error_)
+                {
+                    result.error_line = 1;
+                    ok = false;
+                }
+                return ok;
+            }
+        };
+    }
+
+    bool ImportFile(const std::filesystem::path &path, const std::vector<Column> &columns,
+                    const ImportOptions &options, const ImportWriter_t &write, ImportResult &result)
+    {
+        std::ifstream in(path, std::ios::binary);
+        if (!in || columns.empty() || options.chunk_size == 0)
+            return false;
+
+        ImportParser parser(columns, options);
+        unsigned threads = options.threads != 0 ? options.threads : std::max(1u, std::thread::hardware_concurrency());
+        // the chunks read ahead of the writer, parsed or waiting for a parser
+        ImportPipeline pipeline(in, parser, options, threads * 2);
+        return pipeline.Run(threads, write, result);
+    }
+}
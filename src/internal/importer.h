@@ -0,0 +1,72 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef _H_RURU_IMPORTER_HH_
+#define _H_RURU_IMPORTER_HH_
+
+#include "ruru.h"
+#include "record.h"
+
+#include <string_view>
+
+namespace ruru::internal
+{
+    /*
+        \class ImportParser
+        \brief converts CSV or newline-delimited JSON text into records
+               the values are converted to the types of the columns of a table.
+               Once the header is read the parser is shared by the import threads.
+    */
+    class ImportParser
+    {
+    public:
+        ImportParser(const std::vector<Column> &columns, const ImportOptions &options);
+
+        // read the CSV header line: the table column of each CSV column, unknown names are skipped
+        // returns false when no name is a column of the table
+        bool ReadHeader(std::string_view line);
+
+        // parse the records of a chunk ending at a record boundary
+        // returns false on a record that can't be read, error_offset is its offset in the chunk
+        bool Parse(std::string_view chunk, std::vector<std::unique_ptr<Record>> &records, size_t &error_offset) const;
+
+        // end of the last complete record of data, of the first one when first is true
+        // 0 when data holds no complete record
+        size_t FindRecordEnd(std::string_view data, bool first = false) const;
+
+    private:
+        ImportOptions options_;
+        std::vector<std::string> names_;
+        std::vector<DataTypes> types_;
+        // fields of an empty record
+        std::vector<Field> prototype_;
+        // table column of each CSV column, -1 when the column is skipped
+        std::vector<int> mapping_;
+
+        int _FindColumn(std::string_view name) const;
+
+        // next CSV field of the record at pos, last is set on the last field of the record
+        bool _NextCsvField(std::string_view chunk, size_t &pos, std::string_view &text, bool &quoted,
+                           std::string &scratch, bool &last) const;
+
+        // one record, pos moves past its end of line
+        bool _ParseCsv(std::string_view chunk, size_t &pos, Record &record, std::string &scratch) const;
+        bool _ParseJson(std::string_view chunk, size_t &pos, Record &record, std::string &scratch) const;
+
+        // convert the text of a value to the type of the column
+        // an empty value is a null, a quoted one is an empty varchar
+        bool _SetField(Record &record, int column, std::string_view text, bool quoted) const;
+    };
+
+    // receives the records of each chunk, in file order
+    using ImportWriter_t = std::function<bool(std::vector<std::unique_ptr<Record>> &records)>;
+
+    // read the file with a reader thread, parse its chunks with options.threads threads
+    // and hand them to write from the calling thread
+    bool ImportFile(const std::filesystem::path &path, const std::vector<Column> &columns,
+                    const ImportOptions &options, const ImportWriter_t &write, ImportResult &result);
+}
+
+#endif //_H_RURU_IMPORTER_HH_
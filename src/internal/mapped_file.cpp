@@ -0,0 +1,47 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "ruru.h"
+#include "internal/mapped_file.h"
+
+#include <sys/mman.h>
+
+namespace ruru::internal
+{
+    MappedFile::MappedFile(const FileHandle &file)
+        : file_(file)
+    {
+    }
+
+    bool MappedFile::Cover(RecordPosition_t end, Mapping &mapping)
+    {
+        std::lock_guard<std::mutex> lock(latch_);
+        if (current_.region == nullptr || (size_t)end > current_.size)
+        {
+            int fd = file_.GetDescriptor();
+            size_t size = file_.GetSize();
+            if (fd == -1 || size == 0 || (size_t)end > size)
+                return false;
+
+            void *addr = ::mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED)
+                return false;
+
+            current_.region = std::shared_ptr<const char>(static_cast<const char *>(addr),
+                                                          [size](const char *p)
+                                                          { ::munmap(const_cast<char *>(p), size); });
+            current_.size = size;
+        }
+        mapping = current_;
+        return true;
+    }
+
+    void MappedFile::Unmap()
+    {
+        std::lock_guard<std::mutex> lock(latch_);
+        current_ = Mapping();
+    }
+}
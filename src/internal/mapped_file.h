@@ -0,0 +1,55 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef _H_RURU_MAPPED_FILE_HH_
+#define _H_RURU_MAPPED_FILE_HH_
+
+#include "ruru.h"
+#include "file_handle.h"
+#include <mutex>
+
+namespace ruru::internal
+{
+    /*
+        \class MappedFile
+        \brief read-only memory mapping of a data file
+               the file is mapped up to its current size and mapped again when a
+               read goes past the end of the mapping. The mapping is shared with
+               the record views pointing into it, it is unmapped with the last one,
+               so mapping the file again never invalidates a view.
+               Readers share the object: they get their own reference on the
+               mapping from Cover, under the latch of the file.
+    */
+    class MappedFile
+    {
+    public:
+        // a mapping of the file, kept alive by the reference on the region
+        struct Mapping
+        {
+            std::shared_ptr<const char> region;
+            size_t size = 0;
+
+            const char *Data() const { return region.get(); }
+        };
+
+        MappedFile(const FileHandle &file);
+        MappedFile(const MappedFile &) = delete;
+        MappedFile &operator=(const MappedFile &) = delete;
+
+        // make sure the mapping covers [0, end) and return it
+        // returns false when the file is not open or can't be mapped
+        bool Cover(RecordPosition_t end, Mapping &mapping);
+
+        // drop the mapping, the views keep their own reference
+        void Unmap();
+
+    private:
+        const FileHandle &file_;
+        std::mutex latch_;
+        Mapping current_;
+    };
+}
+
+#endif //_H_RURU_MAPPED_FILE_HH_
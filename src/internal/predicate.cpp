@@ -0,0 +1,246 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "ruru.h"
+#include "record.h"
+#include "record_view.h"
+#include "internal/predicate.h"
+
+#include <cmath>
+
+namespace ruru::internal
+{
+    namespace
+    {
+        // access to the raw bytes of a field
+        struct IntegerTraits
+        {
+            static constexpr DataTypes type = DataTypes::eInteger;
+            using Const = int64_t;
+            using View = int64_t;
+            static View Read(const char *data)
+            {
+                int64_t value;
+                memcpy(&value, data, sizeof(value));
+                return value;
+            }
+        };
+
+        struct DoubleTraits
+        {
+            static constexpr DataTypes type = DataTypes::eDouble;
+            using Const = double;
+            using View = double;
+            static View Read(const char *data)
+            {
+                double value;
+                memcpy(&value, data, sizeof(value));
+                return value;
+            }
+        };
+
+        struct VarCharTraits
+        {
+            static constexpr DataTypes type = DataTypes::eVarChar;
+            using Const = std::string;
+            using View = std::string_view;
+            // varchar is stored as [length][bytes]
+            static View Read(const char *data)
+            {
+                uint64_t len;
+                memcpy(&len, data, sizeof(len));
+                return View(data + sizeof(len), len);
+            }
+        };
+
+        // evaluate the filter on a decoded copy of the field
+        // used when the field and the filter value have different types
+        bool ApplyDecoded(const Filter &filter, DataTypes type, const char *data)
+        {
+            switch (type)
+            {
+            case DataTypes::eInteger:
+                return filter.Apply(IntegerTraits::Read(data));
+            case DataTypes::eDouble:
+                return filter.Apply(DoubleTraits::Read(data));
+            case DataTypes::eVarChar:
+                return filter.Apply(std::string(VarCharTraits::Read(data)));
+            default:
+                throw new std::exception();
+            }
+        }
+
+        bool IsNull(DataTypes type, const char *data)
+        {
+            return type == DataTypes::eNull || data == nullptr;
+        }
+
+        // filters without typed values: IS NULL, IS NOT NULL, unknown operators
+        class GenericPredicate : public IPredicate
+        {
+            Filter filter_;
+
+        public:
+            GenericPredicate(const Filter &filter) : filter_(filter) {}
+
+            bool Match(DataTypes type, const char *data) const override
+            {
+                if (IsNull(type, data))
+                    return filter_.ApplyNull();
+                if (filter_.oper == OperatorType::eIsNotNull)
+                    return true;
+                return ApplyDecoded(filter_, type, data);
+            }
+        };
+
+        // comparison with values of the type Traits::Const, done on the raw field bytes
+        template <typename Traits>
+        class TypedPredicate : public IPredicate
+        {
+            using Const = typename Traits::Const;
+            using View = typename Traits::View;
+
+            Filter filter_;
+            Const value1_;
+            Const value2_;
+            // sorted IN list
+            std::vector<Const> values_;
+
+        public:
+            TypedPredicate(const Filter &filter)
+                : filter_(filter), value1_(), value2_()
+            {
+                if (std::holds_alternative<Const>(filter.value1))
+                    value1_ = std::get<Const>(filter.value1);
+                if (std::holds_alternative<Const>(filter.value2))
+                    value2_ = std::get<Const>(filter.value2);
+
+                for (auto &&v : filter.values)
+                {
+                    const Const &c = std::get<Const>(v);
+                    // NaN is equal to nothing
+                    if constexpr (std::is_floating_point_v<Const>)
+                    {
+                        if (std::isnan(c))
+                            continue;
+                    }
+                    values_.push_back(c);
+                }
+                std::sort(values_.begin(), values_.end());
+            }
+
+            bool Match(DataTypes type, const char *data) const override
+            {
+                if (IsNull(type, data))
+                    return filter_.ApplyNull();
+                if (type != Traits::type)
+                    return ApplyDecoded(filter_, type, data);
+
+                View value = Traits::Read(data);
+                switch (filter_.oper)
+                {
+                case OperatorType::eEqual:
+                    return value == value1_;
+                case OperatorType::eGreater:
+                    return value > value1_;
+                case OperatorType::eGreaterOrEq:
+                    return value >= value1_;
+                case OperatorType::eLesser:
+                    return value < value1_;
+                case OperatorType::eLesserOrEq:
+                    return value <= value1_;
+                case OperatorType::eInRange:
+                    return value >= value1_ && value <= value2_;
+                case OperatorType::eOutRange:
+                    return value < value1_ || value > value2_;
+                case OperatorType::eIn:
+                    // NaN is equal to nothing, but the binary search would find it
+                    if constexpr (std::is_floating_point_v<View>)
+                    {
+                        if (std::isnan(value))
+                            return false;
+                    }
+                    return std::binary_search(values_.begin(), values_.end(), value, std::less<>());
+                default:
+                    return ApplyDecoded(filter_, type, data);
+                }
+            }
+        };
+
+        // the values used by the filter operator all hold the alternative T
+        template <typename T>
+        bool HoldsOnly(const Filter &filter)
+        {
+            switch (filter.oper)
+            {
+            case OperatorType::eEqual:
+            case OperatorType::eGreater:
+            case OperatorType::eGreaterOrEq:
+            case OperatorType::eLesser:
+            case OperatorType::eLesserOrEq:
+                return std::holds_alternative<T>(filter.value1);
+            case OperatorType::eInRange:
+            case OperatorType::eOutRange:
+                return std::holds_alternative<T>(filter.value1) && std::holds_alternative<T>(filter.value2);
+            case OperatorType::eIn:
+                return std::all_of(filter.values.begin(), filter.values.end(),
+                                   [](const Value_t &v)
+                                   { return std::holds_alternative<T>(v); });
+            default:
+                return false;
+            }
+        }
+    }
+
+    bool IPredicate::Match(const Field &field) const
+    {
+        return Match(field.type_, field.Data());
+    }
+
+    std::unique_ptr<IPredicate> CompilePredicate(const Filter &filter)
+    {
+        if (HoldsOnly<int64_t>(filter))
+            return std::make_unique<TypedPredicate<IntegerTraits>>(filter);
+        if (HoldsOnly<double>(filter))
+            return std::make_unique<TypedPredicate<DoubleTraits>>(filter);
+        if (HoldsOnly<std::string>(filter))
+            return std::make_unique<TypedPredicate<VarCharTraits>>(filter);
+        return std::make_unique<GenericPredicate>(filter);
+    }
+
+    CompiledFilters::CompiledFilters(const Filters_t &filters)
+    {
+        entries_.reserve(filters.size());
+        for (auto &&filter : filters)
+            entries_.push_back({filter->column_indx, filter->oper == OperatorType::eIsNull, CompilePredicate(*filter)});
+    }
+
+    bool CompiledFilters::Match(const Record &rec) const
+    {
+        for (auto &&entry : entries_)
+        {
+            // a missing column is null
+            bool ok = entry.column < rec.fields_.size() ? entry.predicate->Match(rec.fields_[entry.column])
+                                                         : entry.null_match;
+            if (!ok)
+                return false;
+        }
+        return true;
+    }
+
+    bool CompiledFilters::Match(const RecordView &view) const
+    {
+        for (auto &&entry : entries_)
+        {
+            // a missing column is null
+            bool ok = entry.column < view.GetFieldCount() ? entry.predicate->Match(view.GetType(entry.column), view.GetData(entry.column))
+                                                           : entry.null_match;
+            if (!ok)
+                return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,64 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef _H_RURU_PREDICATE_HH_
+#define _H_RURU_PREDICATE_HH_
+
+#include "ruru.h"
+
+namespace ruru
+{
+    struct Field;
+    struct Record;
+    class RecordView;
+}
+
+namespace ruru::internal
+{
+    //<interface>
+    // a filter compiled for the type of its value
+    class IPredicate
+    {
+    public:
+        // evaluate the predicate on the raw bytes of a value, data is nullptr for a null
+        virtual bool Match(DataTypes type, const char *data) const = 0;
+
+        // evaluate the predicate on a field
+        bool Match(const Field &field) const;
+
+        virtual ~IPredicate(){};
+    };
+
+    // compile a filter, the comparisons of the returned predicate don't allocate
+    // as long as the field has the type of the filter value
+    std::unique_ptr<IPredicate> CompilePredicate(const Filter &filter);
+
+    /*
+        \class CompiledFilters
+        \brief the filters of a query compiled once, then evaluated on every record
+    */
+    class CompiledFilters
+    {
+        struct Entry
+        {
+            uint16_t column;
+            // result for a record without this column
+            bool null_match;
+            std::unique_ptr<IPredicate> predicate;
+        };
+        std::vector<Entry> entries_;
+
+    public:
+        explicit CompiledFilters(const Filters_t &filters);
+
+        // true when the record satisfies all the filters
+        bool Match(const Record &rec) const;
+
+        // same, on a record decoded in place
+        bool Match(const RecordView &view) const;
+    };
+}
+
+#endif //_H_RURU_PREDICATE_HH_
@@ -0,0 +1,42 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "ruru.h"
+#include "record.h"
+#include "record_view.h"
+#include "internal/record_cursor.h"
+
+namespace ruru::internal
+{
+    IdListCursor::IdListCursor(IStorageEngine *store, std::vector<RecordId> ids, uint64_t snapshot)
+        : store_(store), ids_(std::move(ids)), next_(0), snapshot_(snapshot)
+    {
+    }
+
+    bool IdListCursor::NextBatch(std::vector<CursorRecord> &batch, size_t max)
+    {
+        size_t start = batch.size();
+        for (; next_ < ids_.size() && batch.size() - start < max; next_++)
+        {
+            // the stored record is read in place when the engine allows it
+            auto view = std::make_unique<RecordView>();
+            if (store_->LoadRecordView(ids_[next_], snapshot_, *view))
+            {
+                batch.push_back({std::move(view), nullptr});
+                continue;
+            }
+            std::unique_ptr<Record> rec(store_->LoadRecord(ids_[next_], snapshot_));
+            if (rec != nullptr)
+                batch.push_back({nullptr, std::move(rec)});
+        }
+        return batch.size() > start;
+    }
+
+    RecordCursorPtr IdListCursor::Clone() const
+    {
+        return std::make_unique<IdListCursor>(store_, ids_, snapshot_);
+    }
+}
@@ -0,0 +1,36 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef _H_RURU_RECORD_CURSOR_HH_
+#define _H_RURU_RECORD_CURSOR_HH_
+
+#include "ruru.h"
+
+namespace ruru::internal
+{
+    /*
+        \class IdListCursor
+        \brief cursor of the engines without one of their own
+               the ids found by Lookup are loaded one by one as a snapshot sees them
+    */
+    class IdListCursor : public IRecordCursor
+    {
+    public:
+        IdListCursor(IStorageEngine *store, std::vector<RecordId> ids, uint64_t snapshot);
+
+        bool NextBatch(std::vector<CursorRecord> &batch, size_t max) override;
+
+        RecordCursorPtr Clone() const override;
+
+    private:
+        IStorageEngine *store_;
+        std::vector<RecordId> ids_;
+        // next id to load
+        size_t next_;
+        uint64_t snapshot_;
+    };
+}
+
+#endif //_H_RURU_RECORD_CURSOR_HH_
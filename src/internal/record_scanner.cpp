@@ -0,0 +1,97 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "ruru.h"
+#include "record.h"
+#include "record_view.h"
+#include "internal/record_scanner.h"
+#include "internal/RecordStream.h"
+#include "utils/memory_stream.h"
+
+namespace ruru::internal
+{
+    RecordScanner::RecordScanner(const FileHandle &file, RecordPosition_t start, size_t buffer_size)
+        : file_(file), buffer_(buffer_size), buffer_pos_(start), valid_(0), cursor_(0), end_of_file_(false)
+    {
+    }
+
+    bool RecordScanner::Refill()
+    {
+        if (end_of_file_)
+            return false;
+
+        // move the partial record at the front of the buffer
+        size_t remaining = valid_ - cursor_;
+        if (cursor_ > 0 && remaining > 0)
+            memmove(buffer_.data(), buffer_.data() + cursor_, remaining);
+        buffer_pos_ += cursor_;
+        cursor_ = 0;
+        valid_ = remaining;
+
+        // a single record is bigger than the buffer
+        if (valid_ == buffer_.size())
+            buffer_.resize(buffer_.size() * 2);
+
+        size_t want = buffer_.size() - valid_;
+        int64_t got = file_.ReadAt(buffer_pos_ + valid_, buffer_.data() + valid_, want);
+        if (got <= 0)
+        {
+            end_of_file_ = true;
+            return false;
+        }
+        if ((size_t)got < want)
+            end_of_file_ = true;
+        valid_ += got;
+        return true;
+    }
+
+    bool RecordScanner::Next(Record &rec, RecordPosition_t &position, RecordLength_t &length)
+    {
+        while (true)
+        {
+            if (cursor_ < valid_)
+            {
+                MemoryReader stream(buffer_.data() + cursor_, valid_ - cursor_);
+                RecordStream<MemoryReader> rec_stream(stream);
+                RecordId id = -1;
+                if (rec_stream.Read(id, &rec))
+                {
+                    position = buffer_pos_ + cursor_;
+                    length = stream.tell();
+                    cursor_ += stream.tell();
+                    return true;
+                }
+            }
+            // the record is incomplete, read the next part of the file
+            if (!Refill())
+                return false;
+        }
+    }
+
+    RecordPosition_t RecordScanner::Tell() const
+    {
+        return buffer_pos_ + cursor_;
+    }
+
+    ViewScanner::ViewScanner(const MappedFile::Mapping &mapping, RecordPosition_t start)
+        : region_(mapping.region), size_(mapping.size), cursor_(start)
+    {
+    }
+
+    bool ViewScanner::Next(RecordView &view, RecordPosition_t &position, RecordLength_t &length)
+    {
+        if (region_ == nullptr || cursor_ >= size_)
+            return false;
+        if (!view.Reset(region_.get() + cursor_, size_ - cursor_, region_))
+            return false;
+        length = view.GetLength();
+        if (length == 0)
+            return false;
+        position = cursor_;
+        cursor_ += length;
+        return true;
+    }
+}
@@ -0,0 +1,79 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef _H_RURU_RECORD_SCANNER_HH_
+#define _H_RURU_RECORD_SCANNER_HH_
+
+#include "ruru.h"
+#include "file_handle.h"
+#include "mapped_file.h"
+
+namespace ruru
+{
+    struct Record;
+    class RecordView;
+}
+
+namespace ruru::internal
+{
+    // size of the read-ahead buffer used by sequential scans
+    constexpr size_t SCAN_BUFFER_SIZE = 4 * 1024 * 1024;
+
+    /*
+        \class RecordScanner
+        \brief reads a data file front to back through a large read-ahead buffer
+               records are decoded in place with RecordStream; a record crossing
+               the end of the buffer is carried over to the next read
+    */
+    class RecordScanner
+    {
+        const FileHandle &file_;
+        std::vector<char> buffer_;
+        // file position of buffer_[0]
+        RecordPosition_t buffer_pos_;
+        // number of valid bytes in buffer_
+        size_t valid_;
+        // decoding cursor inside buffer_
+        size_t cursor_;
+        // the last read reached the end of file
+        bool end_of_file_;
+
+        // keep the undecoded bytes and read the next part of the file
+        bool Refill();
+
+    public:
+        RecordScanner(const FileHandle &file, RecordPosition_t start = 0, size_t buffer_size = SCAN_BUFFER_SIZE);
+
+        // decode the next record
+        // returns false at the end of file, or when the tail of the file is truncated
+        bool Next(Record &rec, RecordPosition_t &position, RecordLength_t &length);
+
+        // file position of the next record to decode
+        RecordPosition_t Tell() const;
+    };
+
+    /*
+        \class ViewScanner
+        \brief walks the records of a mapped data file in place
+               the views point into the mapping, nothing is read nor copied.
+               The scan stops at the end of the mapping the scanner is created with.
+    */
+    class ViewScanner
+    {
+        std::shared_ptr<const char> region_;
+        size_t size_;
+        // position of the next record
+        size_t cursor_;
+
+    public:
+        ViewScanner(const MappedFile::Mapping &mapping, RecordPosition_t start = 0);
+
+        // move the view to the next record
+        // returns false at the end of the mapping, or when the tail of the file is truncated
+        bool Next(RecordView &view, RecordPosition_t &position, RecordLength_t &length);
+    };
+}
+
+#endif //_H_RURU_RECORD_SCANNER_HH_
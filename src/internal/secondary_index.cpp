@@ -0,0 +1,28 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "ruru.h"
+#include "record.h"
+#include "internal/secondary_index.h"
+
+namespace ruru::internal
+{
+    ISecondaryIndex *CreateSecondaryIndex(uint16_t column, DataTypes type)
+    {
+        switch (type)
+        {
+        case DataTypes::eInteger:
+            return new SecondaryIndex<int64_t>(column);
+        case DataTypes::eDouble:
+            return new SecondaryIndex<double>(column);
+        case DataTypes::eVarChar:
+            return new SecondaryIndex<StringPrefix>(column);
+        default:
+            // binary values are not indexed
+            return nullptr;
+        }
+    }
+}
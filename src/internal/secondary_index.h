@@ -0,0 +1,300 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef _H_RURU_SECONDARY_INDEX_HH_
+#define _H_RURU_SECONDARY_INDEX_HH_
+
+#include "ruru.h"
+#include "record.h"
+#include "btreeindex.h"
+#include <cmath>
+
+namespace ruru::internal
+{
+    // number of leading bytes of a varchar stored in an index key
+    constexpr size_t INDEX_PREFIX_SIZE = 24;
+
+    // key of a varchar index: zero padded prefix of the string
+    struct StringPrefix
+    {
+        char data[INDEX_PREFIX_SIZE];
+
+        bool operator<(const StringPrefix &other) const
+        {
+            return memcmp(data, other.data, INDEX_PREFIX_SIZE) < 0;
+        }
+    };
+
+    //<interface>
+    class ISecondaryIndex
+    {
+    public:
+        // attach the index to its file
+        virtual bool Open(const std::string &path) = 0;
+
+        // indexed column
+        virtual uint16_t GetColumn() const = 0;
+
+        // add / remove the entry of a record, null values are not indexed
+        virtual void Insert(const Record &rec) = 0;
+        virtual void Remove(const Record &rec) = 0;
+
+        // add the entries of a batch of records, merged into the index in key order
+        virtual void InsertBatch(const std::vector<const Record *> &records) = 0;
+
+        // collect the ids of the records that may match the filter
+        // returns false when the filter can't be served by this index
+        // exact is false when the candidates must be checked against the filter
+        virtual bool Lookup(const Filter &filter, std::vector<RecordId> &ids, bool &exact) = 0;
+
+        // write dirty pages back to the index file
+        virtual bool Flush() = 0;
+
+        virtual ~ISecondaryIndex(){};
+    };
+
+    // conversion of field values and filter values to index keys
+    template <typename T>
+    struct IndexKeyTraits;
+
+    template <>
+    struct IndexKeyTraits<int64_t>
+    {
+        static constexpr bool exact = true;
+        static bool FromField(const Field &field, int64_t &key)
+        {
+            if (field.type_ != DataTypes::eInteger || field.IsNull())
+                return false;
+            memcpy(&key, field.Data(), sizeof(key));
+            return true;
+        }
+        static bool FromValue(const Value_t &value, int64_t &key)
+        {
+            if (!std::holds_alternative<int64_t>(value))
+                return false;
+            key = std::get<int64_t>(value);
+            return true;
+        }
+    };
+
+    template <>
+    struct IndexKeyTraits<double>
+    {
+        static constexpr bool exact = true;
+        static bool FromField(const Field &field, double &key)
+        {
+            if (field.type_ != DataTypes::eDouble || field.IsNull())
+                return false;
+            memcpy(&key, field.Data(), sizeof(key));
+            return !std::isnan(key);
+        }
+        static bool FromValue(const Value_t &value, double &key)
+        {
+            if (!std::holds_alternative<double>(value))
+                return false;
+            key = std::get<double>(value);
+            return !std::isnan(key);
+        }
+    };
+
+    template <>
+    struct IndexKeyTraits<StringPrefix>
+    {
+        // strings sharing the same prefix are not told apart
+        static constexpr bool exact = false;
+        static void FromBytes(const char *data, uint64_t len, StringPrefix &key)
+        {
+            memset(key.data, 0, INDEX_PREFIX_SIZE);
+            memcpy(key.data, data, std::min<uint64_t>(len, INDEX_PREFIX_SIZE));
+        }
+        static bool FromField(const Field &field, StringPrefix &key)
+        {
+            if (field.type_ != DataTypes::eVarChar || field.IsNull())
+                return false;
+            uint64_t len;
+            memcpy(&len, field.Data(), sizeof(len));
+            FromBytes(field.Data() + sizeof(len), len, key);
+            return true;
+        }
+        static bool FromValue(const Value_t &value, StringPrefix &key)
+        {
+            if (!std::holds_alternative<std::string>(value))
+                return false;
+            const std::string &str = std::get<std::string>(value);
+            FromBytes(str.data(), str.size(), key);
+            return true;
+        }
+    };
+
+    /*
+        \class SecondaryIndex
+        \brief ordered index on one column
+               entries are (value, row id) pairs in a paged B+tree, so duplicated
+               values are allowed and equal values are sorted by row id
+    */
+    template <typename T>
+    class SecondaryIndex : public ISecondaryIndex
+    {
+        using Key = std::pair<T, RecordId>;
+        using Traits = IndexKeyTraits<T>;
+
+        uint16_t column_;
+        BTreeIndex<Key, uint8_t> tree_;
+
+        // ids of the entries with from <= value <= to
+        void _CollectRange(const T &from, const T &to, std::vector<RecordId> &ids)
+        {
+            tree_.Scan(Key(from, 0), [&](const Key &key, const uint8_t &)
+                       {
+                           if (to < key.first)
+                               return false;
+                           ids.push_back(key.second);
+                           return true; });
+        }
+
+        // ids of the entries with value > from (value >= from when or_equal)
+        void _CollectGreater(const T &from, bool or_equal, std::vector<RecordId> &ids)
+        {
+            // with a prefix key, longer strings sharing the prefix may be greater
+            bool keep_equal = or_equal || !Traits::exact;
+            tree_.Scan(Key(from, 0), [&](const Key &key, const uint8_t &)
+                       {
+                           if (keep_equal || from < key.first)
+                               ids.push_back(key.second);
+                           return true; });
+        }
+
+        // ids of the entries with value < to (value <= to when or_equal)
+        void _CollectLesser(const T &to, bool or_equal, std::vector<RecordId> &ids)
+        {
+            // with a prefix key, the strings sharing the prefix are candidates
+            bool keep_equal = or_equal || !Traits::exact;
+            tree_.ForEach([&](const Key &key, const uint8_t &)
+                          {
+                              if (to < key.first || (!keep_equal && !(key.first < to)))
+                                  return false;
+                              ids.push_back(key.second);
+                              return true; });
+        }
+
+    public:
+        SecondaryIndex(uint16_t column) : column_(column) {}
+
+        // a file left unclean by a crash is refused, the owner builds the index again
+        bool Open(const std::string &path) override
+        {
+            return tree_.Open(path) && tree_.IsClean();
+        }
+
+        uint16_t GetColumn() const override
+        {
+            return column_;
+        }
+
+        void Insert(const Record &rec) override
+        {
+            T key;
+            if (column_ < rec.fields_.size() && Traits::FromField(rec.fields_[column_], key))
+                tree_.Insert(Key(key, rec.row_id_), 0);
+        }
+
+        void InsertBatch(const std::vector<const Record *> &records) override
+        {
+            std::vector<std::pair<Key, uint8_t>> entries;
+            entries.reserve(records.size());
+            T key;
+            for (auto &&rec : records)
+            {
+                if (column_ < rec->fields_.size() && Traits::FromField(rec->fields_[column_], key))
+                    entries.emplace_back(Key(key, rec->row_id_), 0);
+            }
+            tree_.InsertBatch(std::move(entries));
+        }
+
+        void Remove(const Record &rec) override
+        {
+            T key;
+            if (column_ < rec.fields_.size() && Traits::FromField(rec.fields_[column_], key))
+                tree_.Delete(Key(key, rec.row_id_));
+        }
+
+        bool Lookup(const Filter &filter, std::vector<RecordId> &ids, bool &exact) override
+        {
+            exact = Traits::exact;
+            T value, value2;
+
+            switch (filter.oper)
+            {
+            case OperatorType::eEqual:
+                if (!Traits::FromValue(filter.value1, value))
+                    return false;
+                _CollectRange(value, value, ids);
+                break;
+            case OperatorType::eGreater:
+                if (!Traits::FromValue(filter.value1, value))
+                    return false;
+                _CollectGreater(value, false, ids);
+                break;
+            case OperatorType::eGreaterOrEq:
+                if (!Traits::FromValue(filter.value1, value))
+                    return false;
+                _CollectGreater(value, true, ids);
+                break;
+            case OperatorType::eLesser:
+                if (!Traits::FromValue(filter.value1, value))
+                    return false;
+                _CollectLesser(value, false, ids);
+                break;
+            case OperatorType::eLesserOrEq:
+                if (!Traits::FromValue(filter.value1, value))
+                    return false;
+                _CollectLesser(value, true, ids);
+                break;
+            case OperatorType::eInRange:
+                if (!Traits::FromValue(filter.value1, value) || !Traits::FromValue(filter.value2, value2))
+                    return false;
+                if (!(value2 < value))
+                    _CollectRange(value, value2, ids);
+                break;
+            case OperatorType::eOutRange:
+                if (!Traits::FromValue(filter.value1, value) || !Traits::FromValue(filter.value2, value2))
+                    return false;
+                _CollectLesser(value, false, ids);
+                _CollectGreater(value2, false, ids);
+                break;
+            case OperatorType::eIn:
+            {
+                // every value of the list must be usable as a key
+                std::vector<T> keys(filter.values.size());
+                for (size_t i = 0; i < keys.size(); i++)
+                {
+                    if (!Traits::FromValue(filter.values[i], keys[i]))
+                        return false;
+                }
+                std::sort(keys.begin(), keys.end());
+                for (size_t i = 0; i < keys.size(); i++)
+                {
+                    if (i == 0 || keys[i - 1] < keys[i])
+                        _CollectRange(keys[i], keys[i], ids);
+                }
+            }
+            break;
+            default:
+                return false;
+            }
+            return true;
+        }
+
+        bool Flush() override
+        {
+            return tree_.Flush();
+        }
+    };
+
+    // create an index for a column of the given type, nullptr when the type can't be indexed
+    ISecondaryIndex *CreateSecondaryIndex(uint16_t column, DataTypes type);
+}
+
+#endif //_H_RURU_SECONDARY_INDEX_HH_
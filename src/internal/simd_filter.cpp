@@ -0,0 +1,347 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "ruru.h"
+#include "internal/simd_filter.h"
+
+#if defined(__x86_64__) && (defined(__GNUC__) || defined(__clang__))
+#define RURU_AVX2_KERNELS 1
+#include <immintrin.h>
+#endif
+
+namespace ruru::internal
+{
+    namespace
+    {
+        // in lists longer than this are matched with a binary search
+        constexpr size_t MAX_SIMD_IN_VALUES = 8;
+
+        template <typename T, OperatorType OP>
+        inline bool Compare(T x, T value1, T value2)
+        {
+            if constexpr (OP == OperatorType::eEqual)
+                return x == value1;
+            else if constexpr (OP == OperatorType::eGreater)
+                return x > value1;
+            else if constexpr (OP == OperatorType::eGreaterOrEq)
+                return x >= value1;
+            else if constexpr (OP == OperatorType::eLesser)
+                return x < value1;
+            else if constexpr (OP == OperatorType::eLesserOrEq)
+                return x <= value1;
+            else if constexpr (OP == OperatorType::eInRange)
+                return x >= value1 && x <= value2;
+            else
+                return x < value1 || x > value2;
+        }
+
+        // scalar kernel, from_word is the first selection word to process
+        template <typename T, OperatorType OP>
+        void FilterScalar(const T *data, size_t count, T value1, T value2, uint64_t *selection, size_t from_word)
+        {
+            size_t words = (count + 63) / 64;
+            for (size_t w = from_word; w < words; w++)
+            {
+                if (selection[w] == 0)
+                    continue;
+                size_t base = w * 64;
+                size_t n = std::min<size_t>(64, count - base);
+                uint64_t bits = 0;
+                for (size_t i = 0; i < n; i++)
+                    bits |= (uint64_t)Compare<T, OP>(data[base + i], value1, value2) << i;
+                selection[w] &= bits;
+            }
+        }
+
+        template <typename T>
+        void FilterInScalar(const T *data, size_t count, const std::vector<T> &sorted, uint64_t *selection, size_t from_word)
+        {
+            size_t words = (count + 63) / 64;
+            for (size_t w = from_word; w < words; w++)
+            {
+                if (selection[w] == 0)
+                    continue;
+                size_t base = w * 64;
+                size_t n = std::min<size_t>(64, count - base);
+                uint64_t bits = 0;
+                for (size_t i = 0; i < n; i++)
+                {
+                    const T x = data[base + i];
+                    // x == x rules out NaN, which the binary search would find
+                    bits |= (uint64_t)(x == x && std::binary_search(sorted.begin(), sorted.end(), x)) << i;
+                }
+                selection[w] &= bits;
+            }
+        }
+
+#ifdef RURU_AVX2_KERNELS
+        bool UseAvx2()
+        {
+            static const bool avx2 = __builtin_cpu_supports("avx2");
+            return avx2;
+        }
+
+        // 4 lanes compare, returns one bit per lane
+        template <OperatorType OP>
+        __attribute__((target("avx2"))) inline int MaskInt64(__m256i x, __m256i value1, __m256i value2)
+        {
+            const __m256i ones = _mm256_set1_epi64x(-1);
+            __m256i m;
+            if constexpr (OP == OperatorType::eEqual)
+                m = _mm256_cmpeq_epi64(x, value1);
+            else if constexpr (OP == OperatorType::eGreater)
+                m = _mm256_cmpgt_epi64(x, value1);
+            else if constexpr (OP == OperatorType::eGreaterOrEq)
+                m = _mm256_xor_si256(_mm256_cmpgt_epi64(value1, x), ones);
+            else if constexpr (OP == OperatorType::eLesser)
+                m = _mm256_cmpgt_epi64(value1, x);
+            else if constexpr (OP == OperatorType::eLesserOrEq)
+                m = _mm256_xor_si256(_mm256_cmpgt_epi64(x, value1), ones);
+            else if constexpr (OP == OperatorType::eInRange)
+                m = _mm256_andnot_si256(_mm256_or_si256(_mm256_cmpgt_epi64(value1, x), _mm256_cmpgt_epi64(x, value2)), ones);
+            else
+                m = _mm256_or_si256(_mm256_cmpgt_epi64(value1, x), _mm256_cmpgt_epi64(x, value2));
+            return _mm256_movemask_pd(_mm256_castsi256_pd(m));
+        }
+
+        // ordered comparisons: NaN satisfies nothing, like the scalar operators
+        template <OperatorType OP>
+        __attribute__((target("avx2"))) inline int MaskDouble(__m256d x, __m256d value1, __m256d value2)
+        {
+            __m256d m;
+            if constexpr (OP == OperatorType::eEqual)
+                m = _mm256_cmp_pd(x, value1, _CMP_EQ_OQ);
+            else if constexpr (OP == OperatorType::eGreater)
+                m = _mm256_cmp_pd(x, value1, _CMP_GT_OQ);
+            else if constexpr (OP == OperatorType::eGreaterOrEq)
+                m = _mm256_cmp_pd(x, value1, _CMP_GE_OQ);
+            else if constexpr (OP == OperatorType::eLesser)
+                m = _mm256_cmp_pd(x, value1, _CMP_LT_OQ);
+            else if constexpr (OP == OperatorType::eLesserOrEq)
+                m = _mm256_cmp_pd(x, value1, _CMP_LE_OQ);
+            else if constexpr (OP == OperatorType::eInRange)
+                m = _mm256_and_pd(_mm256_cmp_pd(x, value1, _CMP_GE_OQ), _mm256_cmp_pd(x, value2, _CMP_LE_OQ));
+            else
+                m = _mm256_or_pd(_mm256_cmp_pd(x, value1, _CMP_LT_OQ), _mm256_cmp_pd(x, value2, _CMP_GT_OQ));
+            return _mm256_movemask_pd(m);
+        }
+
+        template <OperatorType OP>
+        __attribute__((target("avx2"))) void FilterInt64Avx2(const int64_t *data, size_t count, int64_t value1, int64_t value2, uint64_t *selection)
+        {
+            const __m256i v1 = _mm256_set1_epi64x(value1);
+            const __m256i v2 = _mm256_set1_epi64x(value2);
+            size_t full_words = count / 64;
+            for (size_t w = 0; w < full_words; w++)
+            {
+                if (selection[w] == 0)
+                    continue;
+                const int64_t *p = data + w * 64;
+                uint64_t bits = 0;
+                for (size_t k = 0; k < 16; k++)
+                {
+                    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + k * 4));
+                    bits |= (uint64_t)MaskInt64<OP>(x, v1, v2) << (k * 4);
+                }
+                selection[w] &= bits;
+            }
+            FilterScalar<int64_t, OP>(data, count, value1, value2, selection, full_words);
+        }
+
+        template <OperatorType OP>
+        __attribute__((target("avx2"))) void FilterDoubleAvx2(const double *data, size_t count, double value1, double value2, uint64_t *selection)
+        {
+            const __m256d v1 = _mm256_set1_pd(value1);
+            const __m256d v2 = _mm256_set1_pd(value2);
+            size_t full_words = count / 64;
+            for (size_t w = 0; w < full_words; w++)
+            {
+                if (selection[w] == 0)
+                    continue;
+                const double *p = data + w * 64;
+                uint64_t bits = 0;
+                for (size_t k = 0; k < 16; k++)
+                {
+                    __m256d x = _mm256_loadu_pd(p + k * 4);
+                    bits |= (uint64_t)MaskDouble<OP>(x, v1, v2) << (k * 4);
+                }
+                selection[w] &= bits;
+            }
+            FilterScalar<double, OP>(data, count, value1, value2, selection, full_words);
+        }
+
+        __attribute__((target("avx2"))) void FilterInInt64Avx2(const int64_t *data, size_t count, const std::vector<int64_t> &values, uint64_t *selection)
+        {
+            __m256i keys[MAX_SIMD_IN_VALUES];
+            size_t nkeys = values.size();
+            for (size_t i = 0; i < nkeys; i++)
+                keys[i] = _mm256_set1_epi64x(values[i]);
+
+            size_t full_words = count / 64;
+            for (size_t w = 0; w < full_words; w++)
+            {
+                if (selection[w] == 0)
+                    continue;
+                const int64_t *p = data + w * 64;
+                uint64_t bits = 0;
+                for (size_t k = 0; k < 16; k++)
+                {
+                    __m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i *>(p + k * 4));
+                    __m256i m = _mm256_setzero_si256();
+                    for (size_t i = 0; i < nkeys; i++)
+                        m = _mm256_or_si256(m, _mm256_cmpeq_epi64(x, keys[i]));
+                    bits |= (uint64_t)_mm256_movemask_pd(_mm256_castsi256_pd(m)) << (k * 4);
+                }
+                selection[w] &= bits;
+            }
+            FilterInScalar<int64_t>(data, count, values, selection, full_words);
+        }
+
+        __attribute__((target("avx2"))) void FilterInDoubleAvx2(const double *data, size_t count, const std::vector<double> &values, uint64_t *selection)
+        {
+            __m256d keys[MAX_SIMD_IN_VALUES];
+            size_t nkeys = values.size();
+            for (size_t i = 0; i < nkeys; i++)
+                keys[i] = _mm256_set1_pd(values[i]);
+
+            size_t full_words = count / 64;
+            for (size_t w = 0; w < full_words; w++)
+            {
+                if (selection[w] == 0)
+                    continue;
+                const double *p = data + w * 64;
+                uint64_t bits = 0;
+                for (size_t k = 0; k < 16; k++)
+                {
+                    __m256d x = _mm256_loadu_pd(p + k * 4);
+                    __m256d m = _mm256_setzero_pd();
+                    for (size_t i = 0; i < nkeys; i++)
+                        m = _mm256_or_pd(m, _mm256_cmp_pd(x, keys[i], _CMP_EQ_OQ));
+                    bits |= (uint64_t)_mm256_movemask_pd(m) << (k * 4);
+                }
+                selection[w] &= bits;
+            }
+            FilterInScalar<double>(data, count, values, selection, full_words);
+        }
+#endif
+
+        template <typename T, OperatorType OP>
+        void FilterOp(const T *data, size_t count, T value1, T value2, uint64_t *selection)
+        {
+#ifdef RURU_AVX2_KERNELS
+            if (UseAvx2())
+            {
+                if constexpr (std::is_same_v<T, int64_t>)
+                    FilterInt64Avx2<OP>(data, count, value1, value2, selection);
+                else
+                    FilterDoubleAvx2<OP>(data, count, value1, value2, selection);
+                return;
+            }
+#endif
+            FilterScalar<T, OP>(data, count, value1, value2, selection, 0);
+        }
+
+        template <typename T>
+        void FilterColumn(const T *data, size_t count, OperatorType oper, T value1, T value2, uint64_t *selection)
+        {
+            switch (oper)
+            {
+            case OperatorType::eEqual:
+                FilterOp<T, OperatorType::eEqual>(data, count, value1, value2, selection);
+                break;
+            case OperatorType::eGreater:
+                FilterOp<T, OperatorType::eGreater>(data, count, value1, value2, selection);
+                break;
+            case OperatorType::eGreaterOrEq:
+                FilterOp<T, OperatorType::eGreaterOrEq>(data, count, value1, value2, selection);
+                break;
+            case OperatorType::eLesser:
+                FilterOp<T, OperatorType::eLesser>(data, count, value1, value2, selection);
+                break;
+            case OperatorType::eLesserOrEq:
+                FilterOp<T, OperatorType::eLesserOrEq>(data, count, value1, value2, selection);
+                break;
+            case OperatorType::eInRange:
+                FilterOp<T, OperatorType::eInRange>(data, count, value1, value2, selection);
+                break;
+            case OperatorType::eOutRange:
+                FilterOp<T, OperatorType::eOutRange>(data, count, value1, value2, selection);
+                break;
+            default:
+                assert(false && "not a kernel operator");
+                break;
+            }
+        }
+    }
+
+    bool IsKernelOperator(OperatorType oper)
+    {
+        switch (oper)
+        {
+        case OperatorType::eEqual:
+        case OperatorType::eGreater:
+        case OperatorType::eGreaterOrEq:
+        case OperatorType::eLesser:
+        case OperatorType::eLesserOrEq:
+        case OperatorType::eInRange:
+        case OperatorType::eOutRange:
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    void FilterInt64(const int64_t *data, size_t count, OperatorType oper,
+                     int64_t value1, int64_t value2, uint64_t *selection)
+    {
+        FilterColumn<int64_t>(data, count, oper, value1, value2, selection);
+    }
+
+    void FilterDouble(const double *data, size_t count, OperatorType oper,
+                      double value1, double value2, uint64_t *selection)
+    {
+        FilterColumn<double>(data, count, oper, value1, value2, selection);
+    }
+
+    void FilterInInt64(const int64_t *data, size_t count, const std::vector<int64_t> &values, uint64_t *selection)
+    {
+        std::vector<int64_t> sorted(values);
+        std::sort(sorted.begin(), sorted.end());
+        sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+#ifdef RURU_AVX2_KERNELS
+        if (UseAvx2() && sorted.size() <= MAX_SIMD_IN_VALUES)
+            return FilterInInt64Avx2(data, count, sorted, selection);
+#endif
+        FilterInScalar<int64_t>(data, count, sorted, selection, 0);
+    }
+
+    void FilterInDouble(const double *data, size_t count, const std::vector<double> &values, uint64_t *selection)
+    {
+        // NaN is equal to nothing
+        std::vector<double> sorted;
+        for (double v : values)
+        {
+            if (v == v)
+                sorted.push_back(v);
+        }
+        std::sort(sorted.begin(), sorted.end());
+        sorted.erase(std::unique(sorted.begin(), sorted.end()), sorted.end());
+#ifdef RURU_AVX2_KERNELS
+        if (UseAvx2() && sorted.size() <= MAX_SIMD_IN_VALUES)
+            return FilterInDoubleAvx2(data, count, sorted, selection);
+#endif
+        FilterInScalar<double>(data, count, sorted, selection, 0);
+    }
+
+    bool HasAvx2Kernels()
+    {
+#ifdef RURU_AVX2_KERNELS
+        return UseAvx2();
+#else
+        return false;
+#endif
+    }
+}
@@ -0,0 +1,44 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef _H_RURU_SIMD_FILTER_HH_
+#define _H_RURU_SIMD_FILTER_HH_
+
+#include "ruru.h"
+
+namespace ruru::internal
+{
+    /*
+        filter kernels over contiguous column values
+
+        selection is a bitmap of count bits, bit i is row i
+        every kernel clears the bits of the rows that don't satisfy the filter,
+        words already cleared are skipped
+
+        comparisons: eEqual, eGreater, eGreaterOrEq, eLesser, eLesserOrEq compare
+        with value1, eInRange and eOutRange use [value1, value2]
+
+        AVX2 versions are selected at runtime when the cpu supports them
+    */
+
+    // true when the comparison operator is handled by the kernels
+    bool IsKernelOperator(OperatorType oper);
+
+    void FilterInt64(const int64_t *data, size_t count, OperatorType oper,
+                     int64_t value1, int64_t value2, uint64_t *selection);
+
+    void FilterDouble(const double *data, size_t count, OperatorType oper,
+                      double value1, double value2, uint64_t *selection);
+
+    // IN list, keeps the rows equal to one of the values
+    void FilterInInt64(const int64_t *data, size_t count, const std::vector<int64_t> &values, uint64_t *selection);
+
+    void FilterInDouble(const double *data, size_t count, const std::vector<double> &values, uint64_t *selection);
+
+    // true when the AVX2 kernels are used
+    bool HasAvx2Kernels();
+}
+
+#endif //_H_RURU_SIMD_FILTER_HH_
@@ -0,0 +1,290 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "ruru.h"
+#include "record.h"
+#include "internal/wal.h"
+#include "internal/RecordStream.h"
+#include "utils/memory_stream.h"
+
+namespace ruru::internal
+{
+    namespace
+    {
+        constexpr char LOG_MAGIC[8] = {'R', 'U', 'R', 'U', 'W', 'A', 'L', '1'};
+        constexpr size_t ENTRY_HEADER_SIZE = 2 * sizeof(uint32_t);
+
+        // crc32 (IEEE 802.3), detects the torn entry at the end of the log
+        uint32_t Crc32(const char *data, size_t len)
+        {
+            static const std::array<uint32_t, 256> table = []
+            {
+                std::array<uint32_t, 256> t{};
+                for (uint32_t i = 0; i < 256; i++)
+                {
+                    uint32_t c = i;
+                    for (int k = 0; k < 8; k++)
+                        c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+                    t[i] = c;
+                }
+                return t;
+            }();
+            uint32_t crc = 0xFFFFFFFFu;
+            for (size_t i = 0; i < len; i++)
+                crc = table[(crc ^ (uint8_t)data[i]) & 0xFF] ^ (crc >> 8);
+            return crc ^ 0xFFFFFFFFu;
+        }
+
+        // [u16 table name length][table name][encoded record]
+        void WriteTableRecord(MemoryWriter &stream, const std::string &table, const Record &record)
+        {
+            uint16_t name_len = table.size();
+            stream.write(reinterpret_cast<const char *>(&name_len), sizeof(name_len));
+            stream.write(table.data(), name_len);
+            RecordStream<MemoryWriter> rec_stream(stream);
+            rec_stream.Write(record);
+        }
+
+        bool ReadTableRecord(MemoryReader &stream, std::string &table, Record &record)
+        {
+            uint16_t name_len;
+            stream.read(reinterpret_cast<char *>(&name_len), sizeof(name_len));
+            if (stream.fail())
+                return false;
+            table.resize(name_len);
+            stream.read(table.data(), name_len);
+            RecordStream<MemoryReader> rec_stream(stream);
+            RecordId id = -1;
+            return !stream.fail() && rec_stream.Read(id, &record);
+        }
+    }
+
+    WriteAheadLog::WriteAheadLog(const std::string &path)
+        : file_(path), file_lsn_(0), next_lsn_(0), written_lsn_(0), durable_lsn_(0), flushing_(false)
+    {
+    }
+
+    bool WriteAheadLog::Open(bool truncate)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        if (!file_.Open(true))
+            return false;
+
+        char magic[sizeof(LOG_MAGIC)];
+        bool valid = file_.ReadAt(0, magic, sizeof(magic)) == sizeof(magic) &&
+                     memcmp(magic, LOG_MAGIC, sizeof(magic)) == 0;
+        if (truncate || !valid)
+        {
+            if (!file_.Truncate(0) || !file_.WriteAt(0, LOG_MAGIC, sizeof(LOG_MAGIC)))
+                return false;
+        }
+        next_lsn_ = written_lsn_ = durable_lsn_ = file_lsn_ + file_.GetSize();
+        return true;
+    }
+
+    uint64_t WriteAheadLog::Append(const std::string &table, const Record &record)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        size_t start = _BeginEntry(LogRecordType::eSave);
+        MemoryWriter stream(buffer_);
+        WriteTableRecord(stream, table, record);
+        return _EndEntry(lock, start);
+    }
+
+    uint64_t WriteAheadLog::AppendTransaction(const std::vector<std::pair<std::string, const Record *>> &records)
+    {
+        if (records.size() > UINT32_MAX)
+            return 0;
+        std::unique_lock<std::mutex> lock(mutex_);
+        size_t start = _BeginEntry(LogRecordType::eTransaction);
+        MemoryWriter stream(buffer_);
+        uint32_t count = records.size();
+        stream.write(reinterpret_cast<const char *>(&count), sizeof(count));
+        for (auto &&it : records)
+            WriteTableRecord(stream, it.first, *it.second);
+        return _EndEntry(lock, start);
+    }
+
+    size_t WriteAheadLog::_BeginEntry(LogRecordType type)
+    {
+        size_t start = buffer_.size();
+        // the header is filled once the body is encoded
+        buffer_.resize(start + ENTRY_HEADER_SIZE);
+        MemoryWriter stream(buffer_);
+        stream.write(reinterpret_cast<const char *>(&type), sizeof(type));
+        return start;
+    }
+
+    uint64_t WriteAheadLog::_EndEntry(std::unique_lock<std::mutex> &lock, size_t start)
+    {
+        uint64_t entry_size = buffer_.size() - start - ENTRY_HEADER_SIZE;
+        if (entry_size > MAX_ENTRY_SIZE)
+        {
+            buffer_.resize(start);
+            return 0;
+        }
+        uint32_t body_size = entry_size;
+        uint32_t crc = Crc32(buffer_.data() + start + ENTRY_HEADER_SIZE, body_size);
+        memcpy(buffer_.data() + start, &body_size, sizeof(body_size));
+        memcpy(buffer_.data() + start + sizeof(body_size), &crc, sizeof(crc));
+
+        next_lsn_ += ENTRY_HEADER_SIZE + body_size;
+        uint64_t lsn = next_lsn_;
+        if (buffer_.size() >= LOG_BUFFER_SIZE && !flushing_)
+            _Write(lock, false);
+        return lsn;
+    }
+
+    bool WriteAheadLog::Commit(uint64_t lsn)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (durable_lsn_ < lsn)
+        {
+            if (flushing_)
+            {
+                // another committer is writing, its sync may cover this entry
+                flushed_.wait(lock);
+                continue;
+            }
+            if (!_Write(lock, true))
+                return false;
+        }
+        return true;
+    }
+
+    bool WriteAheadLog::Write(uint64_t lsn)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        while (written_lsn_ < lsn)
+        {
+            if (flushing_)
+            {
+                flushed_.wait(lock);
+                continue;
+            }
+            if (!_Write(lock, false))
+                return false;
+        }
+        return true;
+    }
+
+    bool WriteAheadLog::_Write(std::unique_lock<std::mutex> &lock, bool sync)
+    {
+        // the committers arriving while the file is written fill the next buffer
+        flushing_ = true;
+        std::vector<char> pending;
+        pending.swap(buffer_);
+        uint64_t position = written_lsn_ - file_lsn_;
+        uint64_t end = next_lsn_;
+        lock.unlock();
+
+        bool ok = pending.empty() || file_.WriteAt(position, pending.data(), pending.size());
+        if (ok && sync)
+            ok = file_.Sync();
+
+        lock.lock();
+        if (ok)
+        {
+            written_lsn_ = end;
+            if (sync)
+                durable_lsn_ = end;
+        }
+        else
+        {
+            // keep the entries in front of the ones appended in the meantime
+            pending.insert(pending.end(), buffer_.begin(), buffer_.end());
+            buffer_.swap(pending);
+        }
+        // the buffer is reused by the next append
+        if (buffer_.empty() && pending.capacity() <= LOG_BUFFER_SIZE * 2)
+        {
+            pending.clear();
+            buffer_.swap(pending);
+        }
+        flushing_ = false;
+        flushed_.notify_all();
+        return ok;
+    }
+
+    uint64_t WriteAheadLog::GetSize()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        return next_lsn_ - file_lsn_;
+    }
+
+    bool WriteAheadLog::Checkpoint()
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        flushed_.wait(lock, [this]
+                      { return !flushing_; });
+        // the tables hold all the logged changes
+        buffer_.clear();
+        if (!file_.Truncate(sizeof(LOG_MAGIC)) || !file_.Sync())
+            return false;
+        // the entries logged so far are durable in the tables, the next one
+        // is written after the magic
+        written_lsn_ = durable_lsn_ = next_lsn_;
+        file_lsn_ = next_lsn_ - sizeof(LOG_MAGIC);
+        return true;
+    }
+
+    bool WriteAheadLog::Read(const std::function<void(const std::string &table, Record &record)> &apply)
+    {
+        std::unique_lock<std::mutex> lock(mutex_);
+        flushed_.wait(lock, [this]
+                      { return !flushing_; });
+
+        uint64_t position = sizeof(LOG_MAGIC);
+        uint64_t size = file_.GetSize();
+        std::vector<char> body;
+        std::vector<std::pair<std::string, Record>> records;
+        while (position + ENTRY_HEADER_SIZE <= size)
+        {
+            uint32_t header[2];
+            if (file_.ReadAt(position, reinterpret_cast<char *>(header), sizeof(header)) != sizeof(header))
+                break;
+            uint32_t body_size = header[0];
+            if (body_size > size - position - ENTRY_HEADER_SIZE)
+                break;
+            body.resize(body_size);
+            if (file_.ReadAt(position + ENTRY_HEADER_SIZE, body.data(), body_size) != body_size ||
+                Crc32(body.data(), body_size) != header[1])
+                break;
+
+            MemoryReader stream(body.data(), body_size);
+            LogRecordType type;
+            uint32_t count = 1;
+            stream.read(reinterpret_cast<char *>(&type), sizeof(type));
+            if (stream.fail())
+                break;
+            if (type == LogRecordType::eTransaction)
+                stream.read(reinterpret_cast<char *>(&count), sizeof(count));
+            else if (type != LogRecordType::eSave)
+                break;
+            if (stream.fail() || count > body_size)
+                break;
+
+            // the records of the entry are decoded before any is applied
+            records.resize(count);
+            bool ok = true;
+            for (uint32_t i = 0; i < count && ok; i++)
+                ok = ReadTableRecord(stream, records[i].first, records[i].second);
+            if (!ok)
+                break;
+
+            for (auto &&it : records)
+                apply(it.first, it.second);
+            position += ENTRY_HEADER_SIZE + body_size;
+        }
+
+        // the next entries are appended after the last complete one
+        if (position < size && !file_.Truncate(position))
+            return false;
+        buffer_.clear();
+        next_lsn_ = written_lsn_ = durable_lsn_ = file_lsn_ + position;
+        return true;
+    }
+}
@@ -0,0 +1,124 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef _H_RURU_WAL_HH_
+#define _H_RURU_WAL_HH_
+
+#include "ruru.h"
+#include "file_handle.h"
+
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+namespace ruru
+{
+    struct Record;
+}
+
+namespace ruru::internal
+{
+    // kind of a log entry
+    enum class LogRecordType : uint8_t
+    {
+        // full image of a saved record
+        eSave = 1,
+        // full images of the records of a transaction
+        eTransaction = 2
+    };
+
+    /*
+        \class WriteAheadLog
+        \brief redo log shared by the tables of a database
+               saves append entries to an in memory log buffer, the buffer is written
+               when it is full or when a commit asks for it. A commit waits until its
+               entry is on disk: the first waiting committer writes and syncs the whole
+               buffer for all the others (group commit).
+               Once the tables are flushed the log is restarted by Checkpoint.
+               the log sequence numbers keep growing across checkpoints: an entry
+               covered by a checkpoint counts as durable.
+
+               file:  [magic "RURUWAL1"] [entry] [entry] ...
+               entry: [u32 body size][u32 crc32 of body][body]
+               body:  [u8 eSave][record]
+                      [u8 eTransaction][u32 count][record] ... count times
+               record: [u16 table name length][table name][encoded record]
+               the records of a transaction are replayed all together, or not at all
+    */
+    class WriteAheadLog
+    {
+    public:
+        // the buffer is written without waiting for a commit when it grows over this size
+        static constexpr size_t LOG_BUFFER_SIZE = 1024 * 1024;
+        // the database checkpoints the tables when the log grows over this size
+        static constexpr uint64_t CHECKPOINT_SIZE = 64 * 1024 * 1024;
+        // the size of an entry body is stored on 32 bits, larger entries are rejected
+        static constexpr uint64_t MAX_ENTRY_SIZE = UINT32_MAX;
+        // largest encoded record a save entry holds, whatever the length of the table name
+        static constexpr uint64_t MAX_RECORD_SIZE = MAX_ENTRY_SIZE - 0x10000 - 16;
+
+        WriteAheadLog(const std::string &path);
+        WriteAheadLog(const WriteAheadLog &) = delete;
+        WriteAheadLog &operator=(const WriteAheadLog &) = delete;
+
+        // open the log file, create it when needed
+        // truncate drops the entries of a previous session
+        bool Open(bool truncate);
+
+        // add the image of a saved record to the log buffer
+        // returns the log sequence number to commit, the end of the entry in the log
+        // returns 0 when the entry is larger than MAX_ENTRY_SIZE, nothing is added
+        uint64_t Append(const std::string &table, const Record &record);
+
+        // add the images of the records of a transaction to the log buffer, as one entry
+        // returns 0 when the entry is larger than MAX_ENTRY_SIZE, nothing is added
+        uint64_t AppendTransaction(const std::vector<std::pair<std::string, const Record *>> &records);
+
+        // wait until the log is on disk up to lsn
+        bool Commit(uint64_t lsn);
+
+        // write the log up to lsn, without waiting for the sync
+        bool Write(uint64_t lsn);
+
+        // size of the log, buffered entries included
+        uint64_t GetSize();
+
+        // the tables are flushed: restart the log
+        bool Checkpoint();
+
+        // call apply on every entry of the log, in log order
+        // the entries following a torn or corrupted entry are dropped from the file
+        bool Read(const std::function<void(const std::string &table, Record &record)> &apply);
+
+    private:
+        FileHandle file_;
+        std::mutex mutex_;
+        std::condition_variable flushed_;
+        // entries not yet written
+        std::vector<char> buffer_;
+        // log sequence number of the start of the file, moved forward by Checkpoint
+        uint64_t file_lsn_;
+        // end of the last appended entry
+        uint64_t next_lsn_;
+        // the log is written, and synced, up to these log sequence numbers
+        uint64_t written_lsn_;
+        uint64_t durable_lsn_;
+        // a committer is writing the log
+        bool flushing_;
+
+        // write the buffer, sync the file when asked to
+        // the lock is released during the file operations
+        bool _Write(std::unique_lock<std::mutex> &lock, bool sync);
+
+        // start an entry in the buffer, returns its offset in the buffer
+        size_t _BeginEntry(LogRecordType type);
+
+        // fill the header of the entry started at start, returns its log sequence number
+        // an entry too large for its header is dropped from the buffer, returns 0
+        uint64_t _EndEntry(std::unique_lock<std::mutex> &lock, size_t start);
+    };
+}
+
+#endif //_H_RURU_WAL_HH_
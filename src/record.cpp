@@ -13,10 +13,88 @@ namespace ruru
     // Field
 
     Field::Field()
-        :  type_(DataTypes::eUnknown), value_(nullptr)
+        :  type_(DataTypes::eUnknown), storage_(Storage::eEmpty)
     {
     }
 
+    Field::Field(const Field &other)
+        : type_(other.type_), storage_(Storage::eEmpty)
+    {
+        *this = other;
+    }
+
+    Field::Field(Field &&other) noexcept
+        : type_(other.type_), storage_(Storage::eEmpty)
+    {
+        *this = std::move(other);
+    }
+
+    Field &Field::operator=(const Field &other)
+    {
+        if (this == &other)
+            return *this;
+        Clear();
+        type_ = other.type_;
+        if (other.storage_ == Storage::eInline)
+            memcpy(inline_, other.inline_, INLINE_SIZE);
+        else if (other.storage_ == Storage::eShared)
+            new (&shared_) std::shared_ptr<char>(other.shared_);
+        storage_ = other.storage_;
+        return *this;
+    }
+
+    Field &Field::operator=(Field &&other) noexcept
+    {
+        if (this == &other)
+            return *this;
+        Clear();
+        type_ = other.type_;
+        if (other.storage_ == Storage::eInline)
+            memcpy(inline_, other.inline_, INLINE_SIZE);
+        else if (other.storage_ == Storage::eShared)
+            new (&shared_) std::shared_ptr<char>(std::move(other.shared_));
+        storage_ = other.storage_;
+        other.Clear();
+        return *this;
+    }
+
+    char *Field::Allocate(size_t size, Arena &arena)
+    {
+        Clear();
+        if (size <= INLINE_SIZE)
+        {
+            storage_ = Storage::eInline;
+            return inline_;
+        }
+        new (&shared_) std::shared_ptr<char>(arena.Allocate(size));
+        storage_ = Storage::eShared;
+        return shared_.get();
+    }
+
+    void Field::Clear()
+    {
+        if (storage_ == Storage::eShared)
+            shared_.~shared_ptr<char>();
+        storage_ = Storage::eEmpty;
+    }
+
+    std::shared_ptr<char> Field::Share() const
+    {
+        switch (storage_)
+        {
+        case Storage::eShared:
+            return shared_;
+        case Storage::eInline:
+        {
+            std::shared_ptr<char> copy(new char[INLINE_SIZE], std::default_delete<char[]>());
+            memcpy(copy.get(), inline_, INLINE_SIZE);
+            return copy;
+        }
+        default:
+            return nullptr;
+        }
+    }
+
     void Field::Reset()
     {
         switch (type_)
@@ -41,18 +119,23 @@ namespace ruru
 
     std::size_t Field::GetHash() const
     {
-        if ( value_ == nullptr)
+        if (IsNull())
             return 0;
+        const char *data = Data();
         switch (type_)
         {
         case DataTypes::eInteger:
-            return std::hash<uint64_t>{}(reinterpret_cast<uint64_t>(value_.get()));
+            return std::hash<int64_t>{}(*reinterpret_cast<const int64_t *>(data));
 
         case DataTypes::eDouble:
-            return std::hash<double>{}(*reinterpret_cast<double *>(value_.get()));
+            return std::hash<double>{}(*reinterpret_cast<const double *>(data));
 
         case DataTypes::eVarChar:
-            return std::hash<std::string>{}(std::string(value_.get()));
+        {
+            // length-prefixed string
+            uint64_t len = *reinterpret_cast<const uint64_t *>(data);
+            return std::hash<std::string_view>{}(std::string_view(data + sizeof(len), len));
+        }
             // missing eBinary, until implementation of binary vector
 
         default:
@@ -62,10 +145,16 @@ namespace ruru
     }
     Field::~Field()
     {
+        Clear();
     }
     // Record
 
     const std::string Record::GetKey() const
+    {
+        return std::to_string(GetHash());
+    }
+
+    uint64_t Record::GetHash() const
     {
         // calculate a key
         std::size_t seed = fields_.size();
@@ -73,7 +162,7 @@ namespace ruru
         {
             seed ^= std::hash<size_t>{}(v.GetHash()) + 0x9e3779b9 + (seed << 6) + (seed >> 2);
         }
-        return std::to_string(seed);
+        return seed;
     }
 
     const RecordLength_t Record::GetRowSize() const
@@ -82,6 +171,9 @@ namespace ruru
         for (auto &&it : fields_)
         {
             len += sizeof(it.type_);
+            // a field without value is written as a single eNull tag
+            if (it.IsNull())
+                continue;
             switch (it.type_)
             {
             case DataTypes::eInteger:
@@ -94,8 +186,7 @@ namespace ruru
             case DataTypes::eBinary:
             {
                 len += sizeof(uint64_t);
-                if( it.value_ != nullptr)
-                    len += *(reinterpret_cast<uint64_t *>(it.value_.get()));
+                len += *(reinterpret_cast<const uint64_t *>(it.Data()));
                 break;
             }
             case DataTypes::eNull:
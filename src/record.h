@@ -1,20 +1,74 @@
 #ifndef _H_RECORD__HH_
 #define _H_RECORD__HH_
 
+#include "utils/arena.h"
+
 namespace ruru
 {
     
+    /*
+        \class Field
+        \brief typed value of a record column
+               integers, doubles and varchar up to INLINE_SIZE bytes, length included,
+               are stored in the field itself. Larger payloads are allocated out of line,
+               usually in the arena of the record.
+    */
     struct Field
     {
+        static constexpr size_t INLINE_SIZE = 24;
+
         Field();
+        Field(const Field &other);
+        Field(Field &&other) noexcept;
+        Field &operator=(const Field &other);
+        Field &operator=(Field &&other) noexcept;
         DataTypes type_;
-        std::shared_ptr<char> value_;
         std::size_t GetHash() const;
         template <typename T>
         void SetValue(const T &value);
+        // the payload is allocated in arena, usually the arena of the record
+        template <typename T>
+        void SetValue(const T &value, Arena &arena);
         void Reset();
         ~Field();
         const RecordLength_t GetSize() const;
+
+        // the field holds no value
+        bool IsNull() const { return storage_ == Storage::eEmpty; }
+        // payload bytes, nullptr when the field holds no value
+        const char *Data() const { return const_cast<Field *>(this)->Data(); }
+        char *Data()
+        {
+            switch (storage_)
+            {
+            case Storage::eInline:
+                return inline_;
+            case Storage::eShared:
+                return shared_.get();
+            default:
+                return nullptr;
+            }
+        }
+        // room for size payload bytes, inline when they fit, in arena otherwise
+        char *Allocate(size_t size, Arena &arena);
+        // drop the payload
+        void Clear();
+        // the payload as a shared buffer, inline payloads are copied
+        std::shared_ptr<char> Share() const;
+
+    private:
+        enum class Storage : uint8_t
+        {
+            eEmpty,
+            eInline,
+            eShared
+        };
+        Storage storage_;
+        union
+        {
+            alignas(8) char inline_[INLINE_SIZE];
+            std::shared_ptr<char> shared_;
+        };
     };
 
     struct Record
@@ -24,7 +78,10 @@ namespace ruru
         RecordId row_id_;
         std::vector<Field> fields_;
         std::map<std::string, SaveCallback_t> callbacks_map_;
+        // storage of the field payloads
+        Arena arena_;
         const std::string GetKey() const;
+        uint64_t GetHash() const;
 
         Record() : row_id_(-1){};
         Record(std::initializer_list<Field> init)
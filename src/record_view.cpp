@@ -0,0 +1,172 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "ruru.h"
+#include "record_view.h"
+#include "internal/RecordStream.h"
+#include "utils/memory_stream.h"
+
+namespace ruru
+{
+    namespace
+    {
+        // size of the header: row id and number of fields
+        constexpr size_t HEADER_SIZE = sizeof(RecordId) + sizeof(uint64_t);
+    }
+
+    RecordView::RecordView()
+        : row_id_(-1), data_(nullptr), size_(0), field_nbr_(0), end_(0), truncated_(false)
+    {
+    }
+
+    bool RecordView::Reset(const char *data, size_t size, std::shared_ptr<const char> owner)
+    {
+        data_ = nullptr;
+        size_ = 0;
+        field_nbr_ = 0;
+        offsets_.clear();
+        end_ = HEADER_SIZE;
+        truncated_ = false;
+        owner_ = std::move(owner);
+        if (data == nullptr || size < HEADER_SIZE)
+            return false;
+
+        uint64_t field_nbr;
+        memcpy(&row_id_, data, sizeof(row_id_));
+        memcpy(&field_nbr, data + sizeof(RecordId), sizeof(field_nbr));
+        // column indexes are 16 bits, anything bigger is not a record
+        if (field_nbr > internal::MAX_FIELDS_PER_RECORD)
+            return false;
+
+        data_ = data;
+        size_ = size;
+        field_nbr_ = field_nbr;
+        return true;
+    }
+
+    bool RecordView::_Reach(uint64_t i) const
+    {
+        if (i >= field_nbr_)
+            return false;
+        while (offsets_.size() <= i)
+        {
+            if (truncated_)
+                return false;
+
+            size_t offset = end_;
+            size_t next = offset + sizeof(DataTypes);
+            if (next > size_)
+            {
+                truncated_ = true;
+                return false;
+            }
+            switch (static_cast<DataTypes>(data_[offset]))
+            {
+            case DataTypes::eNull:
+                break;
+            case DataTypes::eInteger:
+                next += sizeof(int64_t);
+                break;
+            case DataTypes::eDouble:
+                next += sizeof(double);
+                break;
+            case DataTypes::eVarChar:
+            {
+                uint64_t len;
+                if (next + sizeof(len) > size_)
+                {
+                    truncated_ = true;
+                    return false;
+                }
+                memcpy(&len, data_ + next, sizeof(len));
+                if (len > size_)
+                {
+                    truncated_ = true;
+                    return false;
+                }
+                next += sizeof(len) + len;
+                break;
+            }
+                // missing eBinary, until implementation of binary vector
+            default:
+                truncated_ = true;
+                return false;
+            }
+            if (next > size_)
+            {
+                truncated_ = true;
+                return false;
+            }
+            offsets_.push_back(offset);
+            end_ = next;
+        }
+        return true;
+    }
+
+    DataTypes RecordView::GetType(uint64_t i) const
+    {
+        if (i >= field_nbr_)
+            return DataTypes::eNull;
+        if (!_Reach(i))
+            return DataTypes::eUnknown;
+        return static_cast<DataTypes>(data_[offsets_[i]]);
+    }
+
+    const char *RecordView::GetData(uint64_t i) const
+    {
+        DataTypes type = GetType(i);
+        if (type == DataTypes::eNull || type == DataTypes::eUnknown)
+            return nullptr;
+        return data_ + offsets_[i] + sizeof(DataTypes);
+    }
+
+    bool RecordView::GetValue(uint64_t i, int64_t &value) const
+    {
+        if (GetType(i) != DataTypes::eInteger)
+            return false;
+        memcpy(&value, GetData(i), sizeof(value));
+        return true;
+    }
+
+    bool RecordView::GetValue(uint64_t i, double &value) const
+    {
+        if (GetType(i) != DataTypes::eDouble)
+            return false;
+        memcpy(&value, GetData(i), sizeof(value));
+        return true;
+    }
+
+    bool RecordView::GetValue(uint64_t i, std::string_view &value) const
+    {
+        if (GetType(i) != DataTypes::eVarChar)
+            return false;
+        const char *data = GetData(i);
+        uint64_t len;
+        memcpy(&len, data, sizeof(len));
+        value = std::string_view(data + sizeof(len), len);
+        return true;
+    }
+
+    RecordLength_t RecordView::GetLength() const
+    {
+        if (data_ == nullptr)
+            return 0;
+        if (field_nbr_ > 0 && !_Reach(field_nbr_ - 1))
+            return 0;
+        return end_;
+    }
+
+    bool RecordView::Materialize(Record &rec) const
+    {
+        RecordLength_t length = GetLength();
+        if (length == 0)
+            return false;
+        MemoryReader stream(data_, length);
+        internal::RecordStream<MemoryReader> rec_stream(stream);
+        RecordId id = -1;
+        return rec_stream.Read(id, &rec);
+    }
+}
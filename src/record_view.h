@@ -0,0 +1,70 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef _H_RECORD_VIEW__HH_
+#define _H_RECORD_VIEW__HH_
+
+#include "record.h"
+
+namespace ruru
+{
+    /*
+        \class RecordView
+        \brief read-only record decoded in place from its encoded bytes
+               nothing is copied: the offsets of the fields are computed on the
+               first access to a field, values point into the encoded bytes.
+               The owner keeps the bytes alive, usually the mapping of the data file.
+    */
+    class RecordView
+    {
+    public:
+        RecordId row_id_;
+
+        RecordView();
+
+        // start a view on the record encoded at data, the header is checked
+        // returns false when data does not start with a record
+        bool Reset(const char *data, size_t size, std::shared_ptr<const char> owner = nullptr);
+
+        uint64_t GetFieldCount() const { return field_nbr_; }
+
+        // type of the field, eNull for a null or a missing field
+        // eUnknown when the field can't be decoded
+        DataTypes GetType(uint64_t i) const;
+
+        // payload of the field, nullptr for a null or a missing field
+        const char *GetData(uint64_t i) const;
+
+        bool IsNull(uint64_t i) const { return GetData(i) == nullptr; }
+
+        bool GetValue(uint64_t i, int64_t &value) const;
+        bool GetValue(uint64_t i, double &value) const;
+        // the string points into the encoded bytes
+        bool GetValue(uint64_t i, std::string_view &value) const;
+
+        // length of the encoded record, 0 when it is truncated
+        RecordLength_t GetLength() const;
+
+        // copy of the record
+        bool Materialize(Record &rec) const;
+
+    private:
+        const char *data_;
+        size_t size_;
+        std::shared_ptr<const char> owner_;
+        uint64_t field_nbr_;
+        // offset of the type tag of the fields decoded so far
+        mutable std::vector<size_t> offsets_;
+        // offset following the last decoded field
+        mutable size_t end_;
+        // a field crosses the end of the bytes
+        mutable bool truncated_;
+
+        // decode the offsets up to field i, false when it can't be reached
+        bool _Reach(uint64_t i) const;
+    };
+}
+
+#endif //_H_RECORD_VIEW__HH_
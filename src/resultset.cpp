@@ -9,42 +9,85 @@
 namespace ruru
 {
     ResultSet::ResultSet(const Filters_t &filters)
-        : filters_(filters), iter_(-1)
+        : filters_(filters), batch_start_(0), exhausted_(false), iter_(-1), size_(-1)
     {
     }
 
+    bool ResultSet::_NextBatch()
+    {
+        if (exhausted_)
+            return false;
+        size_t max = batch_start_ == 0 && batch_.empty() ? FIRST_BATCH_SIZE : BATCH_SIZE;
+        batch_start_ += batch_.size();
+        batch_.clear();
+        table_->_FetchBatch(*cursor_, max, batch_);
+        // a batch shorter than asked is the last one
+        if (batch_.size() < max)
+        {
+            exhausted_ = true;
+            size_ = batch_start_ + batch_.size();
+        }
+        return !batch_.empty();
+    }
+
+    RecordTablePtr ResultSet::_Current()
+    {
+        while (iter_ >= batch_start_ + (int64_t)batch_.size())
+        {
+            if (!_NextBatch())
+                return nullptr;
+        }
+        return batch_[iter_ - batch_start_];
+    }
+
     std::shared_ptr<RecordTable> ResultSet::First()
     {
-        RecordTablePtr rec(nullptr);
         iter_ = 0;
-        if (!Eof())
+        // the first batch is gone, the records found by the search are read again from the start
+        if (batch_start_ > 0)
         {
-            rec = table_->GetRecord(records_id_[iter_]) ;
+            cursor_ = cursor_->Clone();
+            batch_.clear();
+            batch_start_ = 0;
+            exhausted_ = false;
         }
-        return rec;
+        return _Current();
     }
 
     bool ResultSet::Eof()
     {
-        if (iter_ >= (int64_t)records_id_.size())
-            return true;
-        return false;
+        if (iter_ < 0)
+            return false;
+        return _Current() == nullptr;
     }
 
     std::shared_ptr<RecordTable> ResultSet::Next()
     {
-        RecordTablePtr rec(nullptr);
         iter_++;
-        if (!Eof())
-        {
-            rec  = table_->GetRecord(records_id_[iter_]) ;
-        }
-        return rec;
+        return _Current();
     }
 
     int64_t         ResultSet::GetSize()
     {
-        return records_id_.size();
+        if (size_ >= 0)
+            return size_;
+        // a result set held by the first batch is counted without a second read
+        if (batch_start_ == 0 && batch_.empty())
+            _NextBatch();
+        if (size_ >= 0)
+            return size_;
+
+        // the records found by the search are counted on a cursor of their own, batch by batch
+        RecordCursorPtr cursor = cursor_->Clone();
+        std::vector<RecordTablePtr> batch;
+        int64_t count = 0;
+        while (table_->_FetchBatch(*cursor, BATCH_SIZE, batch))
+        {
+            count += batch.size();
+            batch.clear();
+        }
+        size_ = count;
+        return size_;
     }
 
-}
\ No newline at end of file
+}
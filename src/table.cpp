@@ -6,10 +6,20 @@
 #include "pch.h"
 #include "ruru.h"
 #include "record.h"
+#include "record_view.h"
 #include "database.h"
+#include "version_clock.h"
+#include "internal/importer.h"
+#include "internal/record_cursor.h"
+#include "internal/wal.h"
 
 namespace ruru
 {
+    namespace
+    {
+        // BulkInsert commits a transaction once its records reach this size
+        constexpr size_t BULK_INSERT_TRANSACTION_SIZE = 64 * 1024 * 1024;
+    }
 
     Column::Column(std::string name, DataTypes type, bool isPrimaryKey, bool isNullable, bool isAutoIncrement) : name(std::move(name)), type(type), isPrimaryKey(isPrimaryKey), isNullable(isNullable), isAutoIncrement(isAutoIncrement)
     {
@@ -44,8 +54,20 @@ namespace ruru
 
     void Table::addColumn(const Column &col)
     {
+        auto db_shared = database.lock();
+        Database *db = dynamic_cast<Database *>(db_shared.get());
+        IStorageEngine *store = db != nullptr ? db->getStorageEngine(getName()) : nullptr;
+        if (store == nullptr)
+        {
+            columns.push_back(col);
+            columns_name_to_index[col.getName()] = columns.size() - 1;
+            return;
+        }
+        // the storage engine may store the values of the column by type
+        std::unique_lock<std::shared_mutex> latch(db->getTableLatch(getName()));
         columns.push_back(col);
         columns_name_to_index[col.getName()] = columns.size() - 1;
+        store->SetColumnType(columns.size() - 1, col.getType());
     }
     // Getting column index by name
     int
@@ -81,23 +103,59 @@ namespace ruru
     void Table::addIndex(const std::string &col_name, const std::string &index_name)
     {
         auto index = getColumnIndex(col_name);
+        if (index == -1)
+            return;
+        auto db_shared = database.lock();
+        Database *db = dynamic_cast<Database *>(db_shared.get());
+        if (db == nullptr)
+        {
+            indices[std::make_pair(index_name, col_name)] = index;
+            return;
+        }
+        // the storage engine builds the index, or opens it when it is already persisted
+        // the readers of the table wait for the index to be built
+        IStorageEngine *store = db->getStorageEngine(getName());
+        std::unique_lock<std::shared_mutex> latch(db->getTableLatch(getName()));
         indices[std::make_pair(index_name, col_name)] = index;
+        if (store != nullptr)
+            store->CreateIndex(index_name, index, columns[index].getType());
     }
 
     // Getting index by name
     int Table::getIndex(const std::string &index_name) const
     {
-        auto it = indices.find(std::make_pair(index_name, index_name));
-        if (it == indices.end())
-            return -1;
-        else
-            return it->second;
+        for (auto &&it : indices)
+        {
+            if (it.first.first == index_name)
+                return it.second;
+        }
+        return -1;
     }
 
     // Removing index by name
     void Table::removeIndex(const std::string &index_name)
     {
-        indices.erase(std::make_pair(index_name, index_name));
+        auto db_shared = database.lock();
+        Database *db = dynamic_cast<Database *>(db_shared.get());
+        IStorageEngine *store = nullptr;
+        std::unique_lock<std::shared_mutex> latch;
+        if (db != nullptr)
+        {
+            store = db->getStorageEngine(getName());
+            latch = std::unique_lock<std::shared_mutex>(db->getTableLatch(getName()));
+        }
+
+        for (auto it = indices.begin(); it != indices.end(); ++it)
+        {
+            if (it->first.first == index_name)
+            {
+                indices.erase(it);
+                break;
+            }
+        }
+
+        if (store != nullptr)
+            store->DropIndex(index_name);
     }
 
     RecordTablePtr Table::CreateRecord()
@@ -123,6 +181,13 @@ namespace ruru
         return rectbl;
     }
 
+    RecordTablePtr Table::_CreateRecordTableFromView(RecordView *view)
+    {
+        RecordTablePtr rectbl(new RecordTable(this, view));
+        rectbl->type = RecordType::eModifyed;
+        return rectbl;
+    }
+
     ResultSetPtr Table::Search(const Filters_t &filters)
     {
         auto db_shared = database.lock();
@@ -132,14 +197,62 @@ namespace ruru
         ResultSetPtr result(new ResultSet(filters));
         result->table_ = this;
 
-        // apply the search in the StorageEngine and retrieve list of record Id
+        // the search opens a cursor in the StorageEngine, the records are read as the result set is iterated
+        // searches of the table run together, a writer waits for them
+        // the catalog is read before the table is latched
         IStorageEngine *store = db->getStorageEngine(getName());
-        auto rows = store->Lookup(filters);
-        result->records_id_ = rows;
+        std::shared_lock<std::shared_mutex> latch(db->getTableLatch(getName()));
+        // no writer of the table is running: the snapshot matches the rows found
+        result->snapshot_ = db->pinSnapshot();
+        result->cursor_ = store->OpenCursor(filters, *result->snapshot_);
+        if (result->cursor_ == nullptr)
+            result->cursor_.reset(new internal::IdListCursor(store, store->Lookup(filters), *result->snapshot_));
         return result;
     }
 
+    RecordCursorPtr Table::_OpenCursor(const Filters_t &filters, uint64_t snapshot)
+    {
+        auto db_shared = database.lock();
+        Database *db = dynamic_cast<Database *>(db_shared.get());
+        assert(db != nullptr);
+
+        IStorageEngine *store = db->getStorageEngine(getName());
+        std::shared_lock<std::shared_mutex> latch(db->getTableLatch(getName()));
+        RecordCursorPtr cursor = store->OpenCursor(filters, snapshot);
+        if (cursor == nullptr)
+            cursor.reset(new internal::IdListCursor(store, store->Lookup(filters), snapshot));
+        return cursor;
+    }
+
+    bool Table::_FetchBatch(IRecordCursor &cursor, size_t max, std::vector<RecordTablePtr> &batch)
+    {
+        auto db_shared = database.lock();
+        Database *db = dynamic_cast<Database *>(db_shared.get());
+        assert(db != nullptr);
+
+        std::vector<CursorRecord> records;
+        {
+            // the cursor reads the storage with the table latched, the records are wrapped after
+            std::shared_lock<std::shared_mutex> latch(db->getTableLatch(getName()));
+            cursor.NextBatch(records, max);
+        }
+        batch.reserve(batch.size() + records.size());
+        for (auto &&rec : records)
+        {
+            if (rec.view != nullptr)
+                batch.push_back(_CreateRecordTableFromView(rec.view.release()));
+            else
+                batch.push_back(_CreateRecordTableFromRec(rec.record.release()));
+        }
+        return !records.empty();
+    }
+
     RecordTablePtr Table::GetRecord(RecordId id)
+    {
+        return _GetRecord(id, nullptr);
+    }
+
+    RecordTablePtr Table::_GetRecord(RecordId id, const uint64_t *snapshot)
     {
         // id is internal ID ( rowid)
         auto db_shared = getDatabase().lock();
@@ -147,8 +260,17 @@ namespace ruru
         assert(db != nullptr);
 
         RecordTablePtr rectable = nullptr;
+        // the catalog is read before the table is latched
         IStorageEngine *store = db->getStorageEngine(getName());
-        Record *rec = store->LoadRecord(id);
+        std::shared_lock<std::shared_mutex> latch(db->getTableLatch(getName()));
+        // the stored record is read in place when the engine allows it
+        // without a snapshot the current version is read
+        RecordView *view = new RecordView();
+        if (snapshot != nullptr ? store->LoadRecordView(id, *snapshot, *view) : store->LoadRecordView(id, *view))
+            return _CreateRecordTableFromView(view);
+        delete view;
+
+        Record *rec = snapshot != nullptr ? store->LoadRecord(id, *snapshot) : store->LoadRecord(id);
         if (rec != nullptr)
         {
             rectable = _CreateRecordTableFromRec(rec);
@@ -156,17 +278,108 @@ namespace ruru
         return rectable;
     }
 
+    bool Table::BulkInsert(const std::vector<RecordTablePtr> &records)
+    {
+        auto db = database.lock();
+        if (db == nullptr)
+            return false;
+        // only new records of this table
+        for (auto &&rec : records)
+        {
+            if (rec == nullptr || rec->table != this || rec->type != RecordType::eNew)
+                return false;
+        }
+        // every transaction is one log entry, a large batch is inserted by several of them
+        size_t next = 0;
+        do
+        {
+            auto tx = db->beginTransaction();
+            size_t size = 0;
+            while (next < records.size() && size < BULK_INSERT_TRANSACTION_SIZE)
+            {
+                records[next]->_Materialize();
+                size += records[next]->record->GetRowSize();
+                tx->save(records[next++]);
+            }
+            if (!tx->commit())
+                return false;
+        } while (next < records.size());
+        return true;
+    }
+
+    bool Table::Import(const std::filesystem::path &path, const ImportOptions &options, ImportResult *result)
+    {
+        ImportResult local;
+        ImportResult &res = result != nullptr ? *result : local;
+        res = ImportResult();
+        return internal::ImportFile(path, columns, options, [this](std::vector<std::unique_ptr<Record>> &records)
+                                    {
+                                        std::vector<RecordTablePtr> batch;
+                                        batch.reserve(records.size());
+                                        for (auto &&rec : records)
+                                        {
+                                            RecordTablePtr rectbl(new RecordTable(this, rec.release()));
+                                            rectbl->type = RecordType::eNew;
+                                            batch.push_back(rectbl);
+                                        }
+                                        return BulkInsert(batch); },
+                                    res);
+    }
+
     // RecordTable
 
     RecordTable::RecordTable(Table *tbl, Record *rec)
-        : table(tbl), record(rec)
+        : table(tbl), record(rec), view(nullptr)
     {
     }
+
+    RecordTable::RecordTable(Table *tbl, RecordView *view)
+        : table(tbl), record(nullptr), view(view)
+    {
+    }
+
+    void RecordTable::_Materialize()
+    {
+        if (view == nullptr)
+            return;
+        record = new Record();
+        view->Materialize(*record);
+        delete view;
+        view = nullptr;
+    }
+
+    bool RecordTable::_GetField(const std::string &field_name, DataTypes &type, const char *&data) const
+    {
+        int i = table->getColumnIndex(field_name);
+        if (i == -1)
+        {
+            return false;
+        }
+        if (view != nullptr)
+        {
+            type = view->GetType(i);
+            data = view->GetData(i);
+            return type != DataTypes::eUnknown;
+        }
+        // a record shorter than the table has nulls in the last columns
+        if ((size_t)i >= record->fields_.size())
+        {
+            type = DataTypes::eNull;
+            data = nullptr;
+            return true;
+        }
+        const Field &fl = record->fields_[i];
+        type = fl.type_;
+        data = fl.Data();
+        return true;
+    }
+
     void RecordTable::SetFieldNull(const std::string &field_name)
     {
         int i = table->getColumnIndex(field_name);
         if (i != -1)
         {
+            _Materialize();
             record->fields_[i].SetValue(nullptr);
         }
     }
@@ -176,7 +389,8 @@ namespace ruru
         int i = table->getColumnIndex(field_name);
         if (i != -1)
         {
-            record->fields_[i].SetValue(value);
+            _Materialize();
+            record->fields_[i].SetValue(value, record->arena_);
         }
     }
 
@@ -185,7 +399,8 @@ namespace ruru
         int i = table->getColumnIndex(field_name);
         if (i != -1)
         {
-            record->fields_[i].SetValue(value);
+            _Materialize();
+            record->fields_[i].SetValue(value, record->arena_);
         }
     }
     void RecordTable::SetFieldValue(const std::string &field_name, const std::string &value)
@@ -193,7 +408,8 @@ namespace ruru
         int i = table->getColumnIndex(field_name);
         if (i != -1)
         {
-            record->fields_[i].SetValue(value);
+            _Materialize();
+            record->fields_[i].SetValue(value, record->arena_);
         }
     }
 
@@ -202,66 +418,67 @@ namespace ruru
         /* int i = table->getColumnIndex(field_name);
          if (i != -1)
          {
-             record->fields_[i].SetValue(value);
+             record->fields_[i].SetValue(value, record->arena_);
          }*/
     }
 
     bool RecordTable::GetFieldValue(const std::string &field_name, int64_t &value)
     {
-        int i = table->getColumnIndex(field_name);
-        if (i == -1)
-        {
+        DataTypes type;
+        const char *data;
+        if (!_GetField(field_name, type, data))
             return false;
-        }
-        Column cl = table->getColumn(field_name);
-        if (cl.getType() != DataTypes::eInteger)
+        if (table->getColumn(field_name).getType() != DataTypes::eInteger)
             return false;
-        Field fl = record->fields_[i];
-        value = *reinterpret_cast<int64_t *>(fl.value_.get());
+        if (type != DataTypes::eInteger || data == nullptr)
+            return false;
+        memcpy(&value, data, sizeof(value));
         return true;
     }
 
     bool RecordTable::GetFieldValue(const std::string &field_name, double &value)
     {
-        int i = table->getColumnIndex(field_name);
-        if (i == -1)
-        {
+        DataTypes type;
+        const char *data;
+        if (!_GetField(field_name, type, data))
             return false;
-        }
-        Column cl = table->getColumn(field_name);
-        if (cl.getType() != DataTypes::eDouble)
+        if (table->getColumn(field_name).getType() != DataTypes::eDouble)
             return false;
-        Field fl = record->fields_[i];
-        value = *reinterpret_cast<double *>(fl.value_.get());
+        if (type != DataTypes::eDouble || data == nullptr)
+            return false;
+        memcpy(&value, data, sizeof(value));
         return true;
     }
 
     bool RecordTable::GetFieldValue(const std::string &field_name, std::string &value)
     {
-        int i = table->getColumnIndex(field_name);
-        if (i == -1)
+        std::string_view text;
+        if (!GetFieldValue(field_name, text))
         {
+            value = "";
             return false;
         }
-        Column cl = table->getColumn(field_name);
-        if (cl.getType() != DataTypes::eVarChar)
+        value.assign(text.data(), text.size());
+        return true;
+    }
+
+    bool RecordTable::GetFieldValue(const std::string &field_name, std::string_view &value)
+    {
+        DataTypes type;
+        const char *data;
+        if (!_GetField(field_name, type, data))
             return false;
-        Field fl = record->fields_[i];
-        if (fl.type_ == DataTypes::eNull)
-        {
-            value = "";
+        if (table->getColumn(field_name).getType() != DataTypes::eVarChar)
             return false;
-        }
-        else
+        if (type != DataTypes::eVarChar || data == nullptr)
         {
-             uint64_t *len = reinterpret_cast<uint64_t *>(fl.value_.get());
-            if (*len == 0)
-                value = "";
-            else
-                value.assign(fl.value_.get() + 8, *len);
+            value = std::string_view();
+            return false;
         }
-       
-
+        // varchar is stored as [length][bytes]
+        uint64_t len;
+        memcpy(&len, data, sizeof(len));
+        value = std::string_view(data + sizeof(len), len);
         return true;
     }
 
@@ -275,20 +492,19 @@ namespace ruru
         Column cl = table->getColumn(field_name);
         if (cl.getType() != DataTypes::eBinary)
             return false;
-        Field fl = record->fields_[i];
-        value = fl.value_;
+        _Materialize();
+        const Field &fl = record->fields_[i];
+        value = fl.Share();
         return true;
     }
 
     bool RecordTable::IsFieldNull(const std::string &field_name, bool &value)
     {
-        int i = table->getColumnIndex(field_name);
-        if (i == -1)
-        {
+        DataTypes type;
+        const char *data;
+        if (!_GetField(field_name, type, data))
             return false;
-        }
-        Field fl = record->fields_[i];
-        value = (fl.type_ == DataTypes::eNull) | (fl.value_ == nullptr);
+        value = (type == DataTypes::eNull) | (data == nullptr);
         return true;
     }
 
@@ -299,12 +515,33 @@ namespace ruru
         if (!db)
             return false;
 
-        IStorageEngine *store = db->getStorageEngine(table->getName());
-        return store->Save(*record, type == RecordType::eNew);
+        _Materialize();
+        // the log can't hold a larger record
+        if (record->GetRowSize() > (RecordLength_t)internal::WriteAheadLog::MAX_RECORD_SIZE)
+            return false;
+        // writers are held while the background flush is late
+        db->waitForFlush();
+        uint64_t lsn;
+        {
+            // the writers of different tables only share the log latch,
+            // the writers of a table are serialized by its latch
+            IStorageEngine *store = db->getStorageEngine(table->getName());
+            std::shared_lock<std::shared_mutex> log_latch(db->getLogLatch());
+            std::unique_lock<std::shared_mutex> latch(db->getTableLatch(table->getName()));
+            // the readers of older snapshots keep seeing the previous version
+            uint64_t commit_ts = db->getVersionClock().Commit();
+            if (!store->SaveVersion(*record, type == RecordType::eNew, commit_ts, db->getVersionClock().GetOldest()))
+                return false;
+            // the record has its row id, log the saved version
+            lsn = db->logSave(table->getName(), *record);
+        }
+        // the log sync is shared with the saves committing at the same time
+        return db->commitLog(lsn);
     }
 
     RecordTable::~RecordTable()
     {
         delete record;
+        delete view;
     }
-}
\ No newline at end of file
+}
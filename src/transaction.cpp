@@ -0,0 +1,50 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "ruru.h"
+#include "database.h"
+
+namespace ruru
+{
+    Transaction::Transaction(const std::weak_ptr<IDatabase> &db)
+        : database(db), active(true)
+    {
+    }
+
+    bool Transaction::save(const RecordTablePtr &record)
+    {
+        if (!active || record == nullptr)
+            return false;
+        if (saved.emplace(record.get(), records.size()).second)
+            records.push_back(record);
+        return true;
+    }
+
+    bool Transaction::commit()
+    {
+        if (!active)
+            return false;
+        active = false;
+        auto db_shared = database.lock();
+        Database *db = dynamic_cast<Database *>(db_shared.get());
+        bool result = db != nullptr && db->commitTransaction(records);
+        records.clear();
+        saved.clear();
+        return result;
+    }
+
+    void Transaction::rollback()
+    {
+        active = false;
+        records.clear();
+        saved.clear();
+    }
+
+    Transaction::~Transaction()
+    {
+        rollback();
+    }
+}
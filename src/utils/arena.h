@@ -0,0 +1,117 @@
+#pragma once
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#include <memory>
+#include <algorithm>
+
+/*
+    \class Arena
+    \brief bump allocator for the field payloads of a record
+           payloads are std::shared_ptr<char> aliasing the current block, a block
+           is released with the last payload that points into it.
+           A block of up to LARGE_BLOCK bytes is a single allocation, control block included.
+*/
+class Arena
+{
+public:
+    static constexpr size_t SMALL_BLOCK = 256;
+    static constexpr size_t LARGE_BLOCK = 4096;
+
+    Arena() : used_(0), capacity_(0) {}
+
+    // a copy starts empty, the payloads already handed out keep their block alive
+    Arena(const Arena &) : Arena() {}
+    Arena &operator=(const Arena &)
+    {
+        Release();
+        return *this;
+    }
+
+    Arena(Arena &&other) noexcept
+        : block_(std::move(other.block_)), used_(other.used_), capacity_(other.capacity_)
+    {
+        other.Release();
+    }
+    Arena &operator=(Arena &&other) noexcept
+    {
+        block_ = std::move(other.block_);
+        used_ = other.used_;
+        capacity_ = other.capacity_;
+        other.Release();
+        return *this;
+    }
+
+    // make sure the next size bytes come from a single block
+    void Reserve(size_t size)
+    {
+        if (block_ == nullptr || capacity_ - used_ < size)
+            _NewBlock(size);
+    }
+
+    // size bytes, 8 bytes aligned
+    std::shared_ptr<char> Allocate(size_t size)
+    {
+        size_t need = (size + 7) & ~(size_t)7;
+        if (block_ == nullptr || capacity_ - used_ < need)
+            _NewBlock(std::max(need, SMALL_BLOCK));
+        char *ptr = block_.get() + used_;
+        used_ += need;
+        return std::shared_ptr<char>(block_, ptr);
+    }
+
+    // start over, the block is reused when no payload points into it anymore
+    void Reset()
+    {
+        if (block_ != nullptr && block_.use_count() == 1)
+            used_ = 0;
+        else
+            Release();
+    }
+
+    // drop the current block
+    void Release()
+    {
+        block_.reset();
+        used_ = 0;
+        capacity_ = 0;
+    }
+
+private:
+    template <size_t N>
+    struct Block
+    {
+        // user provided, the payload bytes are not zeroed by make_shared
+        Block() {}
+        alignas(8) char data[N];
+    };
+
+    std::shared_ptr<char> block_;
+    size_t used_;
+    size_t capacity_;
+
+    void _NewBlock(size_t size)
+    {
+        if (size <= SMALL_BLOCK)
+        {
+            auto block = std::make_shared<Block<SMALL_BLOCK>>();
+            block_ = std::shared_ptr<char>(block, block->data);
+            capacity_ = SMALL_BLOCK;
+        }
+        else if (size <= LARGE_BLOCK)
+        {
+            auto block = std::make_shared<Block<LARGE_BLOCK>>();
+            block_ = std::shared_ptr<char>(block, block->data);
+            capacity_ = LARGE_BLOCK;
+        }
+        else
+        {
+            size = (size + 7) & ~(size_t)7;
+            block_ = std::shared_ptr<char>(new char[size], std::default_delete<char[]>());
+            capacity_ = size;
+        }
+        used_ = 0;
+    }
+};
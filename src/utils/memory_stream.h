@@ -0,0 +1,80 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#pragma once
+
+#include <vector>
+#include <cstring>
+
+/*
+    \class MemoryReader
+    \brief read-only stream over a contiguous byte range
+           a read that would cross the end of the range sets the fail flag
+           and leaves the destination untouched, so a caller can detect
+           a truncated record and fetch more bytes
+*/
+class MemoryReader
+{
+public:
+    MemoryReader(const char *data, size_t size) : m_data(data), m_size(size), m_pos(0), m_fail(false) {}
+
+    bool fail() const { return m_fail; }
+
+    bool eof() const { return m_pos >= m_size; }
+
+    void read(char *data, size_t size)
+    {
+        if (m_fail || m_pos + size > m_size)
+        {
+            m_fail = true;
+            return;
+        }
+        memcpy(data, m_data + m_pos, size);
+        m_pos += size;
+    }
+
+    // the stream is read-only
+    void write(const char *, size_t) { m_fail = true; }
+
+    size_t tell() const { return m_pos; }
+
+    void seek(size_t pos)
+    {
+        m_pos = pos;
+        m_fail = false;
+    }
+
+private:
+    const char *m_data;
+    size_t m_size;
+    size_t m_pos;
+    bool m_fail;
+};
+
+/*
+    \class MemoryWriter
+    \brief append-only stream into a std::vector<char>
+           used to encode records before a single positional write
+*/
+class MemoryWriter
+{
+public:
+    MemoryWriter(std::vector<char> &out) : m_out(out) {}
+
+    bool fail() const { return false; }
+
+    void write(const char *data, size_t size)
+    {
+        m_out.insert(m_out.end(), data, data + size);
+    }
+
+    // the stream is write-only
+    void read(char *, size_t) {}
+
+    size_t tell() const { return m_out.size(); }
+
+private:
+    std::vector<char> &m_out;
+};
@@ -0,0 +1,52 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#include "pch.h"
+#include "ruru.h"
+#include "version_clock.h"
+
+namespace ruru
+{
+    VersionClock::VersionClock()
+        : last_commit_(0)
+    {
+    }
+
+    uint64_t VersionClock::Commit()
+    {
+        return ++last_commit_;
+    }
+
+    std::shared_ptr<const uint64_t> VersionClock::Pin()
+    {
+        // the commit timestamp is read under the lock: a writer that took a later
+        // timestamp finds the snapshot pinned when it looks for the oldest one
+        std::lock_guard<std::mutex> lock(mutex_);
+        uint64_t *snapshot = new uint64_t(last_commit_);
+        pinned_.insert(*snapshot);
+        std::weak_ptr<VersionClock> clock = weak_from_this();
+        return std::shared_ptr<const uint64_t>(snapshot, [clock](const uint64_t *p)
+                                               {
+                                                   if (auto owner = clock.lock())
+                                                       owner->_Unpin(*p);
+                                                   delete p; });
+    }
+
+    uint64_t VersionClock::GetOldest()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (pinned_.empty())
+            return last_commit_;
+        return *pinned_.begin();
+    }
+
+    void VersionClock::_Unpin(uint64_t snapshot)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = pinned_.find(snapshot);
+        if (it != pinned_.end())
+            pinned_.erase(it);
+    }
+}
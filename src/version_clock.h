@@ -0,0 +1,50 @@
+// Copyright (c) 2023 Ayoub Serti
+//
+// This software is released under the MIT License.
+// https://opensource.org/licenses/MIT
+
+#ifndef _H_VERSION_CLOCK_HH__
+#define _H_VERSION_CLOCK_HH__
+
+#include "ruru.h"
+
+#include <mutex>
+#include <atomic>
+#include <set>
+
+namespace ruru
+{
+    /*
+        \class VersionClock
+        \brief commit timestamps and pinned snapshots of a database
+               every saved version gets the next commit timestamp, a snapshot is
+               the last commit timestamp when it is pinned and sees the versions
+               committed up to it. The storage engines keep the versions replaced
+               while an older snapshot is pinned.
+    */
+    class VersionClock : public std::enable_shared_from_this<VersionClock>
+    {
+    public:
+        VersionClock();
+        VersionClock(const VersionClock &) = delete;
+        VersionClock &operator=(const VersionClock &) = delete;
+
+        // timestamp of a new version, called with the latch of its table held
+        uint64_t Commit();
+
+        // pin the current snapshot, it is unpinned with the last reference
+        std::shared_ptr<const uint64_t> Pin();
+
+        // oldest pinned snapshot, the last commit timestamp when none is pinned
+        uint64_t GetOldest();
+
+    private:
+        std::mutex mutex_;
+        std::multiset<uint64_t> pinned_;
+        std::atomic<uint64_t> last_commit_;
+
+        void _Unpin(uint64_t snapshot);
+    };
+}
+
+#endif //_H_VERSION_CLOCK_HH__
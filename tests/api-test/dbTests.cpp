@@ -1,6 +1,11 @@
 #include <gtest/gtest.h>
 #include "pch.h"
 #include "ruru.h"
+#include "record.h"
+#include "record_view.h"
+#include "database.h"
+#include "internal/basic_store_cache.h"
+#include <thread>
 using ::testing::EmptyTestEventListener;
 using ::testing::InitGoogleTest;
 using ::testing::Test;
@@ -9,6 +14,35 @@ using ::testing::TestInfo;
 using ::testing::TestPartResult;
 using ::testing::UnitTest;
 
+// remove a table data file with its index, checkpoint and column files
+static void removeTableFiles(const std::string &path)
+{
+    for (auto ext : {"", ".index", ".row.index", ".checkpoint", ".checkpoint.tmp", ".col", ".col.tmp"})
+        std::filesystem::remove(path + ext);
+    // secondary indexes are named <path>.<index name>.secondary.index
+    std::filesystem::path file(path);
+    std::string prefix = file.filename().string() + ".";
+    std::string suffix = ".secondary.index";
+    std::vector<std::filesystem::path> indexes;
+    std::error_code ec;
+    for (auto &&entry : std::filesystem::directory_iterator(file.parent_path(), ec))
+    {
+        std::string name = entry.path().filename().string();
+        if (name.size() > prefix.size() + suffix.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+            indexes.push_back(entry.path());
+    }
+    for (auto &&index : indexes)
+        std::filesystem::remove(index);
+}
+
+// remove a database schema file with its write-ahead log
+static void removeDatabaseFiles(const std::string &path)
+{
+    std::filesystem::remove(path);
+    std::filesystem::remove(path + ".wal");
+}
+
 TEST(newDatabase, no_existant_file)
 {
     // clear test directory
@@ -126,6 +160,439 @@ TEST(openDatabase, non_empty_db)
     }
 }
 
+TEST(checkpoint, sync_commit)
+{
+    ruru::Init();
+    using ruru::IDatabase;
+    removeDatabaseFiles("test/wal_db.ru");
+    removeTableFiles("test/logged.ru");
+    {
+        ruru::DatabasePtr db = IDatabase::newDatabase("test/wal_db.ru");
+        db->setSyncCommit(true);
+        auto tbl = db->newTable("logged");
+        tbl->addColumn(ruru::Column("id", ruru::DataTypes::eInteger));
+        for (int64_t i = 0; i < 10; i++)
+        {
+            auto rec = tbl->CreateRecord();
+            rec->SetFieldValue("id", i);
+            EXPECT_TRUE(rec->Save());
+        }
+        // the saves are in the log until the tables are flushed
+        auto log_size = std::filesystem::file_size("test/wal_db.ru.wal");
+        EXPECT_GT(log_size, 8);
+        EXPECT_TRUE(db->checkpoint());
+        EXPECT_EQ(std::filesystem::file_size("test/wal_db.ru.wal"), 8);
+        EXPECT_EQ(tbl->Search({})->GetSize(), 10);
+    }
+    removeDatabaseFiles("test/wal_db.ru");
+    removeTableFiles("test/logged.ru");
+}
+
+TEST(checkpoint, between_save_and_commit)
+{
+    ruru::Init();
+    using ruru::IDatabase;
+    removeDatabaseFiles("test/gap_db.ru");
+    removeTableFiles("test/gap.ru");
+    {
+        ruru::DatabasePtr db = IDatabase::newDatabase("test/gap_db.ru");
+        db->setSyncCommit(true);
+        auto tbl = db->newTable("gap");
+        tbl->addColumn(ruru::Column("id", ruru::DataTypes::eInteger));
+        auto rec = tbl->CreateRecord();
+        rec->SetFieldValue("id", (int64_t)1);
+        EXPECT_TRUE(rec->Save());
+
+        // a flush restarts the log between the save of a record and its commit
+        auto database = dynamic_cast<ruru::Database *>(db.get());
+        ruru::Record record;
+        uint64_t lsn = database->logSave("gap", record);
+        EXPECT_GT(lsn, 0);
+        EXPECT_TRUE(db->checkpoint());
+        EXPECT_TRUE(database->commitLog(lsn));
+
+        // the entries logged after the checkpoint wait for their sync again
+        rec = tbl->CreateRecord();
+        rec->SetFieldValue("id", (int64_t)2);
+        EXPECT_TRUE(rec->Save());
+        EXPECT_GT(std::filesystem::file_size("test/gap_db.ru.wal"), 8);
+        EXPECT_EQ(tbl->Search({})->GetSize(), 2);
+    }
+    removeDatabaseFiles("test/gap_db.ru");
+    removeTableFiles("test/gap.ru");
+}
+
+TEST(checkpoint, background_flush)
+{
+    ruru::Init();
+    using ruru::IDatabase;
+    removeDatabaseFiles("test/flushed_db.ru");
+    removeTableFiles("test/flushed.ru");
+    ruru::DatabasePtr db = IDatabase::newDatabase("test/flushed_db.ru");
+    ruru::FlushPolicy policy;
+    policy.interval_ms = 10;
+    db->setFlushPolicy(policy);
+    auto tbl = db->newTable("flushed");
+    tbl->addColumn(ruru::Column("id", ruru::DataTypes::eInteger));
+    for (int64_t i = 0; i < 10; i++)
+    {
+        auto rec = tbl->CreateRecord();
+        rec->SetFieldValue("id", i);
+        EXPECT_TRUE(rec->Save());
+    }
+    // the table is flushed without any call to checkpoint
+    for (int i = 0; i < 200 && !std::filesystem::exists("test/flushed.ru.checkpoint"); i++)
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    EXPECT_TRUE(std::filesystem::exists("test/flushed.ru.checkpoint"));
+}
+
+TEST(openDatabase, recovery)
+{
+    ruru::Init();
+    using ruru::IDatabase;
+    removeDatabaseFiles("test/recovered_db.ru");
+    removeTableFiles("test/recovered.ru");
+    {
+        ruru::DatabasePtr db = IDatabase::newDatabase("test/recovered_db.ru");
+        auto tbl = db->newTable("recovered");
+        tbl->addColumn(ruru::Column("id", ruru::DataTypes::eInteger));
+        db->saveSchema("test/recovered_db.ru");
+        for (int64_t i = 0; i < 10; i++)
+        {
+            auto rec = tbl->CreateRecord();
+            rec->SetFieldValue("id", i);
+            rec->Save();
+        }
+    }
+    // index files lost: the data file is scanned at open
+    std::filesystem::remove("test/recovered.ru.row.index");
+    std::filesystem::remove("test/recovered.ru.checkpoint");
+    {
+        auto db = IDatabase::openDatabase("test/recovered_db.ru");
+        auto tbl = db->getTable("recovered");
+        EXPECT_EQ(tbl->Search({})->GetSize(), 10);
+        auto rec = tbl->CreateRecord();
+        rec->SetFieldValue("id", (int64_t)10);
+        EXPECT_TRUE(rec->Save());
+        EXPECT_EQ(tbl->Search({})->GetSize(), 11);
+    }
+}
+
+TEST(openDatabase, stale_index_files)
+{
+    ruru::Init();
+    using ruru::IDatabase;
+    removeDatabaseFiles("test/stale_db.ru");
+    removeTableFiles("test/stale.ru");
+    for (int64_t count : {10, 3})
+    {
+        // the table is created again next to the index files of the previous one
+        std::filesystem::remove("test/stale.ru");
+        {
+            ruru::DatabasePtr db = IDatabase::newDatabase("test/stale_db.ru");
+            auto tbl = db->newTable("stale");
+            tbl->addColumn(ruru::Column("id", ruru::DataTypes::eInteger));
+            db->saveSchema("test/stale_db.ru");
+            for (int64_t i = 0; i < count; i++)
+            {
+                auto rec = tbl->CreateRecord();
+                rec->SetFieldValue("id", i);
+                EXPECT_TRUE(rec->Save());
+            }
+            EXPECT_TRUE(db->checkpoint());
+        }
+        auto db = IDatabase::openDatabase("test/stale_db.ru");
+        auto tbl = db->getTable("stale");
+        EXPECT_EQ(tbl->Search({})->GetSize(), count);
+        auto rec = tbl->GetRecord(count);
+        ASSERT_NE(rec, nullptr);
+        int64_t id = 0;
+        rec->GetFieldValue("id", id);
+        EXPECT_EQ(id, count - 1);
+    }
+    removeDatabaseFiles("test/stale_db.ru");
+    removeTableFiles("test/stale.ru");
+}
+
+TEST(transaction, commit_rollback)
+{
+    ruru::Init();
+    using ruru::IDatabase;
+    removeDatabaseFiles("test/tx_db.ru");
+    removeTableFiles("test/orders.ru");
+    removeTableFiles("test/order_lines.ru");
+    ruru::DatabasePtr db = IDatabase::newDatabase("test/tx_db.ru");
+    auto orders = db->newTable("orders");
+    orders->addColumn(ruru::Column("id", ruru::DataTypes::eInteger));
+    orders->addColumn(ruru::Column("status", ruru::DataTypes::eVarChar));
+    auto lines = db->newTable("order_lines");
+    lines->addColumn(ruru::Column("order_id", ruru::DataTypes::eInteger));
+    lines->addColumn(ruru::Column("qty", ruru::DataTypes::eInteger));
+
+    // an order and its lines are written together
+    auto tx = db->beginTransaction();
+    auto order = orders->CreateRecord();
+    order->SetFieldValue("id", (int64_t)1);
+    order->SetFieldValue("status", "new");
+    EXPECT_TRUE(tx->save(order));
+    for (int64_t i = 0; i < 3; i++)
+    {
+        auto line = lines->CreateRecord();
+        line->SetFieldValue("order_id", (int64_t)1);
+        line->SetFieldValue("qty", i + 1);
+        EXPECT_TRUE(tx->save(line));
+    }
+    EXPECT_EQ(orders->Search({})->GetSize(), 0);
+    EXPECT_TRUE(tx->commit());
+    EXPECT_FALSE(tx->isActive());
+    EXPECT_FALSE(tx->save(order));
+    EXPECT_EQ(orders->Search({})->GetSize(), 1);
+    EXPECT_EQ(lines->Search({})->GetSize(), 3);
+
+    // a rolled back transaction writes nothing
+    tx = db->beginTransaction();
+    auto line = lines->CreateRecord();
+    line->SetFieldValue("order_id", (int64_t)2);
+    line->SetFieldValue("qty", (int64_t)5);
+    tx->save(line);
+    tx->rollback();
+    EXPECT_FALSE(tx->commit());
+    EXPECT_EQ(lines->Search({})->GetSize(), 3);
+
+    // the committed order got a row id and can be updated
+    auto rs = orders->Search({});
+    auto stored = rs->First();
+    ASSERT_NE(stored, nullptr);
+    stored->SetFieldValue("status", "shipped");
+    tx = db->beginTransaction();
+    tx->save(stored);
+    EXPECT_TRUE(tx->commit());
+    rs = orders->Search({});
+    EXPECT_EQ(rs->GetSize(), 1);
+    std::string status;
+    rs->First()->GetFieldValue("status", status);
+    EXPECT_EQ(status, "shipped");
+}
+
+TEST(cursor, batch_size)
+{
+    ruru::Init();
+    removeDatabaseFiles("test/cursor_db.ru");
+    removeTableFiles("test/Cursors.ru");
+    ruru::DatabasePtr db = ruru::IDatabase::newDatabase("test/cursor_db.ru");
+    auto tbl = db->newTable("Cursors");
+    tbl->addColumn(ruru::Column("seq", ruru::DataTypes::eInteger));
+    for (int64_t i = 0; i < 100; i++)
+    {
+        auto rec = tbl->CreateRecord();
+        rec->SetFieldValue("seq", i);
+        EXPECT_TRUE(rec->Save());
+    }
+
+    // the first step holds a few records that don't match, the next ones only matching records
+    auto from = std::make_shared<ruru::Filter>(0, ruru::OperatorType::eGreaterOrEq, (int64_t)3, (int64_t)0);
+    auto store = dynamic_cast<ruru::Database *>(db.get())->getStorageEngine("Cursors");
+    auto cursor = store->OpenCursor({from}, UINT64_MAX);
+    ASSERT_NE(cursor, nullptr);
+    std::vector<ruru::CursorRecord> batch;
+    size_t total = 0;
+    bool sized = true;
+    while (cursor->NextBatch(batch, 10))
+    {
+        // at most max records, fewer only for the last batch
+        sized = sized && batch.size() <= 10 && (batch.size() == 10 || total + batch.size() == 97);
+        total += batch.size();
+        batch.clear();
+    }
+    EXPECT_TRUE(sized);
+    EXPECT_EQ(total, 97);
+}
+
+TEST(cacheBudget, buffer_pool)
+{
+    removeDatabaseFiles("test/pages.ru");
+    removeTableFiles("test/Pages.ru");
+    {
+        ruru::DatabasePtr db = ruru::IDatabase::newDatabase("test/pages.ru");
+        ruru::TablePtr tbl = db->newTable("Pages");
+        tbl->addColumn(ruru::Column("id", ruru::DataTypes::eInteger));
+        tbl->addColumn(ruru::Column("text", ruru::DataTypes::eVarChar));
+        std::vector<ruru::RecordTablePtr> batch;
+        for (int64_t i = 0; i < 5000; i++)
+        {
+            auto rec = tbl->CreateRecord();
+            rec->SetFieldValue("id", i);
+            rec->SetFieldValue("text", std::string(200, 'a' + i % 26));
+            batch.push_back(rec);
+        }
+        EXPECT_TRUE(tbl->BulkInsert(batch));
+        EXPECT_TRUE(db->checkpoint());
+    }
+
+    // the file is larger than the budget: the pages are read again after their eviction
+    const uint64_t budget = 256 * 1024;
+    ruru::internal::BufferPool pool(budget);
+    ruru::internal::CacheStore cache("test/Pages.ru", &pool);
+    EXPECT_TRUE(cache.Load());
+    EXPECT_GT(pool.GetUsage(), 0);
+    EXPECT_LE(pool.GetUsage(), budget);
+    EXPECT_EQ(cache.Lookup({}).size(), 5000);
+    EXPECT_LE(pool.GetUsage(), budget);
+    // the scan didn't replace the pages kept by the load
+    ruru::Record rec;
+    EXPECT_TRUE(cache.GetRecord(1, rec));
+    EXPECT_EQ(rec.row_id_, 1);
+    // a page read by id replaces a page only read by the scans
+    EXPECT_TRUE(cache.GetRecord(5000, rec));
+    EXPECT_EQ(rec.row_id_, 5000);
+    EXPECT_LE(pool.GetUsage(), budget);
+
+    // a pinned frame is not evicted
+    int owner = 0;
+    auto ref = pool.Pin(&owner, 0, []
+                        { return std::make_unique<ruru::internal::CacheSegment>(0); });
+    EXPECT_TRUE(ref);
+    pool.SetBudget(0);
+    EXPECT_GT(pool.GetUsage(), 0);
+    EXPECT_TRUE(pool.Find(&owner, 0));
+    ref.Release();
+    pool.SetBudget(0);
+    EXPECT_EQ(pool.GetUsage(), 0);
+    EXPECT_FALSE(pool.Find(&owner, 0));
+}
+
+TEST(cacheBudget, scan_resistance)
+{
+    auto segment = []
+    { return std::make_unique<ruru::internal::CacheSegment>(0); };
+    const uint64_t frame_size = segment()->GetMemorySize();
+    ruru::internal::BufferPool pool(frame_size * 4);
+    int hot = 0, cold = 0;
+
+    // pages read often
+    for (int round = 0; round < 4; round++)
+    {
+        for (uint64_t page = 0; page < 4; page++)
+            EXPECT_TRUE(pool.Pin(&hot, page, segment));
+    }
+    EXPECT_EQ(pool.GetUsage(), frame_size * 4);
+
+    // a scan larger than the pool doesn't evict them
+    for (uint64_t page = 0; page < 100; page++)
+        EXPECT_TRUE(pool.Pin(&cold, page, segment, ruru::internal::BufferPool::Access::eScan));
+    // nor do pages read once
+    for (uint64_t page = 100; page < 200; page++)
+        EXPECT_TRUE(pool.Pin(&cold, page, segment));
+    for (uint64_t page = 0; page < 4; page++)
+        EXPECT_TRUE(pool.Find(&hot, page));
+    EXPECT_EQ(pool.GetUsage(), frame_size * 4);
+
+    // a page read more often than a resident one replaces it
+    for (int round = 0; round < 8; round++)
+        pool.Pin(&cold, 500, segment);
+    EXPECT_TRUE(pool.Find(&cold, 500));
+    EXPECT_LE(pool.GetUsage(), frame_size * 4);
+}
+
+TEST(cacheBudget, record_directory)
+{
+    removeDatabaseFiles("test/directory.ru");
+    removeTableFiles("test/Directory.ru");
+    {
+        ruru::DatabasePtr db = ruru::IDatabase::newDatabase("test/directory.ru");
+        ruru::TablePtr tbl = db->newTable("Directory");
+        tbl->addColumn(ruru::Column("id", ruru::DataTypes::eInteger));
+        tbl->addColumn(ruru::Column("text", ruru::DataTypes::eVarChar));
+        for (int64_t i = 0; i < 5000; i++)
+        {
+            auto rec = tbl->CreateRecord();
+            rec->SetFieldValue("id", i);
+            rec->SetFieldValue("text", std::string(100, 'a' + i % 26));
+            EXPECT_TRUE(rec->Save());
+        }
+        // the updated records move to the last pages
+        for (ruru::RecordId id = 1; id <= 5000; id += 50)
+        {
+            auto rec = tbl->GetRecord(id);
+            rec->SetFieldValue("id", -(int64_t)id);
+            EXPECT_TRUE(rec->Save());
+        }
+        EXPECT_TRUE(db->checkpoint());
+    }
+
+    // every record is found through its page and slot, in its current version
+    ruru::internal::CacheStore cache("test/Directory.ru");
+    EXPECT_TRUE(cache.Load());
+    ruru::Record rec;
+    bool found = true;
+    for (ruru::RecordId id = 1; id <= 5000; id++)
+    {
+        int64_t value = 0;
+        if (!cache.GetRecord(id, rec) || rec.row_id_ != id)
+        {
+            found = false;
+            break;
+        }
+        memcpy(&value, rec.fields_[0].Data(), sizeof(value));
+        found = found && value == ((id - 1) % 50 == 0 ? -(int64_t)id : (int64_t)id - 1);
+    }
+    EXPECT_TRUE(found);
+    EXPECT_FALSE(cache.GetRecord(5001, rec));
+    EXPECT_FALSE(cache.GetRecord(0, rec));
+}
+
+TEST(cacheBudget, background_load)
+{
+    ruru::Init();
+    removeDatabaseFiles("test/loading.ru");
+    removeTableFiles("test/Loading.ru");
+    {
+        ruru::DatabasePtr db = ruru::IDatabase::newDatabase("test/loading.ru");
+        EXPECT_TRUE(db->setStorageEngineFactory(ruru::getEngineFactory(ruru::_basic_cached_factory)));
+        ruru::TablePtr tbl = db->newTable("Loading");
+        tbl->addColumn(ruru::Column("id", ruru::DataTypes::eInteger));
+        tbl->addColumn(ruru::Column("text", ruru::DataTypes::eVarChar));
+        // records larger than a page and than a read of the scanner
+        for (int64_t i = 0; i < 2000; i++)
+        {
+            auto rec = tbl->CreateRecord();
+            rec->SetFieldValue("id", i);
+            size_t size = i % 500 == 7 ? 5 * 1024 * 1024 : (i % 100 == 3 ? 100 * 1024 : 40);
+            rec->SetFieldValue("text", std::string(size, 'a' + i % 26));
+            EXPECT_TRUE(rec->Save());
+        }
+        EXPECT_TRUE(db->checkpoint());
+        db->saveSchema("test/loading.ru");
+    }
+
+    ruru::internal::CacheStore cache("test/Loading.ru");
+    EXPECT_TRUE(cache.Load(true));
+    cache.WaitLoaded();
+    EXPECT_TRUE(cache.Covers(std::filesystem::file_size("test/Loading.ru")));
+    ruru::Record rec;
+    bool found = true;
+    for (ruru::RecordId id = 1; id <= 2000; id++)
+        found = found && cache.GetRecord(id, rec) && rec.row_id_ == id;
+    EXPECT_TRUE(found);
+
+    // the table is written while its cache is loaded
+    ruru::DatabasePtr db = ruru::IDatabase::openDatabase("test/loading.ru");
+    ruru::TablePtr tbl = db->getTable("Loading");
+    for (int64_t id = 2000; id > 0; id -= 37)
+    {
+        auto rec = tbl->GetRecord(id);
+        rec->SetFieldValue("id", -id);
+        EXPECT_TRUE(rec->Save());
+    }
+    int64_t value = 0;
+    bool updated = true;
+    for (int64_t id = 2000; id > 0; id -= 37)
+        updated = updated && tbl->GetRecord(id)->GetFieldValue("id", value) && value == -id;
+    EXPECT_TRUE(updated);
+    auto negative = std::make_shared<ruru::Filter>(0, ruru::OperatorType::eLesser, (int64_t)0, (int64_t)0);
+    EXPECT_EQ(tbl->Search({negative})->GetSize(), 55);
+}
+
 int main(int argc, char **argv)
 {
 
@@ -134,4 +601,4 @@ int main(int argc, char **argv)
     return RUN_ALL_TESTS();
 
     return 0;
-}
\ No newline at end of file
+}
@@ -1,6 +1,8 @@
 #include <gtest/gtest.h>
 #include "pch.h"
 #include "ruru.h"
+#include <thread>
+#include <atomic>
 using ::testing::EmptyTestEventListener;
 using ::testing::InitGoogleTest;
 using ::testing::Test;
@@ -9,6 +11,35 @@ using ::testing::TestInfo;
 using ::testing::TestPartResult;
 using ::testing::UnitTest;
 
+// remove a table data file with its index, checkpoint and column files
+static void removeTableFiles(const std::string &path)
+{
+    for (auto ext : {"", ".index", ".row.index", ".checkpoint", ".checkpoint.tmp", ".col", ".col.tmp"})
+        std::filesystem::remove(path + ext);
+    // secondary indexes are named <path>.<index name>.secondary.index
+    std::filesystem::path file(path);
+    std::string prefix = file.filename().string() + ".";
+    std::string suffix = ".secondary.index";
+    std::vector<std::filesystem::path> indexes;
+    std::error_code ec;
+    for (auto &&entry : std::filesystem::directory_iterator(file.parent_path(), ec))
+    {
+        std::string name = entry.path().filename().string();
+        if (name.size() > prefix.size() + suffix.size() && name.compare(0, prefix.size(), prefix) == 0 &&
+            name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0)
+            indexes.push_back(entry.path());
+    }
+    for (auto &&index : indexes)
+        std::filesystem::remove(index);
+}
+
+// remove a database schema file with its write-ahead log
+static void removeDatabaseFiles(const std::string &path)
+{
+    std::filesystem::remove(path);
+    std::filesystem::remove(path + ".wal");
+}
+
 TEST(Table, add_get_column)
 {
     // clear test directory
@@ -89,6 +120,617 @@ TEST( Table, GetRecord)
     }
 }
 
+TEST( Table, addIndex)
+{
+    ruru::DatabasePtr db = ruru::IDatabase::openDatabase("test/newdb.ru");
+    EXPECT_TRUE(db != nullptr);
+    {
+        auto tbl = db->getTable("MyTable");
+        tbl->addIndex("col1", "idx_col1");
+        EXPECT_EQ(tbl->getIndex("idx_col1"), 0);
+
+        auto rec = tbl->CreateRecord();
+        rec->SetFieldValue("col1", (int64_t)42);
+        rec->SetFieldValue("col2", "World");
+        EXPECT_TRUE(rec->Save());
+
+        auto filter = std::make_shared<ruru::Filter>(0, ruru::OperatorType::eEqual, (int64_t)42, (int64_t)0);
+        auto recs = tbl->Search({filter});
+        EXPECT_EQ(recs->GetSize(), 1);
+
+        tbl->removeIndex("idx_col1");
+        EXPECT_EQ(tbl->getIndex("idx_col1"), -1);
+    }
+}
+
+TEST( Table, SearchRange)
+{
+    ruru::DatabasePtr db = ruru::IDatabase::openDatabase("test/newdb.ru");
+    EXPECT_TRUE(db != nullptr);
+    {
+        auto tbl = db->getTable("MyTable");
+        tbl->addIndex("col1", "idx_col1");
+
+        auto in_range = std::make_shared<ruru::Filter>(0, ruru::OperatorType::eInRange, (int64_t)10, (int64_t)30);
+        EXPECT_EQ(tbl->Search({in_range})->GetSize(), 1);
+
+        auto out_range = std::make_shared<ruru::Filter>(0, ruru::OperatorType::eOutRange, (int64_t)10, (int64_t)30);
+        EXPECT_EQ(tbl->Search({out_range})->GetSize(), 1);
+
+        std::vector<ruru::Value_t> values = {(int64_t)42, (int64_t)20, (int64_t)7};
+        auto in_list = std::make_shared<ruru::Filter>(0, values);
+        EXPECT_EQ(tbl->Search({in_list})->GetSize(), 2);
+
+        tbl->removeIndex("idx_col1");
+        EXPECT_EQ(tbl->Search({in_list})->GetSize(), 2);
+    }
+}
+
+TEST( Table, SearchVarChar)
+{
+    ruru::DatabasePtr db = ruru::IDatabase::openDatabase("test/newdb.ru");
+    EXPECT_TRUE(db != nullptr);
+    {
+        auto tbl = db->getTable("MyTable");
+        auto equal = std::make_shared<ruru::Filter>(1, ruru::OperatorType::eEqual, std::string("Hello"), (int64_t)0);
+        EXPECT_EQ(tbl->Search({equal})->GetSize(), 1);
+
+        auto greater = std::make_shared<ruru::Filter>(1, ruru::OperatorType::eGreater, std::string("Hello"), (int64_t)0);
+        EXPECT_EQ(tbl->Search({greater})->GetSize(), 1);
+    }
+}
+
+TEST( Table, LongVarChar)
+{
+    ruru::DatabasePtr db = ruru::IDatabase::openDatabase("test/newdb.ru");
+    EXPECT_TRUE(db != nullptr);
+    {
+        // too long to be stored inline in the field
+        std::string text(100, 'x');
+        auto tbl = db->getTable("MyTable");
+        auto rec = tbl->CreateRecord();
+        rec->SetFieldValue("col1", (int64_t)77);
+        rec->SetFieldValue("col2", text);
+        EXPECT_TRUE(rec->Save());
+
+        auto equal = std::make_shared<ruru::Filter>(1, ruru::OperatorType::eEqual, text, (int64_t)0);
+        auto recs = tbl->Search({equal});
+        EXPECT_EQ(recs->GetSize(), 1);
+        auto found = recs->Next();
+        EXPECT_TRUE(found != nullptr);
+        std::string value;
+        int64_t col1 = 0;
+        EXPECT_TRUE(found->GetFieldValue("col2", value));
+        EXPECT_TRUE(found->GetFieldValue("col1", col1));
+        EXPECT_EQ(value, text);
+        EXPECT_EQ(col1, 77);
+    }
+}
+
+TEST( Table, RecordView)
+{
+    ruru::DatabasePtr db = ruru::IDatabase::openDatabase("test/newdb.ru");
+    EXPECT_TRUE(db != nullptr);
+    {
+        auto tbl = db->getTable("MyTable");
+        auto rec = tbl->GetRecord(1);
+        EXPECT_TRUE(rec != nullptr);
+        std::string_view text;
+        EXPECT_TRUE(rec->GetFieldValue("col2", text));
+        EXPECT_EQ(text, "Hello");
+
+        // the record is copied on the first modification
+        rec->SetFieldValue("col1", (int64_t)21);
+        EXPECT_TRUE(rec->GetFieldValue("col2", text));
+        EXPECT_EQ(text, "Hello");
+        EXPECT_TRUE(rec->Save());
+
+        int64_t col1 = 0;
+        EXPECT_TRUE(tbl->GetRecord(1)->GetFieldValue("col1", col1));
+        EXPECT_EQ(col1, 21);
+    }
+}
+
+TEST( Table, columnarSearch)
+{
+    removeDatabaseFiles("test/columnar.ru");
+    removeTableFiles("test/Measures.ru");
+    removeTableFiles("test/Readings.ru");
+    {
+        ruru::DatabasePtr db = ruru::IDatabase::newDatabase("test/columnar.ru");
+        EXPECT_TRUE(db->setStorageEngineFactory(ruru::getEngineFactory(ruru::_columnar_factory)));
+        ruru::TablePtr tbl = db->newTable("Measures");
+        tbl->addColumn(ruru::Column("time", ruru::DataTypes::eInteger));
+        tbl->addColumn(ruru::Column("value", ruru::DataTypes::eDouble));
+        for (int64_t i = 0; i < 1000; i++)
+        {
+            auto rec = tbl->CreateRecord();
+            rec->SetFieldValue("time", i);
+            if (i % 10 != 0)
+                rec->SetFieldValue("value", i * 0.5);
+            EXPECT_TRUE(rec->Save());
+        }
+        auto window = std::make_shared<ruru::Filter>(0, ruru::OperatorType::eInRange, (int64_t)100, (int64_t)199);
+        EXPECT_EQ(tbl->Search({window})->GetSize(), 100);
+
+        // an integer stored in a double column is not a null
+        ruru::TablePtr readings = db->newTable("Readings");
+        readings->addColumn(ruru::Column("value", ruru::DataTypes::eDouble));
+        auto first = readings->CreateRecord();
+        first->SetFieldValue("value", (int64_t)7);
+        EXPECT_TRUE(first->Save());
+        auto second = readings->CreateRecord();
+        second->SetFieldValue("value", 7.5);
+        EXPECT_TRUE(second->Save());
+        auto no_value = std::make_shared<ruru::Filter>(0, ruru::OperatorType::eIsNull, (int64_t)0, (int64_t)0);
+        auto has_value = std::make_shared<ruru::Filter>(0, ruru::OperatorType::eIsNotNull, (int64_t)0, (int64_t)0);
+        EXPECT_EQ(readings->Search({no_value})->GetSize(), 0);
+        EXPECT_EQ(readings->Search({has_value})->GetSize(), 2);
+        db->saveSchema("test/columnar.ru");
+    }
+    {
+        // reopened with the columns file
+        ruru::DatabasePtr db = ruru::IDatabase::openDatabase("test/columnar.ru");
+        auto tbl = db->getTable("Measures");
+        auto window = std::make_shared<ruru::Filter>(0, ruru::OperatorType::eInRange, (int64_t)100, (int64_t)199);
+        auto greater = std::make_shared<ruru::Filter>(1, ruru::OperatorType::eGreater, 90.0, (int64_t)0);
+        EXPECT_EQ(tbl->Search({window, greater})->GetSize(), 18);
+        auto is_null = std::make_shared<ruru::Filter>(1, ruru::OperatorType::eIsNull, (int64_t)0, (int64_t)0);
+        EXPECT_EQ(tbl->Search({is_null})->GetSize(), 100);
+    }
+}
+
+TEST( Table, concurrentReaders)
+{
+    removeDatabaseFiles("test/concurrent.ru");
+    removeTableFiles("test/Counters.ru");
+    ruru::DatabasePtr db = ruru::IDatabase::newDatabase("test/concurrent.ru");
+    ruru::TablePtr tbl = db->newTable("Counters");
+    tbl->addColumn(ruru::Column("key", ruru::DataTypes::eInteger));
+    tbl->addColumn(ruru::Column("value", ruru::DataTypes::eInteger));
+    tbl->addIndex("key", "idx_key");
+    const int64_t rows = 200;
+    for (int64_t i = 0; i < rows; i++)
+    {
+        auto rec = tbl->CreateRecord();
+        rec->SetFieldValue("key", i);
+        rec->SetFieldValue("value", (int64_t)0);
+        EXPECT_TRUE(rec->Save());
+    }
+
+    // the readers search and read the table while a writer updates it
+    std::atomic<bool> done{false};
+    std::atomic<int> errors{0};
+    std::vector<std::thread> readers;
+    for (int t = 0; t < 4; t++)
+    {
+        readers.emplace_back([&, t]
+                             {
+            int64_t i = t;
+            while (!done)
+            {
+                int64_t key = i++ % rows;
+                auto equal = std::make_shared<ruru::Filter>(0, ruru::OperatorType::eEqual, key, (int64_t)0);
+                auto recs = tbl->Search({equal});
+                auto rec = recs->Next();
+                int64_t found = -1;
+                if (recs->GetSize() != 1 || rec == nullptr || !rec->GetFieldValue("key", found) || found != key)
+                    errors++;
+            } });
+    }
+    for (int64_t pass = 1; pass <= 5; pass++)
+    {
+        for (int64_t id = 1; id <= rows; id++)
+        {
+            auto rec = tbl->GetRecord(id);
+            rec->SetFieldValue("value", pass);
+            EXPECT_TRUE(rec->Save());
+        }
+    }
+    done = true;
+    for (auto &&it : readers)
+        it.join();
+    EXPECT_EQ(errors, 0);
+
+    auto last = std::make_shared<ruru::Filter>(1, ruru::OperatorType::eEqual, (int64_t)5, (int64_t)0);
+    EXPECT_EQ(tbl->Search({last})->GetSize(), rows);
+}
+
+TEST( Table, snapshotRead)
+{
+    removeDatabaseFiles("test/snapshot.ru");
+    removeTableFiles("test/Stock.ru");
+    ruru::DatabasePtr db = ruru::IDatabase::newDatabase("test/snapshot.ru");
+    ruru::TablePtr tbl = db->newTable("Stock");
+    tbl->addColumn(ruru::Column("item", ruru::DataTypes::eVarChar));
+    tbl->addColumn(ruru::Column("quantity", ruru::DataTypes::eInteger));
+    for (int64_t i = 0; i < 3; i++)
+    {
+        auto rec = tbl->CreateRecord();
+        rec->SetFieldValue("item", "item" + std::to_string(i));
+        rec->SetFieldValue("quantity", (int64_t)10);
+        EXPECT_TRUE(rec->Save());
+    }
+
+    auto recs = tbl->Search({});
+    EXPECT_EQ(recs->GetSize(), 3);
+
+    // the writer goes on while the result set is read
+    for (int64_t pass = 1; pass <= 3; pass++)
+    {
+        auto rec = tbl->GetRecord(1);
+        rec->SetFieldValue("quantity", 10 + pass);
+        rec->SetFieldValue("item", std::string(40, 'x'));
+        EXPECT_TRUE(rec->Save());
+    }
+    auto added = tbl->CreateRecord();
+    added->SetFieldValue("item", "item3");
+    added->SetFieldValue("quantity", (int64_t)10);
+    EXPECT_TRUE(added->Save());
+
+    int64_t quantity = 0;
+    std::string item;
+    auto first = recs->Next();
+    EXPECT_TRUE(first != nullptr);
+    EXPECT_TRUE(first->GetFieldValue("quantity", quantity));
+    EXPECT_TRUE(first->GetFieldValue("item", item));
+    EXPECT_EQ(quantity, 10);
+    EXPECT_EQ(item, "item0");
+
+    // the current version outside of the snapshot
+    EXPECT_TRUE(tbl->GetRecord(1)->GetFieldValue("quantity", quantity));
+    EXPECT_EQ(quantity, 13);
+    EXPECT_EQ(tbl->Search({})->GetSize(), 4);
+
+    // the old versions are released with the snapshot
+    recs.reset();
+    EXPECT_TRUE(db->checkpoint());
+    auto again = tbl->Search({});
+    auto rec = again->Next();
+    EXPECT_TRUE(rec->GetFieldValue("quantity", quantity));
+    EXPECT_EQ(quantity, 13);
+}
+
+TEST( Table, snapshotIndexSearch)
+{
+    removeDatabaseFiles("test/snapshot_index.ru");
+    removeTableFiles("test/Shelves.ru");
+    ruru::DatabasePtr db = ruru::IDatabase::newDatabase("test/snapshot_index.ru");
+    ruru::TablePtr tbl = db->newTable("Shelves");
+    tbl->addColumn(ruru::Column("item", ruru::DataTypes::eVarChar));
+    tbl->addColumn(ruru::Column("quantity", ruru::DataTypes::eInteger));
+    tbl->addIndex("quantity", "idx_quantity");
+    // more records than the first batch of a result set
+    const int64_t rows = 100;
+    for (int64_t i = 0; i <= rows; i++)
+    {
+        auto rec = tbl->CreateRecord();
+        rec->SetFieldValue("item", i < rows ? "item" + std::to_string(i) : std::string("extra"));
+        rec->SetFieldValue("quantity", i < rows ? (int64_t)20 : (int64_t)30);
+        EXPECT_TRUE(rec->Save());
+    }
+
+    auto equal = std::make_shared<ruru::Filter>(1, ruru::OperatorType::eEqual, (int64_t)20, (int64_t)0);
+    auto recs = tbl->Search({equal});
+    int64_t count = 0;
+    for (auto rec = recs->First(); rec != nullptr; rec = recs->Next())
+        count++;
+    EXPECT_EQ(count, rows);
+    auto counted = tbl->Search({equal});
+    EXPECT_TRUE(counted->Next() != nullptr);
+
+    // the index moves on with the writer, the result sets read again stay on their snapshot
+    auto rec = tbl->GetRecord(1);
+    rec->SetFieldValue("quantity", (int64_t)25);
+    EXPECT_TRUE(rec->Save());
+    EXPECT_EQ(counted->GetSize(), rows);
+    std::string item;
+    auto first = recs->First();
+    ASSERT_NE(first, nullptr);
+    EXPECT_TRUE(first->GetFieldValue("item", item));
+    EXPECT_EQ(item, "item0");
+
+    rec = tbl->GetRecord(rows + 1);
+    rec->SetFieldValue("quantity", (int64_t)20);
+    EXPECT_TRUE(rec->Save());
+    count = 0;
+    bool extra = false;
+    for (auto rec = recs->First(); rec != nullptr; rec = recs->Next())
+    {
+        count++;
+        extra = extra || (rec->GetFieldValue("item", item) && item == "extra");
+    }
+    EXPECT_EQ(count, rows);
+    EXPECT_FALSE(extra);
+
+    // the current versions outside of the snapshot
+    first = tbl->Search({equal})->First();
+    ASSERT_NE(first, nullptr);
+    EXPECT_TRUE(first->GetFieldValue("item", item));
+    EXPECT_EQ(item, "item1");
+}
+
+TEST( Table, BulkInsert)
+{
+    removeDatabaseFiles("test/bulk.ru");
+    removeTableFiles("test/Lines.ru");
+    ruru::DatabasePtr db = ruru::IDatabase::newDatabase("test/bulk.ru");
+    ruru::TablePtr tbl = db->newTable("Lines");
+    tbl->addColumn(ruru::Column("qty", ruru::DataTypes::eInteger));
+    tbl->addColumn(ruru::Column("label", ruru::DataTypes::eVarChar));
+    tbl->addIndex("qty", "idx_qty");
+
+    std::vector<ruru::RecordTablePtr> batch;
+    for (int64_t i = 0; i < 5000; i++)
+    {
+        auto rec = tbl->CreateRecord();
+        // keys out of order for the index
+        rec->SetFieldValue("qty", (i * 37) % 5000);
+        rec->SetFieldValue("label", "line" + std::to_string(i));
+        batch.push_back(rec);
+    }
+    EXPECT_TRUE(tbl->BulkInsert(batch));
+    EXPECT_EQ(tbl->Search({})->GetSize(), 5000);
+
+    auto equal = std::make_shared<ruru::Filter>(0, ruru::OperatorType::eEqual, (int64_t)37, (int64_t)0);
+    auto recs = tbl->Search({equal});
+    EXPECT_EQ(recs->GetSize(), 1);
+    std::string label;
+    EXPECT_TRUE(recs->First()->GetFieldValue("label", label));
+    EXPECT_EQ(label, "line1");
+
+    auto range = std::make_shared<ruru::Filter>(0, ruru::OperatorType::eInRange, (int64_t)100, (int64_t)199);
+    EXPECT_EQ(tbl->Search({range})->GetSize(), 100);
+
+    // every record got its row id
+    EXPECT_TRUE(tbl->GetRecord(5000) != nullptr);
+    // a saved record is not new anymore, nothing is inserted
+    auto stored = tbl->Search({equal})->First();
+    EXPECT_FALSE(tbl->BulkInsert({stored}));
+    EXPECT_EQ(tbl->Search({})->GetSize(), 5000);
+
+    // a batch larger than a transaction is inserted by several of them
+    std::vector<ruru::RecordTablePtr> large;
+    for (int64_t i = 0; i < 70; i++)
+    {
+        auto rec = tbl->CreateRecord();
+        rec->SetFieldValue("qty", 5000 + i);
+        rec->SetFieldValue("label", std::string(1024 * 1024, 'a' + i % 26));
+        large.push_back(rec);
+    }
+    EXPECT_TRUE(tbl->BulkInsert(large));
+    EXPECT_EQ(tbl->Search({})->GetSize(), 5070);
+    std::string text;
+    EXPECT_TRUE(tbl->GetRecord(5070)->GetFieldValue("label", text));
+    EXPECT_EQ(text, std::string(1024 * 1024, 'a' + 69 % 26));
+}
+
+TEST( Table, Import)
+{
+    removeDatabaseFiles("test/import.ru");
+    removeTableFiles("test/People.ru");
+    ruru::DatabasePtr db = ruru::IDatabase::newDatabase("test/import.ru");
+    ruru::TablePtr tbl = db->newTable("People");
+    tbl->addColumn(ruru::Column("id", ruru::DataTypes::eInteger));
+    tbl->addColumn(ruru::Column("name", ruru::DataTypes::eVarChar));
+    tbl->addColumn(ruru::Column("score", ruru::DataTypes::eDouble));
+
+    {
+        // columns in another order, quoted values, an unknown column and CRLF line ends
+        std::ofstream csv("test/people.csv", std::ios::binary);
+        csv << "name,extra,id,score\r\n";
+        csv << "\"Doe, \"\"John\"\"\",x,1,1.5\r\n";
+        csv << "\"two\nlines\",x,2,\r\n";
+        for (int i = 3; i <= 200; i++)
+            csv << "name" << i << ",x," << i << "," << i * 0.5 << "\n";
+    }
+    ruru::ImportOptions options;
+    options.threads = 2;
+    // small chunks: records are cut across the reads
+    options.chunk_size = 64;
+    ruru::ImportResult result;
+    EXPECT_TRUE(tbl->Import("test/people.csv", options, &result));
+    EXPECT_EQ(result.rows, 200);
+    EXPECT_EQ(tbl->Search({})->GetSize(), 200);
+
+    std::string name;
+    double score = 0;
+    bool isNull = false;
+    auto first = tbl->GetRecord(1);
+    EXPECT_TRUE(first->GetFieldValue("name", name));
+    EXPECT_EQ(name, "Doe, \"John\"");
+    EXPECT_TRUE(first->GetFieldValue("score", score));
+    EXPECT_EQ(score, 1.5);
+    auto second = tbl->GetRecord(2);
+    EXPECT_TRUE(second->GetFieldValue("name", name));
+    EXPECT_EQ(name, "two\nlines");
+    EXPECT_TRUE(second->IsFieldNull("score", isNull));
+    EXPECT_TRUE(isNull);
+    // the rows keep the order of the file
+    int64_t id = 0;
+    EXPECT_TRUE(tbl->GetRecord(200)->GetFieldValue("id", id));
+    EXPECT_EQ(id, 200);
+
+    {
+        std::ofstream json("test/people.json", std::ios::binary);
+        json << "{\"id\": 201, \"name\": \"caf\\u00e9\", \"score\": 2}\n";
+        json << "{\"id\": 202, \"name\": null, \"tags\": \"ignored\"}\n";
+        json << "{\"id\": \"oops\"}\n";
+        json << "{\"id\": 204}\n";
+    }
+    options.format = ruru::ImportOptions::Format::eJsonLines;
+    options.chunk_size = 1024;
+    EXPECT_FALSE(tbl->Import("test/people.json", options, &result));
+    EXPECT_EQ(result.error_line, 3);
+    EXPECT_EQ(result.rows, 0);
+    EXPECT_EQ(tbl->Search({})->GetSize(), 200);
+
+    // one record per chunk: the records before the bad one are inserted
+    options.chunk_size = 8;
+    EXPECT_FALSE(tbl->Import("test/people.json", options, &result));
+    EXPECT_EQ(result.error_line, 3);
+    EXPECT_EQ(result.rows, 2);
+    auto filter = std::make_shared<ruru::Filter>(0, ruru::OperatorType::eEqual, (int64_t)201, (int64_t)0);
+    auto recs = tbl->Search({filter});
+    EXPECT_EQ(recs->GetSize(), 1);
+    EXPECT_TRUE(recs->First()->GetFieldValue("name", name));
+    EXPECT_EQ(name, "caf\xc3\xa9");
+}
+
+TEST( Table, streamingSearch)
+{
+    removeDatabaseFiles("test/stream.ru");
+    removeTableFiles("test/Events.ru");
+    ruru::DatabasePtr db = ruru::IDatabase::newDatabase("test/stream.ru");
+    ruru::TablePtr tbl = db->newTable("Events");
+    tbl->addColumn(ruru::Column("seq", ruru::DataTypes::eInteger));
+    tbl->addColumn(ruru::Column("kind", ruru::DataTypes::eVarChar));
+
+    std::vector<ruru::RecordTablePtr> batch;
+    for (int64_t i = 0; i < 3000; i++)
+    {
+        auto rec = tbl->CreateRecord();
+        rec->SetFieldValue("seq", i);
+        rec->SetFieldValue("kind", i % 3 == 0 ? "start" : "stop");
+        batch.push_back(rec);
+    }
+    EXPECT_TRUE(tbl->BulkInsert(batch));
+
+    // the result set spans several batches of the cursor
+    auto kind = std::make_shared<ruru::Filter>(1, ruru::OperatorType::eEqual, std::string("start"), std::string());
+    auto recs = tbl->Search({kind});
+    auto rec = recs->First();
+    EXPECT_TRUE(rec != nullptr);
+
+    // the writer goes on while the result set is read
+    auto updated = tbl->GetRecord(4);
+    updated->SetFieldValue("seq", (int64_t)-1);
+    EXPECT_TRUE(updated->Save());
+    auto added = tbl->CreateRecord();
+    added->SetFieldValue("seq", (int64_t)3000);
+    added->SetFieldValue("kind", "start");
+    EXPECT_TRUE(added->Save());
+
+    int64_t expected = 0;
+    int64_t seq = 0;
+    bool ordered = true;
+    while (!recs->Eof())
+    {
+        ordered = ordered && rec->GetFieldValue("seq", seq) && seq == expected;
+        expected += 3;
+        rec = recs->Next();
+    }
+    EXPECT_TRUE(ordered);
+    EXPECT_EQ(expected, 3000);
+    EXPECT_EQ(recs->GetSize(), 1000);
+
+    // First goes back to the start of the result
+    EXPECT_TRUE(recs->First()->GetFieldValue("seq", seq));
+    EXPECT_EQ(seq, 0);
+    EXPECT_EQ(tbl->Search({kind})->GetSize(), 1001);
+
+    // an empty result
+    auto none = std::make_shared<ruru::Filter>(1, ruru::OperatorType::eEqual, std::string("pause"), std::string());
+    auto empty = tbl->Search({none});
+    EXPECT_TRUE(empty->First() == nullptr);
+    EXPECT_TRUE(empty->Eof());
+    EXPECT_EQ(empty->GetSize(), 0);
+}
+
+TEST( Table, searchUpdatedRecords)
+{
+    removeDatabaseFiles("test/updated.ru");
+    removeTableFiles("test/Counters.ru");
+    ruru::DatabasePtr db = ruru::IDatabase::newDatabase("test/updated.ru");
+    ruru::TablePtr tbl = db->newTable("Counters");
+    tbl->addColumn(ruru::Column("value", ruru::DataTypes::eInteger));
+    for (int64_t i = 0; i < 2000; i++)
+    {
+        auto rec = tbl->CreateRecord();
+        rec->SetFieldValue("value", i);
+        EXPECT_TRUE(rec->Save());
+    }
+    // the new versions are appended backwards: the file order is no longer the row id order
+    for (int64_t id = 2000; id > 0; id -= 7)
+    {
+        auto rec = tbl->GetRecord(id);
+        rec->SetFieldValue("value", (int64_t)(id - 1) * 10);
+        EXPECT_TRUE(rec->Save());
+    }
+
+    auto recs = tbl->Search({});
+    auto rec = recs->First();
+    int64_t count = 0;
+    int64_t value = 0;
+    bool ordered = true;
+    while (!recs->Eof())
+    {
+        int64_t id = count + 1;
+        int64_t expected = (2000 - id) % 7 == 0 ? count * 10 : count;
+        ordered = ordered && rec->GetFieldValue("value", value) && value == expected;
+        count++;
+        rec = recs->Next();
+    }
+    EXPECT_TRUE(ordered);
+    EXPECT_EQ(count, 2000);
+
+    auto greater = std::make_shared<ruru::Filter>(0, ruru::OperatorType::eGreater, (int64_t)1999, (int64_t)0);
+    // the updated records from row id 201
+    EXPECT_EQ(tbl->Search({greater})->GetSize(), 258);
+}
+
+TEST( Table, cachedEngine)
+{
+    removeDatabaseFiles("test/cached.ru");
+    removeTableFiles("test/Accounts.ru");
+    for (int round = 0; round < 2; round++)
+    {
+        // the factory is saved with the schema
+        ruru::DatabasePtr db = round == 0 ? ruru::IDatabase::newDatabase("test/cached.ru") : ruru::IDatabase::openDatabase("test/cached.ru");
+        if (round == 0)
+        {
+            EXPECT_TRUE(db->setStorageEngineFactory(ruru::getEngineFactory(ruru::_basic_cached_factory)));
+        }
+        // the second round doesn't keep the whole table
+        db->setCacheBudget(round == 0 ? 16 * 1024 * 1024 : 128 * 1024);
+        ruru::TablePtr tbl = round == 0 ? db->newTable("Accounts") : db->getTable("Accounts");
+        if (round == 0)
+        {
+            tbl->addColumn(ruru::Column("balance", ruru::DataTypes::eInteger));
+            tbl->addColumn(ruru::Column("owner", ruru::DataTypes::eVarChar));
+            for (int64_t i = 0; i < 3000; i++)
+            {
+                auto rec = tbl->CreateRecord();
+                rec->SetFieldValue("balance", i);
+                rec->SetFieldValue("owner", std::string(100, 'a' + i % 26));
+                EXPECT_TRUE(rec->Save());
+            }
+        }
+
+        // the pages read by id stay in the cache, the updates are seen through them
+        int64_t balance = 0;
+        for (ruru::RecordId id = 1; id <= 3000; id += 100)
+        {
+            auto rec = tbl->GetRecord(id);
+            EXPECT_TRUE(rec->GetFieldValue("balance", balance));
+            EXPECT_EQ(balance, round == 0 ? (int64_t)id - 1 : -(int64_t)id);
+            rec->SetFieldValue("balance", -(int64_t)id);
+            EXPECT_TRUE(rec->Save());
+            EXPECT_TRUE(tbl->GetRecord(id)->GetFieldValue("balance", balance));
+            EXPECT_EQ(balance, -(int64_t)id);
+        }
+
+        auto negative = std::make_shared<ruru::Filter>(0, ruru::OperatorType::eLesser, (int64_t)0, (int64_t)0);
+        EXPECT_EQ(tbl->Search({negative})->GetSize(), 30);
+        auto recs = tbl->Search({});
+        int64_t count = 0;
+        for (auto rec = recs->First(); !recs->Eof(); rec = recs->Next())
+            count++;
+        EXPECT_EQ(count, 3000);
+        if (round == 0)
+            db->saveSchema("test/cached.ru");
+    }
+}
 
 int main(int argc, char **argv)
 {
@@ -99,4 +741,4 @@ int main(int argc, char **argv)
     return RUN_ALL_TESTS();
 
     return 0;
-}
\ No newline at end of file
+}
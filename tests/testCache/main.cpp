@@ -18,24 +18,24 @@ static void print_record ( const ruru::Record record)
     {
         if ( f.type_ == ruru::DataTypes::eInteger)
         {
-           auto value = *reinterpret_cast<int64_t *>(f.value_.get());
+           auto value = *reinterpret_cast<const int64_t *>(f.Data());
            std::cout << value << "\n";
         }
         else if ( f.type_ == ruru::DataTypes::eDouble)
         {
-           auto value = *reinterpret_cast<double *>(f.value_.get());
+           auto value = *reinterpret_cast<const double *>(f.Data());
            std::cout << value << "\n";
         }
         else if ( f.type_ == ruru::DataTypes::eVarChar )
         {
             
-            uint64_t *len = reinterpret_cast<uint64_t *>(f.value_.get());
+            const uint64_t *len = reinterpret_cast<const uint64_t *>(f.Data());
             if (*len == 0)
                 std::cout << "<<EMPTY>>" << "\n";
             else
             {
                 std::string value;
-                value.assign(f.value_.get() + 8, *len);
+                value.assign(f.Data() + 8, *len);
                 std::cout << "\"" << value  << "\""<< "\n";
             }
         }